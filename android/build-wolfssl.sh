@@ -117,7 +117,8 @@ fi
 
 ENABLE_QUIC="${ENABLE_QUIC:-1}"
 WOLFSSL_CONFIGURE_QUIC=""
-[ "$ENABLE_QUIC" = "1" ] && WOLFSSL_CONFIGURE_QUIC="--enable-quic"
+# Session tickets and early data back TLS resumption / 0-RTT reconnects.
+[ "$ENABLE_QUIC" = "1" ] && WOLFSSL_CONFIGURE_QUIC="--enable-quic --enable-session-ticket --enable-earlydata"
 
 export CC
 export CFLAGS="-fPIC"
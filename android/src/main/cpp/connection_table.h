@@ -0,0 +1,126 @@
+//
+// connection_table.h
+// MqttQuicPlugin
+//
+// Handle table behind the JNI layer's connection handles. It does not depend
+// on ngtcp2 or JNI, so the host tests in android/src/test/cpp build it on its
+// own.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace mqttquic {
+
+// Handles pack a shard, a slot and a generation, so a lookup only takes its
+// own shard's lock for the length of a shared_ptr copy, and a stale handle
+// (closed, slot since reused) never resolves to another entry. Entries are
+// shared so a call that blocks (connect, read_stream_wait) holds no table
+// lock at all; remove() hands the entry to the caller and it is destroyed
+// when the last caller drops its reference.
+template <typename T>
+class ConnectionTable {
+ public:
+  // 0 if the shard is full.
+  int64_t insert(std::shared_ptr<T> entry) {
+    uint32_t shard_idx =
+        next_shard_.fetch_add(1, std::memory_order_relaxed) % kShards;
+    Shard &shard = shards_[shard_idx];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    uint32_t slot_idx;
+    if (!shard.free_slots.empty()) {
+      slot_idx = shard.free_slots.back();
+      shard.free_slots.pop_back();
+    } else {
+      if (shard.slots.size() > kMaxSlot) {
+        return 0;
+      }
+      slot_idx = (uint32_t)shard.slots.size();
+      shard.slots.emplace_back();
+    }
+    Slot &slot = shard.slots[slot_idx];
+    slot.entry = std::move(entry);
+    return encode(slot.generation, slot_idx, shard_idx);
+  }
+
+  std::shared_ptr<T> find(int64_t handle) {
+    uint32_t gen, slot_idx, shard_idx;
+    decode(handle, &gen, &slot_idx, &shard_idx);
+    Shard &shard = shards_[shard_idx];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Slot *slot = live_slot(shard, gen, slot_idx);
+    return slot ? slot->entry : nullptr;
+  }
+
+  std::shared_ptr<T> remove(int64_t handle) {
+    uint32_t gen, slot_idx, shard_idx;
+    decode(handle, &gen, &slot_idx, &shard_idx);
+    Shard &shard = shards_[shard_idx];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Slot *slot = live_slot(shard, gen, slot_idx);
+    if (!slot) {
+      return nullptr;
+    }
+    auto entry = std::move(slot->entry);
+    // Bump so the old handle stays dead once the slot is reused; skip 0 so
+    // no handle ever encodes to 0 (the Kotlin side's "no connection").
+    slot->generation = (slot->generation + 1) & kGenMask;
+    if (slot->generation == 0) {
+      slot->generation = 1;
+    }
+    shard.free_slots.push_back(slot_idx);
+    return entry;
+  }
+
+ private:
+  static constexpr uint32_t kShardBits = 4;
+  static constexpr uint32_t kShards = 1u << kShardBits;
+  static constexpr uint32_t kSlotBits = 28;
+  static constexpr uint32_t kMaxSlot = (1u << kSlotBits) - 1;
+  static constexpr uint32_t kGenMask = 0x7fffffffu;
+
+  struct Slot {
+    uint32_t generation = 1;
+    std::shared_ptr<T> entry;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> free_slots;
+  };
+
+  static int64_t encode(uint32_t gen, uint32_t slot_idx, uint32_t shard_idx) {
+    return (int64_t)(((uint64_t)gen << 32) |
+                     ((uint64_t)slot_idx << kShardBits) | shard_idx);
+  }
+
+  static void decode(int64_t handle, uint32_t *gen, uint32_t *slot_idx,
+                     uint32_t *shard_idx) {
+    uint64_t h = (uint64_t)handle;
+    *gen = (uint32_t)(h >> 32) & kGenMask;
+    *slot_idx = (uint32_t)(h & 0xffffffffu) >> kShardBits;
+    *shard_idx = (uint32_t)h & (kShards - 1);
+  }
+
+  static Slot *live_slot(Shard &shard, uint32_t gen, uint32_t slot_idx) {
+    if (slot_idx >= shard.slots.size()) {
+      return nullptr;
+    }
+    Slot &slot = shard.slots[slot_idx];
+    if (slot.generation != gen || !slot.entry) {
+      return nullptr;
+    }
+    return &slot;
+  }
+
+  Shard shards_[kShards];
+  std::atomic<uint32_t> next_shard_{0};
+};
+
+}  // namespace mqttquic
@@ -14,34 +14,69 @@
 
 #include <wolfssl/ssl.h>
 
+#include "connection_table.h"
+#include "stream_buffers.h"
+
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cerrno>
 #include <cinttypes>
 #include <cstdarg>
 #include <cstdlib>
 #include <cstdio>
 #include <condition_variable>
+#include <cstring>
 #include <deque>
+#include <functional>
+#include <future>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <queue>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #define LOG_TAG "NGTCP2JNI"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 
+// Older NDK headers predate UDP GSO/GRO (Linux 4.18/5.0); the kernel decides
+// at runtime.
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
 namespace {
 
+using mqttquic::ConnectionTable;
+using mqttquic::MqttFramer;
+using mqttquic::RecvBuffer;
+
 static uint64_t now_ts() {
   struct timespec tp;
   if (clock_gettime(CLOCK_MONOTONIC, &tp) != 0) {
@@ -50,6 +85,10 @@ static uint64_t now_ts() {
   return (uint64_t)tp.tv_sec * NGTCP2_SECONDS + (uint64_t)tp.tv_nsec;
 }
 
+// "No deadline" for the absolute now_ts() deadlines below; also what
+// ngtcp2_conn_get_expiry returns when nothing is armed.
+static constexpr uint64_t kNoDeadline = UINT64_MAX;
+
 static void log_printf(void *user_data, const char *fmt, ...) {
   (void)user_data;
   va_list ap;
@@ -59,20 +98,918 @@ static void log_printf(void *user_data, const char *fmt, ...) {
   fprintf(stderr, "\n");
 }
 
+// Receive flow control for one stream or the whole connection. Credit
+// follows the application's reads, not arrival: once less than half the
+// window is left past what has been consumed, the worker moves the limit
+// to consumed + window (QuicClient::return_credit). On framed streams the
+// bytes of a packet still being received count as consumed on arrival (see
+// append_stream_data), so a packet larger than the window can complete.
+struct FlowWindow {
+  uint64_t window = 0;      // current size; grows with autotuning
+  uint64_t max_offset = 0;  // limit advertised to the peer
+  uint64_t consumed = 0;    // bytes handed to the application
+  ngtcp2_tstamp last_update = 0;
+  bool pending = false;     // queued for the worker
+
+  void init(uint64_t initial, ngtcp2_tstamp now) {
+    window = max_offset = initial;
+    last_update = now;
+  }
+
+  // True the first time the remaining credit drops below half a window.
+  bool consume(uint64_t n) {
+    consumed += n;
+    if (pending || max_offset - consumed >= window / 2) {
+      return false;
+    }
+    pending = true;
+    return true;
+  }
+
+  // Worker. Returns the credit to hand to ngtcp2. Half a window drained
+  // within two RTTs of the previous update means the reader keeps up and
+  // the window is what limits throughput, so it doubles up to max_window,
+  // as TCP receive-window autotuning does.
+  uint64_t update(ngtcp2_tstamp now, ngtcp2_duration rtt, uint64_t max_window) {
+    pending = false;
+    if (window < max_window && now - last_update < 2 * rtt) {
+      window = std::min(window * 2, max_window);
+    }
+    last_update = now;
+    uint64_t target = consumed + window;
+    uint64_t credit = target > max_offset ? target - max_offset : 0;
+    max_offset = std::max(max_offset, target);
+    return credit;
+  }
+};
+
 struct StreamState {
-  std::deque<uint8_t> recv_buf;
+  RecvBuffer recv_buf;
+  // With MQTT framing on, received data goes through framer instead of
+  // recv_buf; readable()/read() pick the right one.
+  bool framed = false;
+  MqttFramer framer;
+  bool framing_error = false;
   bool fin_received = false;
   bool closed = false;
+  FlowWindow flow;
+  // Queued framer bytes that need no credit when read: packets from
+  // DATAGRAM frames, which flow control does not cover, and the part of a
+  // stream packet already counted while it was partial (see
+  // append_stream_data and consume_credit).
+  uint64_t uncredited = 0;
+  // Push delivery bookkeeping (see deliver_stream_data).
+  bool push_pending = false;
+  bool end_delivered = false;
+  // Signalled (under stream_mutex_) when data arrives, the stream ends, or
+  // the connection shuts down; read_stream_wait parks on it.
+  std::condition_variable cv;
+
+  size_t readable() const { return framed ? framer.size() : recv_buf.size(); }
+
+  size_t read(uint8_t *out, size_t maxlen) {
+    return framed ? framer.read(out, maxlen) : recv_buf.read(out, maxlen);
+  }
+};
+
+// Per-stream send buffer indexed by stream offset. ngtcp2 does not copy
+// stream data: any byte it has written may be retransmitted until the peer
+// acknowledges it, so chunk memory must stay put until
+// acked_stream_data_offset_cb covers it. Acks for a stream arrive as a
+// contiguous, increasing range, so chunks are only ever released from the
+// front.
+//
+// A chunk either owns its bytes or borrows caller memory together with a
+// release callback; the callback runs when the chunk is released (acked,
+// stream closed, or connection torn down), so callers can hand buffers over
+// without a copy.
+class SendBuffer {
+ public:
+  void append(const uint8_t *data, size_t len, bool fin) {
+    append(std::vector<uint8_t>(data, data + len), fin);
+  }
+
+  void append(std::vector<uint8_t> data, bool fin) {
+    if (!data.empty()) {
+      Chunk chunk;
+      chunk.owned = std::move(data);
+      chunk.base = chunk.owned.data();
+      chunk.len = chunk.owned.size();
+      push(std::move(chunk));
+    }
+    if (fin) {
+      fin_ = true;
+    }
+  }
+
+  void append_external(const uint8_t *data, size_t len, bool fin,
+                       std::function<void()> release) {
+    if (len > 0) {
+      Chunk chunk;
+      chunk.base = data;
+      chunk.len = len;
+      chunk.release = std::move(release);
+      push(std::move(chunk));
+    } else if (release) {
+      release();
+    }
+    if (fin) {
+      fin_ = true;
+    }
+  }
+
+  // Data from the first byte ngtcp2 has not written yet up to the end of its
+  // chunk. A FIN with no data left yields an empty vec with *fin set.
+  bool next_unsent(ngtcp2_vec *vec, bool *fin) const {
+    if (sent_offset_ == end_offset_) {
+      if (!fin_ || fin_sent_) {
+        return false;
+      }
+      vec->base = nullptr;
+      vec->len = 0;
+      *fin = true;
+      return true;
+    }
+    const Chunk &chunk = chunk_at(sent_offset_);
+    size_t pos = (size_t)(sent_offset_ - chunk.offset);
+    vec->base = const_cast<uint8_t *>(chunk.base) + pos;
+    vec->len = chunk.len - pos;
+    *fin = fin_ && chunk.offset + chunk.len == end_offset_;
+    return true;
+  }
+
+  // Returns how many of the n bytes go out for the first time; bytes sent
+  // again after rewind() are not counted twice.
+  uint64_t mark_sent(size_t n, bool fin) {
+    sent_offset_ += n;
+    if (fin && sent_offset_ == end_offset_) {
+      fin_sent_ = true;
+    }
+    if (sent_offset_ <= max_sent_offset_) {
+      return 0;
+    }
+    uint64_t first_time = sent_offset_ - max_sent_offset_;
+    max_sent_offset_ = sent_offset_;
+    return first_time;
+  }
+
+  // Returns the number of bytes newly acknowledged.
+  uint64_t ack(uint64_t offset, uint64_t len) {
+    uint64_t end = offset + len;
+    if (end <= acked_offset_) {
+      return 0;
+    }
+    uint64_t newly = end - std::max(offset, acked_offset_);
+    acked_offset_ = end;
+    while (!chunks_.empty() &&
+           chunks_.front().offset + chunks_.front().len <= acked_offset_) {
+      retained_ -= chunks_.front().len;
+      chunks_.pop_front();
+    }
+    return newly;
+  }
+
+  // Everything not yet acknowledged goes out again from the first unacked
+  // byte (rejected 0-RTT: the server discarded it). Chunks are only dropped
+  // once acked, so the bytes are still here.
+  void rewind() {
+    sent_offset_ = acked_offset_;
+    fin_sent_ = false;
+  }
+
+  bool has_unsent() const {
+    return sent_offset_ < end_offset_ || (fin_ && !fin_sent_);
+  }
+  uint64_t bytes_unsent() const { return end_offset_ - sent_offset_; }
+  uint64_t bytes_unacked() const { return sent_offset_ - acked_offset_; }
+  uint64_t bytes_retained() const { return retained_; }
+
+ private:
+  struct Chunk {
+    uint64_t offset = 0;
+    const uint8_t *base = nullptr;
+    size_t len = 0;
+    std::vector<uint8_t> owned;
+    std::function<void()> release;
+
+    Chunk() = default;
+    Chunk(Chunk &&other) noexcept
+        : offset(other.offset),
+          base(other.base),
+          len(other.len),
+          owned(std::move(other.owned)),
+          release(std::move(other.release)) {
+      other.release = nullptr;
+    }
+    Chunk &operator=(Chunk &&) = delete;
+    ~Chunk() {
+      if (release) {
+        release();
+      }
+    }
+  };
+
+  void push(Chunk chunk) {
+    chunk.offset = end_offset_;
+    end_offset_ += chunk.len;
+    retained_ += chunk.len;
+    chunks_.push_back(std::move(chunk));
+  }
+
+  const Chunk &chunk_at(uint64_t offset) const {
+    auto it = std::upper_bound(
+        chunks_.begin(), chunks_.end(), offset,
+        [](uint64_t off, const Chunk &c) { return off < c.offset; });
+    return *(it - 1);
+  }
+
+  std::deque<Chunk> chunks_;
+  uint64_t end_offset_ = 0;
+  uint64_t sent_offset_ = 0;
+  uint64_t max_sent_offset_ = 0;  // sent_offset_ before any rewind()
+  uint64_t acked_offset_ = 0;
+  uint64_t retained_ = 0;
+  bool fin_ = false;
+  bool fin_sent_ = false;
+};
+
+// Transport parameters and receive windows advertised to the server (see
+// QuicClient::set_transport_config). Defaults are what init_quic has always
+// sent.
+struct TransportConfig {
+  uint64_t max_streams_bidi = 8;
+  uint64_t max_streams_uni = 8;
+  uint64_t max_stream_data = 256 * 1024;
+  uint64_t max_data = 1024 * 1024;
+  uint64_t max_ack_delay_ms = 1;
+  uint64_t idle_timeout_ms = 30 * 1000;  // 0 disables
+
+  // RFC 9000 bounds (stream counts <= 2^60, max_ack_delay < 2^14 ms, the
+  // rest varints). Zero windows would stall every stream, so they are out
+  // too.
+  bool valid() const {
+    const uint64_t max_varint = (1ULL << 62) - 1;
+    return max_streams_bidi <= (1ULL << 60) && max_streams_uni <= (1ULL << 60) &&
+           max_stream_data > 0 && max_stream_data <= max_varint &&
+           max_data > 0 && max_data <= max_varint &&
+           max_ack_delay_ms < (1ULL << 14) &&
+           idle_timeout_ms <= max_varint / NGTCP2_MILLISECONDS;
+  }
+};
+
+// TLS resumption state per host:port/ALPN: the newest session ticket and the
+// server transport parameters that 0-RTT has to assume before the handshake
+// confirms them. Process-wide so a reconnect from a new QuicClient finds it;
+// with a directory set (set_dir) entries are also written there and survive
+// a restart.
+class SessionCache {
+ public:
+  struct Entry {
+    std::vector<uint8_t> session;           // wolfSSL_i2d_SSL_SESSION
+    std::vector<uint8_t> transport_params;  // ngtcp2 0-RTT encoding
+  };
+
+  static SessionCache &instance() {
+    static auto *cache = new SessionCache();
+    return *cache;
+  }
+
+  static std::string key(const std::string &host, uint16_t port,
+                         const std::string &alpn) {
+    return host + ":" + std::to_string(port) + "/" + alpn;
+  }
+
+  // Empty turns persistence off; entries already in memory are kept.
+  void set_dir(const std::string &dir) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dir_ = dir;
+  }
+
+  bool find(const std::string &key, Entry &out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      Entry loaded;
+      if (!load(key, loaded)) {
+        return false;
+      }
+      it = entries_.emplace(key, std::move(loaded)).first;
+    }
+    out = it->second;
+    return true;
+  }
+
+  void store(const std::string &key, Entry entry) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    save(key, entry);
+    entries_[key] = std::move(entry);
+  }
+
+ private:
+  static constexpr uint32_t kMagic = 0x4353514d;  // "MQSC"
+  static constexpr uint32_t kMaxBlob = 64 * 1024;
+
+  // Hex of the key, so host names and ALPN ids are safe as file names.
+  std::string path(const std::string &key) const {
+    static const char digits[] = "0123456789abcdef";
+    std::string p = dir_ + "/";
+    for (unsigned char c : key) {
+      p.push_back(digits[c >> 4]);
+      p.push_back(digits[c & 0xf]);
+    }
+    return p + ".session";
+  }
+
+  bool load(const std::string &key, Entry &out) const {
+    if (dir_.empty()) {
+      return false;
+    }
+    FILE *f = fopen(path(key).c_str(), "rb");
+    if (!f) {
+      return false;
+    }
+    uint32_t magic = 0;
+    bool ok = fread(&magic, sizeof(magic), 1, f) == 1 && magic == kMagic &&
+              read_blob(f, out.session) && read_blob(f, out.transport_params);
+    fclose(f);
+    return ok && !out.session.empty();
+  }
+
+  // Written to a temp file and renamed, so a reader never sees half of one.
+  void save(const std::string &key, const Entry &entry) const {
+    if (dir_.empty()) {
+      return;
+    }
+    std::string final_path = path(key);
+    std::string tmp_path = final_path + ".tmp";
+    FILE *f = fopen(tmp_path.c_str(), "wb");
+    if (!f) {
+      return;
+    }
+    uint32_t magic = kMagic;
+    bool ok = fwrite(&magic, sizeof(magic), 1, f) == 1 &&
+              write_blob(f, entry.session) &&
+              write_blob(f, entry.transport_params);
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp_path.c_str(), final_path.c_str()) != 0) {
+      unlink(tmp_path.c_str());
+    }
+  }
+
+  static bool read_blob(FILE *f, std::vector<uint8_t> &out) {
+    uint32_t len = 0;
+    if (fread(&len, sizeof(len), 1, f) != 1 || len > kMaxBlob) {
+      return false;
+    }
+    out.resize(len);
+    return len == 0 || fread(out.data(), 1, len, f) == len;
+  }
+
+  static bool write_blob(FILE *f, const std::vector<uint8_t> &in) {
+    uint32_t len = (uint32_t)in.size();
+    return fwrite(&len, sizeof(len), 1, f) == 1 &&
+           (len == 0 || fwrite(in.data(), 1, len, f) == len);
+  }
+
+  std::mutex mutex_;
+  std::string dir_;
+  std::unordered_map<std::string, Entry> entries_;
+};
+
+// Trust-anchor blob written by build-ca-store.py: "MQCA", version, count,
+// reserved (u32 each, little-endian), then count index entries {u32 offset,
+// u32 length}, then the DER certificates. Loading it skips PEM decoding and
+// the per-file reads of a CA directory. wolfSSL only verifies against
+// signers already in the context, so every anchor is added; the index only
+// gives their bounds without parsing the DER. Version 1 blobs also carried
+// an unused u64 subject hash before each entry and still load.
+static constexpr size_t kCaBlobHeader = 16;
+static constexpr size_t kCaBlobEntry = 8;
+static constexpr size_t kCaBlobEntryV1 = 16;
+
+static uint32_t read_le32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+// Number of anchors added to ctx, 0 if path is not a blob (load it as PEM),
+// or -1 if it is one but is corrupt.
+static int load_ca_blob(WOLFSSL_CTX *ctx, const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return 0;  // the PEM loader reports it
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)kCaBlobHeader) {
+    ::close(fd);
+    return 0;
+  }
+  size_t size = (size_t)st.st_size;
+  void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    return 0;
+  }
+  const uint8_t *base = static_cast<const uint8_t *>(map);
+  if (memcmp(base, "MQCA", 4) != 0) {
+    munmap(map, size);
+    return 0;
+  }
+  uint32_t version = read_le32(base + 4);
+  uint32_t count = read_le32(base + 8);
+  size_t stride = version == 1 ? kCaBlobEntryV1 : kCaBlobEntry;
+  int loaded = 0;
+  if ((version != 1 && version != 2) || count == 0 ||
+      count > (size - kCaBlobHeader) / stride) {
+    loaded = -1;
+  }
+  for (uint32_t i = 0; loaded >= 0 && i < count; ++i) {
+    const uint8_t *entry = base + kCaBlobHeader + (size_t)i * stride +
+                           (stride - kCaBlobEntry);
+    size_t offset = read_le32(entry);
+    size_t len = read_le32(entry + 4);
+    if (offset > size || len == 0 || len > size - offset ||
+        wolfSSL_CTX_load_verify_buffer(ctx, base + offset, (long)len,
+                                       WOLFSSL_FILETYPE_ASN1) != 1) {
+      loaded = -1;
+      break;
+    }
+    ++loaded;
+  }
+  munmap(map, size);
+  return loaded;
+}
+
+// WOLFSSL_CTX shared by every QuicClient with the same trust settings.
+// Building one parses the whole CA store, which dominates connect setup on
+// slow devices; after the first connect it is a map lookup. A context is
+// never changed once built (wolfSSL allows sharing it across threads then)
+// and lives for the process: there is one per distinct CA configuration,
+// and dropping it with the last client would put the parse back on every
+// reconnect.
+class TlsContextCache {
+ public:
+  using NewSessionCb = int (*)(WOLFSSL *, WOLFSSL_SESSION *);
+
+  // ca_file / ca_path may be null or empty; with neither the platform store
+  // is used. Null with *error set if the context could not be built.
+  // Failures are not cached, so a corrected CA setting applies on the next
+  // connect.
+  static std::shared_ptr<WOLFSSL_CTX> get(const char *ca_file,
+                                          const char *ca_path, int verify_mode,
+                                          NewSessionCb new_session,
+                                          bool *reused, std::string *error) {
+    std::string file = ca_file ? ca_file : "";
+    std::string path = ca_path ? ca_path : "";
+    std::string key = std::to_string(verify_mode) + "\n" + file + "\n" + path;
+    // Held while building, so concurrent first connects parse the store once.
+    std::lock_guard<std::mutex> lock(mutex());
+    auto it = contexts().find(key);
+    if (it != contexts().end()) {
+      *reused = true;
+      return it->second;
+    }
+    *reused = false;
+    std::shared_ptr<WOLFSSL_CTX> ctx =
+        build(file, path, verify_mode, new_session, error);
+    if (ctx) {
+      contexts().emplace(key, ctx);
+    }
+    return ctx;
+  }
+
+ private:
+  static std::shared_ptr<WOLFSSL_CTX> build(const std::string &file,
+                                            const std::string &path,
+                                            int verify_mode,
+                                            NewSessionCb new_session,
+                                            std::string *error) {
+    std::shared_ptr<WOLFSSL_CTX> ctx(wolfSSL_CTX_new(wolfTLS_client_method()),
+                                     [](WOLFSSL_CTX *c) {
+                                       if (c) {
+                                         wolfSSL_CTX_free(c);
+                                       }
+                                     });
+    if (!ctx) {
+      *error = "wolfSSL_CTX_new failed";
+      return nullptr;
+    }
+    if (ngtcp2_crypto_wolfssl_configure_client_context(ctx.get()) != 0) {
+      *error = "ngtcp2_crypto_wolfssl_configure_client_context failed";
+      return nullptr;
+    }
+    wolfSSL_CTX_set_verify(ctx.get(), verify_mode, nullptr);
+    // Tickets reach new_session; clients without session resumption ignore
+    // them.
+    wolfSSL_CTX_set_session_cache_mode(
+        ctx.get(), WOLFSSL_SESS_CACHE_CLIENT | WOLFSSL_SESS_CACHE_NO_INTERNAL_STORE);
+    wolfSSL_CTX_sess_set_new_cb(ctx.get(), new_session);
+
+    auto ca_start = std::chrono::steady_clock::now();
+    const char *file_arg = file.empty() ? nullptr : file.c_str();
+    const char *path_arg = path.empty() ? nullptr : path.c_str();
+    const char *source = "system";
+    bool ca_loaded = false;
+    int blob_anchors = file_arg ? load_ca_blob(ctx.get(), file_arg) : 0;
+    if (blob_anchors < 0) {
+      *error = "Corrupt CA blob in MQTT_QUIC_CA_FILE";
+      return nullptr;
+    }
+    if (blob_anchors > 0) {
+      ca_loaded = true;
+      source = "blob";
+      file_arg = nullptr;
+    }
+    if (file_arg || path_arg) {
+      if (wolfSSL_CTX_load_verify_locations(ctx.get(), file_arg, path_arg) != 1) {
+        *error = "Failed to load CA bundle from MQTT_QUIC_CA_FILE/CA_PATH";
+        return nullptr;
+      }
+      ca_loaded = true;
+      if (blob_anchors == 0) {
+        source = "pem";
+      }
+    }
+    if (!ca_loaded && wolfSSL_CTX_set_default_verify_paths(ctx.get()) == 1) {
+      ca_loaded = true;
+    }
+    if (!ca_loaded && wolfSSL_CTX_load_system_CA_certs(ctx.get()) == 1) {
+      ca_loaded = true;
+    }
+    if (!ca_loaded) {
+      *error = "No CA bundle available for TLS verification";
+      return nullptr;
+    }
+    LOGI("CA load %.2f ms (%s)",
+         std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - ca_start).count(),
+         source);
+    return ctx;
+  }
+
+  static std::unordered_map<std::string, std::shared_ptr<WOLFSSL_CTX>> &contexts() {
+    static auto *map =
+        new std::unordered_map<std::string, std::shared_ptr<WOLFSSL_CTX>>();
+    return *map;
+  }
+  static std::mutex &mutex() {
+    static auto *m = new std::mutex();
+    return *m;
+  }
+};
+
+// Snapshot returned by QuicClient::stats(). Field order is also the layout of
+// the exported stats array; append new fields at the end.
+struct ClientStats {
+  uint64_t stream_bytes_sent = 0;
+  uint64_t stream_bytes_acked = 0;
+  uint64_t stream_bytes_unacked = 0;
+  uint64_t stream_bytes_unsent = 0;
+  uint64_t send_buffer_bytes = 0;
+  uint64_t wakeup_enqueues = 0;
+  uint64_t wakeups = 0;
+  uint64_t recv_syscalls = 0;
+  uint64_t recv_packets = 0;
+  uint64_t send_syscalls = 0;
+  uint64_t send_packets = 0;
+  uint64_t path_max_udp_payload = 0;
+  uint64_t loop_wakeups = 0;
+  uint64_t spurious_wakeups = 0;
+  uint64_t recv_window = 0;
+  uint64_t credit_updates = 0;
+  uint64_t session_resumed = 0;
+  uint64_t early_data_accepted = 0;
+  uint64_t datagrams_sent = 0;
+  uint64_t datagrams_received = 0;
+  uint64_t datagrams_lost = 0;
+};
+
+// Optional shared event loops (set_reactor_threads > 0). Instead of a
+// worker thread polling two fds per connection, a small fixed pool of loop
+// threads each multiplex many connections with epoll, with per-connection
+// timers in a heap keyed by the next ngtcp2 expiry and a timerfd armed to
+// the earliest of them. A connection stays on
+// one loop for its lifetime, so everything that ran on its worker thread
+// still runs on a single thread.
+class ReactorClient {
+ public:
+  virtual ~ReactorClient() = default;
+  virtual int reactor_socket_fd() const = 0;
+  virtual int reactor_wakeup_fd() const = 0;
+  // One pass of the connection's event loop; false once it should stop.
+  virtual bool reactor_service(bool socket_ready, bool wakeup_ready) = 0;
+  // now_ts() time of the connection's next timed pass, or kNoDeadline.
+  virtual uint64_t reactor_deadline() = 0;
+  // The loop has dropped the connection and will not touch it again.
+  virtual void reactor_detached() = 0;
+};
+
+class ReactorLoop {
+ public:
+  ReactorLoop()
+      : epfd_(epoll_create1(EPOLL_CLOEXEC)),
+        ctl_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+        timer_fd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) {
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = kCtlToken;
+    bool ok = epfd_ >= 0 && ctl_fd_ >= 0 && timer_fd_ >= 0 &&
+              epoll_ctl(epfd_, EPOLL_CTL_ADD, ctl_fd_, &ev) == 0;
+    ev.data.u64 = kTimerToken;
+    if (ok && epoll_ctl(epfd_, EPOLL_CTL_ADD, timer_fd_, &ev) == 0) {
+      thread_ = std::thread([this]() { run(); });
+    }
+  }
+
+  // Loops live for the rest of the process; see Reactor.
+  ReactorLoop(const ReactorLoop &) = delete;
+  ReactorLoop &operator=(const ReactorLoop &) = delete;
+
+  bool ok() const { return thread_.joinable(); }
+  size_t load() const { return load_.load(std::memory_order_relaxed); }
+
+  // Hands the connection to the loop thread, which registers it and runs a
+  // first pass.
+  void attach(ReactorClient *client) {
+    load_.fetch_add(1, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_.push_back(client);
+    }
+    uint64_t one = 1;
+    write(ctl_fd_, &one, sizeof(one));
+  }
+
+ private:
+  static constexpr uint64_t kCtlToken = ~(uint64_t)0;
+  static constexpr uint64_t kTimerToken = ~(uint64_t)1;
+  static constexpr int kMaxEvents = 64;
+
+  struct Registration {
+    ReactorClient *client = nullptr;
+    int socket_fd = -1;
+    uint64_t timer_seq = 0;
+    bool socket_ready = false;
+    bool wakeup_ready = false;
+    bool queued = false;
+  };
+
+  struct Timer {
+    uint64_t deadline;  // now_ts() time
+    uint64_t id;
+    uint64_t seq;
+    bool operator>(const Timer &o) const { return deadline > o.deadline; }
+  };
+
+  void run() {
+    epoll_event events[kMaxEvents];
+    for (;;) {
+      int n = epoll_wait(epfd_, events, kMaxEvents, arm_timer());
+      if (n < 0) {
+        if (errno != EINTR) {
+          LOGE("reactor epoll_wait failed errno=%d", errno);
+        }
+        n = 0;
+      }
+      for (int i = 0; i < n; i++) {
+        uint64_t token = events[i].data.u64;
+        if (token == kCtlToken) {
+          take_pending();
+          continue;
+        }
+        if (token == kTimerToken) {
+          uint64_t expirations;
+          read(timer_fd_, &expirations, sizeof(expirations));
+          continue;
+        }
+        auto it = regs_.find(token >> 1);
+        if (it == regs_.end()) {
+          continue;
+        }
+        if (token & 1) {
+          it->second.wakeup_ready = true;
+        } else {
+          it->second.socket_ready = true;
+        }
+        enqueue(it->first, it->second);
+      }
+      uint64_t now = now_ts();
+      while (!timers_.empty() && timers_.top().deadline <= now) {
+        Timer t = timers_.top();
+        timers_.pop();
+        auto it = regs_.find(t.id);
+        if (it != regs_.end() && it->second.timer_seq == t.seq) {
+          enqueue(it->first, it->second);
+        }
+      }
+      for (uint64_t id : ready_) {
+        service(id);
+      }
+      ready_.clear();
+    }
+  }
+
+  void take_pending() {
+    uint64_t count;
+    read(ctl_fd_, &count, sizeof(count));
+    std::vector<ReactorClient *> pending;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending.swap(pending_);
+    }
+    for (ReactorClient *client : pending) {
+      uint64_t id = next_id_++;
+      epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN;
+      ev.data.u64 = id << 1;
+      bool ok = epoll_ctl(epfd_, EPOLL_CTL_ADD, client->reactor_socket_fd(), &ev) == 0;
+      ev.data.u64 = (id << 1) | 1;
+      ok = ok && epoll_ctl(epfd_, EPOLL_CTL_ADD, client->reactor_wakeup_fd(), &ev) == 0;
+      Registration &reg = regs_[id];
+      reg.client = client;
+      reg.socket_fd = client->reactor_socket_fd();
+      // connect_async signals the wakeup fd right after attaching.
+      reg.wakeup_ready = true;
+      if (!ok) {
+        LOGE("reactor could not register connection errno=%d", errno);
+        detach(id);
+        continue;
+      }
+      enqueue(id, reg);
+    }
+  }
+
+  void enqueue(uint64_t id, Registration &reg) {
+    if (!reg.queued) {
+      reg.queued = true;
+      ready_.push_back(id);
+    }
+  }
+
+  void service(uint64_t id) {
+    auto it = regs_.find(id);
+    if (it == regs_.end()) {
+      return;
+    }
+    Registration &reg = it->second;
+    bool socket_ready = reg.socket_ready;
+    bool wakeup_ready = reg.wakeup_ready;
+    reg.socket_ready = false;
+    reg.wakeup_ready = false;
+    reg.queued = false;
+    if (!reg.client->reactor_service(socket_ready, wakeup_ready)) {
+      detach(id);
+      return;
+    }
+    if (reg.client->reactor_socket_fd() != reg.socket_fd && !rearm_socket(id, reg)) {
+      return;
+    }
+    // Older heap entries for this connection go stale (seq mismatch).
+    uint64_t deadline = reg.client->reactor_deadline();
+    ++reg.timer_seq;
+    if (deadline != kNoDeadline) {
+      timers_.push(Timer{deadline, id, reg.timer_seq});
+    }
+  }
+
+  // The connection migrated to a new socket. The old one is closed, which
+  // already took it out of the epoll set.
+  bool rearm_socket(uint64_t id, Registration &reg) {
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = id << 1;
+    reg.socket_fd = reg.client->reactor_socket_fd();
+    if (epoll_ctl(epfd_, EPOLL_CTL_ADD, reg.socket_fd, &ev) != 0) {
+      LOGE("reactor could not register migrated socket errno=%d", errno);
+      detach(id);
+      return false;
+    }
+    return true;
+  }
+
+  void detach(uint64_t id) {
+    auto it = regs_.find(id);
+    ReactorClient *client = it->second.client;
+    regs_.erase(it);
+    epoll_ctl(epfd_, EPOLL_CTL_DEL, client->reactor_socket_fd(), nullptr);
+    epoll_ctl(epfd_, EPOLL_CTL_DEL, client->reactor_wakeup_fd(), nullptr);
+    load_.fetch_sub(1, std::memory_order_relaxed);
+    client->reactor_detached();
+  }
+
+  // The epoll_wait timeout: 0 when work is already due, otherwise -1 with
+  // the timerfd armed (absolute, full nanosecond resolution) at the earliest
+  // live deadline.
+  int arm_timer() {
+    while (!timers_.empty()) {
+      const Timer &t = timers_.top();
+      auto it = regs_.find(t.id);
+      if (it != regs_.end() && it->second.timer_seq == t.seq) {
+        break;
+      }
+      timers_.pop();
+    }
+    if (!ready_.empty()) {
+      return 0;
+    }
+    uint64_t deadline = timers_.empty() ? kNoDeadline : timers_.top().deadline;
+    if (deadline != kNoDeadline && deadline <= now_ts()) {
+      return 0;
+    }
+    if (deadline != armed_deadline_) {
+      // A zero it_value disarms the timer.
+      struct itimerspec its;
+      memset(&its, 0, sizeof(its));
+      if (deadline != kNoDeadline) {
+        its.it_value.tv_sec = (time_t)(deadline / NGTCP2_SECONDS);
+        its.it_value.tv_nsec = (long)(deadline % NGTCP2_SECONDS);
+      }
+      if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &its, nullptr) != 0) {
+        LOGE("reactor timerfd_settime failed errno=%d", errno);
+      }
+      armed_deadline_ = deadline;
+    }
+    return -1;
+  }
+
+  int epfd_;
+  int ctl_fd_;
+  int timer_fd_;
+  std::thread thread_;
+  std::atomic<size_t> load_{0};
+  std::mutex mutex_;
+  std::vector<ReactorClient *> pending_;
+  // Loop thread only.
+  std::unordered_map<uint64_t, Registration> regs_;
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+  std::vector<uint64_t> ready_;
+  uint64_t next_id_ = 0;
+  uint64_t armed_deadline_ = kNoDeadline;
 };
 
-struct OutgoingChunk {
-  std::vector<uint8_t> data;
-  size_t offset = 0;
-  bool fin = false;
+// The process-wide loop pool. Configured once; connections created after
+// that go to the least loaded loop.
+class Reactor {
+ public:
+  static int set_threads(size_t threads) {
+    std::lock_guard<std::mutex> lock(mutex());
+    auto &pool = loops();
+    if (!pool.empty()) {
+      return pool.size() == threads ? 0 : -1;
+    }
+    for (size_t i = 0; i < threads; i++) {
+      auto *loop = new ReactorLoop();
+      if (!loop->ok()) {
+        LOGE("reactor loop %zu failed to start", i);
+        return -1;
+      }
+      pool.push_back(loop);
+    }
+    LOGI("reactor started with %zu loops", threads);
+    return 0;
+  }
+
+  // nullptr when no pool is configured (thread-per-connection).
+  static ReactorLoop *pick() {
+    std::lock_guard<std::mutex> lock(mutex());
+    ReactorLoop *best = nullptr;
+    for (ReactorLoop *loop : loops()) {
+      if (!best || loop->load() < best->load()) {
+        best = loop;
+      }
+    }
+    return best;
+  }
+
+ private:
+  // Leaked on purpose: loop threads run until exit, so nothing may be
+  // destroyed under them during static teardown.
+  static std::vector<ReactorLoop *> &loops() {
+    static auto *pool = new std::vector<ReactorLoop *>();
+    return *pool;
+  }
+  static std::mutex &mutex() {
+    static auto *m = new std::mutex();
+    return *m;
+  }
 };
 
-class QuicClient {
+class QuicClient : public ReactorClient {
  public:
+  // Receives stream data pushed from the worker thread. data/len is only
+  // valid for the duration of the call: on a framed stream it is exactly one
+  // MQTT packet (packet set), otherwise everything that arrived for the
+  // stream in one batch. A final call with fin set and no data reports,
+  // once, that the stream has ended (FIN, reset, or connection closed).
+  using StreamListener =
+      std::function<void(int64_t stream_id, const uint8_t *data, size_t len,
+                         bool packet, bool fin)>;
+
+  using ConnectCallback = std::function<void(int result)>;
+
   QuicClient(std::string host, uint16_t port)
       : QuicClient(std::move(host), "", port) {}
 
@@ -81,7 +1018,6 @@ class QuicClient {
         connect_addr_(connect_addr.empty() ? host_ : std::move(connect_addr)),
         port_(port),
         fd_(-1),
-        ssl_ctx_(nullptr),
         ssl_(nullptr),
         conn_(nullptr),
         running_(false),
@@ -90,20 +1026,30 @@ class QuicClient {
     ngtcp2_ccerr_default(&last_error_);
     conn_ref_.get_conn = get_conn;
     conn_ref_.user_data = this;
-    wakeup_fds_[0] = -1;
-    wakeup_fds_[1] = -1;
   }
 
   ~QuicClient() { close(); }
 
-  int connect(const std::string &alpn) {
+  // Starts the handshake and returns without waiting for it. done(0) fires
+  // once on the worker thread when the handshake completes, or done(-1) (see
+  // last_error) if it fails, times out, or the client is closed first. Returns
+  // -1 without calling done if the connection could not be set up.
+  int connect_async(const std::string &alpn, ConnectCallback done) {
     {
-      std::lock_guard<std::mutex> lock(state_mutex_);
+      std::unique_lock<std::mutex> lock(state_mutex_);
       if (connected_) {
+        lock.unlock();
+        done(0);
         return 0;
       }
+      if (started_) {
+        setError("QUIC connect already started on this client");
+        return -1;
+      }
+      started_ = true;
     }
     clearError();
+    session_key_ = SessionCache::key(host_, port_, alpn);
     if (init_socket() != 0) {
       return -1;
     }
@@ -113,28 +1059,33 @@ class QuicClient {
     if (init_quic() != 0) {
       return -1;
     }
-    if (init_wakeup_pipe() != 0) {
+    if (init_wakeup_fd() != 0) {
       return -1;
     }
 
+    // Only the worker touches these once it is started.
+    connect_done_ = std::move(done);
     running_ = true;
-    worker_ = std::thread([this]() { run_loop(); });
+    if (ReactorLoop *loop = Reactor::pick()) {
+      {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        on_reactor_ = true;
+      }
+      loop->attach(this);
+    } else {
+      worker_ = std::thread([this]() { run_loop(); });
+    }
     signal_wakeup();
+    return 0;
+  }
 
-    std::unique_lock<std::mutex> wait_lock(state_mutex_);
-    if (!cv_state_.wait_for(wait_lock, std::chrono::seconds(15), [this]() {
-          return connected_ || !running_;
-        })) {
-      setError("QUIC handshake timed out");
-      return -1;
-    }
-    if (!connected_) {
-      if (last_error_str_.empty()) {
-        setError("QUIC handshake failed");
-      }
+  int connect(const std::string &alpn) {
+    auto result = std::make_shared<std::promise<int>>();
+    std::future<int> done = result->get_future();
+    if (connect_async(alpn, [result](int rv) { result->set_value(rv); }) != 0) {
       return -1;
     }
-    return 0;
+    return done.get();
   }
 
   int64_t open_stream() {
@@ -150,7 +1101,11 @@ class QuicClient {
     }
     {
       std::lock_guard<std::mutex> lock(stream_mutex_);
-      streams_.emplace(stream_id, StreamState{});
+      stream_state(stream_id);
+      if (dgram_stream_id_ < 0) {
+        // The MQTT session's stream; received datagrams join it.
+        dgram_stream_id_ = stream_id;
+      }
     }
     signal_wakeup();
     return stream_id;
@@ -162,13 +1117,51 @@ class QuicClient {
       setError("QUIC connection not initialized");
       return -1;
     }
-    OutgoingChunk chunk;
-    chunk.data.assign(data, data + datalen);
-    chunk.offset = 0;
-    chunk.fin = fin;
     {
       std::lock_guard<std::mutex> lock(out_mutex_);
-      outgoing_[stream_id].push_back(std::move(chunk));
+      if (!writable(stream_id)) {
+        return -1;
+      }
+      send_bufs_[stream_id].append(data, datalen, fin);
+    }
+    signal_wakeup();
+    return 0;
+  }
+
+  // Takes ownership of data; no further copy before ngtcp2 reads it.
+  int write_stream(int64_t stream_id, std::vector<uint8_t> data, bool fin) {
+    if (!conn_) {
+      setError("QUIC connection not initialized");
+      return -1;
+    }
+    {
+      std::lock_guard<std::mutex> lock(out_mutex_);
+      if (!writable(stream_id)) {
+        return -1;
+      }
+      send_bufs_[stream_id].append(std::move(data), fin);
+    }
+    signal_wakeup();
+    return 0;
+  }
+
+  // Queues caller memory without copying. data must stay valid and unchanged
+  // until release runs (once, on the worker or in close()). On failure
+  // release is not called and the caller keeps ownership.
+  int write_stream_nocopy(int64_t stream_id, const uint8_t *data,
+                          size_t datalen, bool fin,
+                          std::function<void()> release) {
+    if (!conn_) {
+      setError("QUIC connection not initialized");
+      return -1;
+    }
+    {
+      std::lock_guard<std::mutex> lock(out_mutex_);
+      if (!writable(stream_id)) {
+        return -1;
+      }
+      send_bufs_[stream_id].append_external(data, datalen, fin,
+                                            std::move(release));
     }
     signal_wakeup();
     return 0;
@@ -181,10 +1174,9 @@ class QuicClient {
       return 0;
     }
     StreamState &state = it->second;
-    size_t n = std::min(maxlen, state.recv_buf.size());
-    for (size_t i = 0; i < n; ++i) {
-      buffer[i] = state.recv_buf.front();
-      state.recv_buf.pop_front();
+    size_t n = state.read(buffer, maxlen);
+    if (consume_credit(stream_id, state, n)) {
+      signal_wakeup();
     }
     if (n > 0) {
       LOGI("read_stream stream_id=%" PRId64 " returning %zu bytes", (int64_t)stream_id, n);
@@ -192,6 +1184,106 @@ class QuicClient {
     return (ssize_t)n;
   }
 
+  // Blocking variant of read_stream: parks until data is buffered, the
+  // stream ends, or timeout_ns elapses. Returns bytes read, 0 on timeout,
+  // or -1 once the stream has ended with nothing left to read.
+  ssize_t read_stream_wait(int64_t stream_id, uint8_t *buffer, size_t maxlen,
+                           uint64_t timeout_ns) {
+    std::unique_lock<std::mutex> lock(stream_mutex_);
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end()) {
+      lock.unlock();
+      setError("Unknown QUIC stream");
+      return -1;
+    }
+    StreamState &state = it->second;
+    wait_readable(lock, state, timeout_ns, [&]() { return state.readable() > 0; });
+    size_t n = state.read(buffer, maxlen);
+    if (consume_credit(stream_id, state, n)) {
+      signal_wakeup();
+    }
+    bool eof = n == 0 && stream_ended(state);
+    lock.unlock();
+    if (eof) {
+      setError("QUIC stream closed");
+      return -1;
+    }
+    return (ssize_t)n;
+  }
+
+  // MQTT framing: streams created after this hand out whole packets via
+  // read_packet. Set before connect().
+  void set_mqtt_framing(bool enabled) {
+    std::lock_guard<std::mutex> lock(stream_mutex_);
+    mqtt_framing_ = enabled;
+  }
+
+  // Framed streams: the next whole MQTT packet, waiting up to timeout_ns for
+  // one to complete. Returns 1 with the packet in out, 0 on timeout, or -1
+  // once the stream has ended with no complete packet left.
+  int read_packet(int64_t stream_id, std::vector<uint8_t> &out,
+                  uint64_t timeout_ns) {
+    std::unique_lock<std::mutex> lock(stream_mutex_);
+    StreamState *state = framed_stream(stream_id);
+    if (!state) {
+      lock.unlock();
+      setError("Unknown or unframed QUIC stream");
+      return -1;
+    }
+    wait_readable(lock, *state, timeout_ns,
+                  [state]() { return state->framer.has_packet(); });
+    if (state->framer.pop(out)) {
+      if (consume_credit(stream_id, *state, out.size())) {
+        signal_wakeup();
+      }
+      return 1;
+    }
+    bool eof = stream_ended(*state);
+    lock.unlock();
+    if (eof) {
+      setError("QUIC stream closed");
+      return -1;
+    }
+    return 0;
+  }
+
+  // Same, copying into a caller buffer. Returns the packet length, 0 on
+  // timeout, -1 once the stream has ended, or -2 if maxlen is too small, in
+  // which case the packet stays queued and *needed holds its size.
+  ssize_t read_packet(int64_t stream_id, uint8_t *buffer, size_t maxlen,
+                      uint64_t timeout_ns, size_t *needed) {
+    std::unique_lock<std::mutex> lock(stream_mutex_);
+    StreamState *state = framed_stream(stream_id);
+    if (!state) {
+      lock.unlock();
+      setError("Unknown or unframed QUIC stream");
+      return -1;
+    }
+    wait_readable(lock, *state, timeout_ns,
+                  [state]() { return state->framer.has_packet(); });
+    if (state->framer.has_packet()) {
+      size_t len = state->framer.front_size();
+      if (needed) {
+        *needed = len;
+      }
+      if (len > maxlen) {
+        return -2;
+      }
+      state->framer.read(buffer, len);
+      if (consume_credit(stream_id, *state, len)) {
+        signal_wakeup();
+      }
+      return (ssize_t)len;
+    }
+    bool eof = stream_ended(*state);
+    lock.unlock();
+    if (eof) {
+      setError("QUIC stream closed");
+      return -1;
+    }
+    return 0;
+  }
+
   int close_stream(int64_t stream_id) {
     if (!conn_) {
       return 0;
@@ -201,6 +1293,10 @@ class QuicClient {
       setError(ngtcp2_strerror(rv));
       return -1;
     }
+    {
+      std::lock_guard<std::mutex> lock(out_mutex_);
+      send_closed_.insert(stream_id);
+    }
     signal_wakeup();
     return 0;
   }
@@ -208,13 +1304,18 @@ class QuicClient {
   int close() {
     {
       std::lock_guard<std::mutex> lock(state_mutex_);
-      if (!running_) {
-        cleanup();
-        return 0;
+      if (running_) {
+        close_requested_ = true;
       }
-      close_requested_ = true;
     }
     signal_wakeup();
+    {
+      // Reactor mode: the loop runs the close pass, then drops us.
+      std::unique_lock<std::mutex> lock(state_mutex_);
+      reactor_cv_.wait(lock, [this]() { return !on_reactor_; });
+    }
+    // Also reaps a worker that already exited on its own (failed or timed
+    // out handshake).
     if (worker_.joinable()) {
       worker_.join();
     }
@@ -222,6 +1323,38 @@ class QuicClient {
     return 0;
   }
 
+  int reactor_socket_fd() const override { return fd_; }
+  int reactor_wakeup_fd() const override { return wakeup_fd_; }
+
+  bool reactor_service(bool socket_ready, bool wakeup_ready) override {
+    return running_ && loop_pass(socket_ready, wakeup_ready);
+  }
+
+  uint64_t reactor_deadline() override { return next_deadline(); }
+
+  void reactor_detached() override {
+    if (running_) {
+      finish_loop();
+    }
+    {
+      std::lock_guard<std::mutex> lock(state_mutex_);
+      on_reactor_ = false;
+    }
+    reactor_cv_.notify_all();
+  }
+
+  // With a listener set, received data no longer waits in recv_buf for
+  // read_stream: the worker drains it into the listener after each batch of
+  // packets. Set before connect() so nothing is missed.
+  void set_stream_listener(StreamListener listener) {
+    std::lock_guard<std::mutex> lock(stream_mutex_);
+    if (listener) {
+      stream_listener_ = std::make_shared<const StreamListener>(std::move(listener));
+    } else {
+      stream_listener_.reset();
+    }
+  }
+
   int is_connected() const { return connected_ ? 1 : 0; }
 
   const char *last_error() const { return last_error_str_.c_str(); }
@@ -229,10 +1362,10 @@ class QuicClient {
   int on_recv_stream_data(uint32_t flags, int64_t stream_id,
                           const uint8_t *data, size_t datalen) {
     std::lock_guard<std::mutex> lock(stream_mutex_);
-    StreamState &state = streams_[stream_id];
-    state.recv_buf.insert(state.recv_buf.end(), data, data + datalen);
-    LOGI("recv stream data stream_id=%" PRId64 " len=%zu recv_buf_total=%zu",
-         (int64_t)stream_id, datalen, state.recv_buf.size());
+    StreamState &state = stream_state(stream_id);
+    append_stream_data(stream_id, state, data, datalen);
+    LOGI("recv stream data stream_id=%" PRId64 " len=%zu readable=%zu",
+         (int64_t)stream_id, datalen, state.readable());
     if (datalen > 2 && datalen <= 32) {
       char hex[128];
       size_t n = datalen < 16 ? datalen : 16u;
@@ -250,7 +1383,190 @@ class QuicClient {
     if (flags & NGTCP2_STREAM_DATA_FLAG_FIN) {
       state.fin_received = true;
     }
-    return 0;
+    mark_push_pending(stream_id, state);
+    state.cv.notify_all();
+    return 0;
+  }
+
+  // A DATAGRAM frame holds one or more whole QoS 0 PUBLISH packets. They
+  // join the MQTT stream's packet queue, so readers take them like any
+  // other PUBLISH; they may overtake packets still in flight on the stream.
+  // Anything else (partial, malformed, other packet types) is dropped.
+  void on_recv_datagram(const uint8_t *data, size_t datalen) {
+    MqttFramer framer;
+    if (!framer.feed(data, datalen) || !framer.idle() || !framer.has_packet()) {
+      return;
+    }
+    datagrams_received_.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(stream_mutex_);
+    auto it = streams_.find(dgram_stream_id_);
+    if (it == streams_.end() || !it->second.framed || stream_ended(it->second)) {
+      return;
+    }
+    StreamState &state = it->second;
+    std::vector<uint8_t> packet;
+    while (framer.pop(packet)) {
+      if ((packet[0] & 0xf6) != 0x30) {  // PUBLISH with QoS 0
+        continue;
+      }
+      state.uncredited += packet.size();
+      state.framer.push_packet(std::move(packet));
+    }
+    mark_push_pending(dgram_stream_id_, state);
+    state.cv.notify_all();
+  }
+
+  int on_acked_stream_data(int64_t stream_id, uint64_t offset,
+                           uint64_t datalen) {
+    std::lock_guard<std::mutex> lock(out_mutex_);
+    auto it = send_bufs_.find(stream_id);
+    if (it != send_bufs_.end()) {
+      stream_bytes_acked_ += it->second.ack(offset, datalen);
+    }
+    return 0;
+  }
+
+  // false sends every packet with its own send() instead of a GSO or
+  // sendmmsg train; for measuring what batching saves. Set before connect().
+  void set_send_batching(bool enabled) {
+    send_gso_ = enabled;
+    send_mmsg_ = enabled;
+  }
+
+  // Largest UDP payload to send (PMTUD's ceiling), 0 for ngtcp2's default
+  // (1452). pmtud=false keeps the path at 1200. Set before connect().
+  void set_path_mtu(size_t max_udp_payload, bool pmtud) {
+    max_udp_payload_ = max_udp_payload == 0
+                           ? 0
+                           : std::min<size_t>(std::max<size_t>(max_udp_payload, 1200), 65527);
+    pmtud_ = pmtud;
+  }
+
+  // Congestion controller (ngtcp2_cc_algo). -1 for an unknown value. Set
+  // before connect().
+  int set_cc_algo(int cc_algo) {
+    switch (cc_algo) {
+    case NGTCP2_CC_ALGO_RENO:
+    case NGTCP2_CC_ALGO_CUBIC:
+    case NGTCP2_CC_ALGO_BBR:
+      cc_algo_ = static_cast<ngtcp2_cc_algo>(cc_algo);
+      return 0;
+    default:
+      return -1;
+    }
+  }
+
+  // Set before connect(); -1 (nothing changed) if a value is out of range.
+  int set_transport_config(const TransportConfig &config) {
+    if (!config.valid()) {
+      return -1;
+    }
+    transport_ = config;
+    return 0;
+  }
+
+  // Resume TLS sessions from SessionCache and send 0-RTT when the ticket
+  // allows it; new tickets are stored either way. Off by default: 0-RTT
+  // data can be replayed by an attacker, which only idempotent first
+  // packets (CONNECT) tolerate. Set before connect().
+  void set_session_resumption(bool enabled) { resumption_ = enabled; }
+
+  // Keep an idle connection alive with QUIC PINGs every interval_ms instead
+  // of MQTT PINGREQs: ngtcp2 schedules them on the same expiry timer as
+  // loss recovery, so an idle connection costs one wakeup per interval and
+  // no trip through the platform layer. The idle timeout becomes 1.5x the
+  // interval, matching the MQTT keepalive grace period. 0 turns it off.
+  // Set before connect().
+  void set_keep_alive(uint64_t interval_ms) { keep_alive_ms_ = interval_ms; }
+
+  // Offer the QUIC DATAGRAM extension (RFC 9221) for QoS 0 PUBLISH packets:
+  // see write_datagram, and on_recv_datagram for the receive side, which
+  // needs MQTT framing. Set before connect().
+  void set_datagrams(bool enabled) { datagrams_ = enabled; }
+
+  // Sends a QoS 0 PUBLISH in a DATAGRAM frame instead of on the stream: it
+  // is never retransmitted and is not held up behind lost stream data.
+  // Returns -1 when the caller should write it to the stream instead:
+  // datagrams are off, the server does not support them, the handshake
+  // has not finished, the packet does not fit one datagram, or the queue
+  // is full.
+  int write_datagram(const uint8_t *data, size_t len) {
+    if (len == 0 || len > dgram_max_payload_.load(std::memory_order_relaxed)) {
+      return -1;
+    }
+    {
+      std::lock_guard<std::mutex> lock(out_mutex_);
+      if (dgram_out_.size() >= kMaxQueuedDatagrams) {
+        return -1;
+      }
+      dgram_out_.emplace_back(data, data + len);
+    }
+    signal_wakeup();
+    return 0;
+  }
+
+  // Moves the connection to a new UDP socket after a network change (Wi-Fi
+  // to cellular and back): same server address, whatever local address the
+  // kernel now routes from. Streams, their buffers and the MQTT session
+  // above them carry on; ngtcp2 validates the new path and retransmits
+  // what the old one lost. Blocks until the worker has switched. -1 (see
+  // last_error) before the handshake is confirmed, if the server disabled
+  // migration, or if it has not issued a spare connection ID yet. With
+  // `local` the new socket is bound to that address first (a specific
+  // interface, or a second loopback address in tests) instead of letting
+  // the route decide.
+  int migrate(const struct sockaddr *local = nullptr, socklen_t local_len = 0) {
+    auto result = std::make_shared<std::promise<int>>();
+    std::future<int> done = result->get_future();
+    {
+      std::lock_guard<std::mutex> lock(state_mutex_);
+      if (!running_ || !connected_) {
+        setError("QUIC connection not established");
+        return -1;
+      }
+      if (migrate_request_) {
+        setError("QUIC migration already in progress");
+        return -1;
+      }
+      migrate_request_ = std::move(result);
+      migrate_local_len_ = local ? local_len : 0;
+      if (local) {
+        memcpy(&migrate_local_, local, local_len);
+      }
+      migrate_pending_ = true;
+    }
+    signal_wakeup();
+    return done.get();
+  }
+
+  ClientStats stats() {
+    ClientStats s;
+    std::lock_guard<std::mutex> lock(out_mutex_);
+    s.stream_bytes_sent = stream_bytes_sent_;
+    s.stream_bytes_acked = stream_bytes_acked_;
+    for (const auto &kv : send_bufs_) {
+      s.stream_bytes_unacked += kv.second.bytes_unacked();
+      s.stream_bytes_unsent += kv.second.bytes_unsent();
+      s.send_buffer_bytes += kv.second.bytes_retained();
+    }
+    s.wakeup_enqueues = wakeup_enqueues_.load(std::memory_order_relaxed);
+    s.wakeups = wakeups_.load(std::memory_order_relaxed);
+    s.recv_syscalls = recv_syscalls_.load(std::memory_order_relaxed);
+    s.recv_packets = recv_packets_.load(std::memory_order_relaxed);
+    s.send_syscalls = send_syscalls_.load(std::memory_order_relaxed);
+    s.send_packets = send_packets_.load(std::memory_order_relaxed);
+    s.path_max_udp_payload = path_max_udp_payload_.load(std::memory_order_relaxed);
+    s.loop_wakeups = loop_wakeups_.load(std::memory_order_relaxed);
+    s.spurious_wakeups = spurious_wakeups_.load(std::memory_order_relaxed);
+    s.recv_window = recv_window_.load(std::memory_order_relaxed);
+    s.credit_updates = credit_updates_.load(std::memory_order_relaxed);
+    s.session_resumed = session_resumed_.load(std::memory_order_relaxed) ? 1 : 0;
+    s.early_data_accepted =
+        early_data_accepted_.load(std::memory_order_relaxed) ? 1 : 0;
+    s.datagrams_sent = datagrams_sent_.load(std::memory_order_relaxed);
+    s.datagrams_received = datagrams_received_.load(std::memory_order_relaxed);
+    s.datagrams_lost = datagrams_lost_.load(std::memory_order_relaxed);
+    return s;
   }
 
   int on_handshake_completed() {
@@ -258,11 +1574,75 @@ class QuicClient {
       std::lock_guard<std::mutex> lock(state_mutex_);
       connected_ = true;
     }
+    if (!session_checked_) {
+      // Runs again on handshake_confirmed; the outcome is known the first
+      // time.
+      session_checked_ = true;
+      session_resumed_.store(wolfSSL_session_reused(ssl_) == 1,
+                             std::memory_order_relaxed);
+      if (early_data_) {
+        bool accepted =
+            wolfSSL_get_early_data_status(ssl_) == WOLFSSL_EARLY_DATA_ACCEPTED;
+        early_data_accepted_.store(accepted, std::memory_order_relaxed);
+        if (!accepted) {
+          // No-op if ngtcp2 already saw the rejection.
+          if (ngtcp2_conn_tls_early_data_rejected(conn_) != 0) {
+            return NGTCP2_ERR_CALLBACK_FAILURE;
+          }
+          replay_pending_ = true;
+        }
+        LOGI("session resumed=%d 0-RTT accepted=%d",
+                session_resumed_.load() ? 1 : 0,
+                early_data_accepted_.load() ? 1 : 0);
+      }
+    }
+    clamp_keep_alive();
+    init_datagrams();
     LOGI("ngtcp2 handshake completed");
-    cv_state_.notify_all();
     return 0;
   }
 
+  // The negotiated idle timeout is the smaller of ours and the server's; if
+  // the server's is shorter than the PING interval, ping at half of it so
+  // the connection does not idle out between PINGs.
+  void clamp_keep_alive() {
+    if (keep_alive_ms_ == 0) {
+      return;
+    }
+    const ngtcp2_transport_params *remote =
+        ngtcp2_conn_get_remote_transport_params(conn_);
+    if (!remote || remote->max_idle_timeout == 0 ||
+        remote->max_idle_timeout > keep_alive_ms_ * NGTCP2_MILLISECONDS) {
+      return;
+    }
+    ngtcp2_conn_set_keep_alive_timeout(conn_, remote->max_idle_timeout / 2);
+    LOGI("keep-alive %llu ms above server idle timeout, pinging every %llu ms",
+         (unsigned long long)keep_alive_ms_,
+         (unsigned long long)(remote->max_idle_timeout / 2 /
+                              NGTCP2_MILLISECONDS));
+  }
+
+  // Datagrams can be used once the server's transport parameters allow
+  // them. A payload must fit a minimum-size (1200 byte) packet, so
+  // write_datagram's limit holds on any path, migration included.
+  void init_datagrams() {
+    if (!datagrams_ || dgram_checked_) {
+      return;
+    }
+    dgram_checked_ = true;
+    const ngtcp2_transport_params *remote =
+        ngtcp2_conn_get_remote_transport_params(conn_);
+    if (!remote || remote->max_datagram_frame_size <= kDatagramFrameOverhead) {
+      LOGI("server does not support DATAGRAM, QoS 0 stays on the stream");
+      return;
+    }
+    size_t max_payload = (size_t)std::min<uint64_t>(
+        kDatagramMaxPayload,
+        remote->max_datagram_frame_size - kDatagramFrameOverhead);
+    dgram_max_payload_.store(max_payload, std::memory_order_relaxed);
+    LOGI("DATAGRAM enabled, max payload %zu", max_payload);
+  }
+
  private:
   static ngtcp2_conn *get_conn(ngtcp2_crypto_conn_ref *conn_ref) {
     auto *client = static_cast<QuicClient *>(conn_ref->user_data);
@@ -325,29 +1705,74 @@ class QuicClient {
       fcntl(fd, F_SETFL, flags | O_NONBLOCK);
     }
 
+    dont_fragment_ = set_dont_fragment(fd, remote_addr_.ss_family);
     fd_ = fd;
+    init_recv_batch();
     return 0;
   }
 
+  // DF on, and the kernel's own PMTU cache ignored (PROBE) so PMTUD probes
+  // larger than it still go out.
+  static bool set_dont_fragment(int fd, int family) {
+    int rv;
+    if (family == AF_INET6) {
+      int val = IPV6_PMTUDISC_PROBE;
+      rv = setsockopt(fd, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &val, sizeof(val));
+    } else {
+      int val = IP_PMTUDISC_PROBE;
+      rv = setsockopt(fd, IPPROTO_IP, IP_MTU_DISCOVER, &val, sizeof(val));
+    }
+    if (rv != 0) {
+      LOGI("could not set DF bit, PMTUD disabled");
+    }
+    return rv == 0;
+  }
+
+  // recvmmsg slots for read_packets. With UDP GRO the kernel coalesces a
+  // burst from the peer into one buffer of equal-sized segments, so there are
+  // fewer, larger slots; without it each slot holds one datagram.
+  void init_recv_batch() {
+    int on = 1;
+    recv_gro_ = setsockopt(fd_, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+    size_t slots = recv_gro_ ? kRecvGroSlots : kRecvSlots;
+    size_t slot_size = recv_gro_ ? kRecvGroSlotSize : kRecvSlotSize;
+    recv_buf_.assign(slots * slot_size, 0);
+    recv_ctrl_.assign(slots * kRecvCtrlSize, 0);
+    recv_iov_.assign(slots, iovec{});
+    recv_msgs_.assign(slots, mmsghdr{});
+    for (size_t i = 0; i < slots; i++) {
+      recv_iov_[i].iov_base = recv_buf_.data() + i * slot_size;
+      recv_iov_[i].iov_len = slot_size;
+      recv_msgs_[i].msg_hdr.msg_iov = &recv_iov_[i];
+      recv_msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+    LOGI("recv batch: %zu slots x %zu bytes, gro=%d", slots, slot_size,
+         recv_gro_ ? 1 : 0);
+  }
+
   int init_tls(const std::string &alpn) {
-    ssl_ctx_ = wolfSSL_CTX_new(wolfTLS_client_method());
+    auto tls_start = std::chrono::steady_clock::now();
+    bool ctx_reused = false;
+    std::string ctx_error;
+    ssl_ctx_ = TlsContextCache::get(std::getenv("MQTT_QUIC_CA_FILE"),
+                                    std::getenv("MQTT_QUIC_CA_PATH"),
+                                    WOLFSSL_VERIFY_PEER, new_session_cb,
+                                    &ctx_reused, &ctx_error);
     if (!ssl_ctx_) {
-      setError("wolfSSL_CTX_new failed");
-      return -1;
-    }
-    if (ngtcp2_crypto_wolfssl_configure_client_context(ssl_ctx_) != 0) {
-      setError("ngtcp2_crypto_wolfssl_configure_client_context failed");
+      setError(ctx_error.c_str());
       return -1;
     }
-    wolfSSL_CTX_set_verify(ssl_ctx_, WOLFSSL_VERIFY_PEER, nullptr);
 
-    ssl_ = wolfSSL_new(ssl_ctx_);
+    ssl_ = wolfSSL_new(ssl_ctx_.get());
     if (!ssl_) {
       setError("wolfSSL_new failed");
       return -1;
     }
     wolfSSL_set_app_data(ssl_, &conn_ref_);
     wolfSSL_set_connect_state(ssl_);
+    if (resumption_) {
+      restore_session();
+    }
 
     std::string alpn_vec;
     alpn_vec.push_back(static_cast<char>(alpn.size()));
@@ -362,30 +1787,172 @@ class QuicClient {
       return -1;
     }
 
-    bool ca_loaded = false;
-    const char *ca_file = std::getenv("MQTT_QUIC_CA_FILE");
-    const char *ca_path = std::getenv("MQTT_QUIC_CA_PATH");
-    const char *file_arg = (ca_file && ca_file[0] != '\0') ? ca_file : nullptr;
-    const char *path_arg = (ca_path && ca_path[0] != '\0') ? ca_path : nullptr;
-    if (file_arg || path_arg) {
-      if (wolfSSL_CTX_load_verify_locations(ssl_ctx_, file_arg, path_arg) == 1) {
-        ca_loaded = true;
-      } else {
-        setError("Failed to load CA bundle from MQTT_QUIC_CA_FILE/CA_PATH");
+    LOGI("TLS setup %.2f ms (%s context)",
+         std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - tls_start).count(),
+         ctx_reused ? "shared" : "new");
+    return 0;
+  }
+
+  // Loads the cached ticket for session_key_, if any, and turns on 0-RTT
+  // when the ticket allows early data and the transport parameters it needs
+  // were saved with it. A stale or unparsable entry just means a full
+  // handshake.
+  void restore_session() {
+    SessionCache::Entry entry;
+    if (!SessionCache::instance().find(session_key_, entry)) {
+      return;
+    }
+    const unsigned char *der = entry.session.data();
+    WOLFSSL_SESSION *session =
+        wolfSSL_d2i_SSL_SESSION(nullptr, &der, (long)entry.session.size());
+    if (!session) {
+      return;
+    }
+    if (wolfSSL_set_session(ssl_, session) == 1 &&
+        !entry.transport_params.empty() &&
+        wolfSSL_SESSION_get_max_early_data(session) > 0) {
+      wolfSSL_set_quic_early_data_enabled(ssl_, 1);
+      early_data_ = true;
+      resume_params_ = std::move(entry.transport_params);
+    }
+    wolfSSL_SESSION_free(session);
+  }
+
+  static int new_session_cb(WOLFSSL *ssl, WOLFSSL_SESSION *session) {
+    auto *conn_ref =
+        static_cast<ngtcp2_crypto_conn_ref *>(wolfSSL_get_app_data(ssl));
+    static_cast<QuicClient *>(conn_ref->user_data)->on_new_session(session);
+    // 0: the session is not kept, wolfSSL frees it. The context is shared,
+    // so this also fires for clients without session resumption.
+    return 0;
+  }
+
+  // Worker thread (NewSessionTicket arrives after the handshake).
+  void on_new_session(WOLFSSL_SESSION *session) {
+    if (!resumption_) {
+      return;
+    }
+    SessionCache::Entry entry;
+    int len = wolfSSL_i2d_SSL_SESSION(session, nullptr);
+    if (len <= 0) {
+      return;
+    }
+    entry.session.resize((size_t)len);
+    unsigned char *der = entry.session.data();
+    if (wolfSSL_i2d_SSL_SESSION(session, &der) != len) {
+      return;
+    }
+    uint8_t params[256];
+    ngtcp2_ssize n =
+        ngtcp2_conn_encode_0rtt_transport_params(conn_, params, sizeof(params));
+    if (n > 0) {
+      entry.transport_params.assign(params, params + n);
+    }
+    SessionCache::instance().store(session_key_, std::move(entry));
+  }
+
+  // Worker thread. The server rejected 0-RTT, so ngtcp2 dropped every stream
+  // opened before the handshake and the server never saw their data.
+  // Reopening them in order yields the same stream ids; their send buffers
+  // still hold everything, which goes out again under 1-RTT keys.
+  int replay_early_streams() {
+    replay_pending_ = false;
+    std::vector<int64_t> ids;
+    {
+      std::lock_guard<std::mutex> lock(stream_mutex_);
+      for (const auto &kv : streams_) {
+        if ((kv.first & 0x3) == 0) {  // client-initiated bidi
+          ids.push_back(kv.first);
+        }
+      }
+    }
+    for (int64_t id : ids) {
+      int64_t reopened = -1;
+      int rv = ngtcp2_conn_open_bidi_stream(conn_, &reopened, nullptr);
+      if (rv != 0 || reopened != id) {
+        setError("Could not reopen streams after 0-RTT rejection");
         return -1;
       }
     }
-    if (!ca_loaded && wolfSSL_CTX_set_default_verify_paths(ssl_ctx_) == 1) {
-      ca_loaded = true;
+    {
+      std::lock_guard<std::mutex> lock(out_mutex_);
+      for (auto &kv : send_bufs_) {
+        kv.second.rewind();
+      }
     }
-    if (!ca_loaded && wolfSSL_CTX_load_system_CA_certs(ssl_ctx_) == 1) {
-      ca_loaded = true;
+    LOGI("0-RTT rejected, replaying %zu streams", ids.size());
+    return 0;
+  }
+
+  // Worker thread. Answers a pending migrate(); with stopping set (the loop
+  // is ending) it fails instead.
+  void serve_migrate_request(bool stopping) {
+    std::shared_ptr<std::promise<int>> request;
+    struct sockaddr_storage local;
+    socklen_t local_len;
+    {
+      std::lock_guard<std::mutex> lock(state_mutex_);
+      request = std::move(migrate_request_);
+      migrate_request_ = nullptr;
+      migrate_pending_ = false;
+      local = migrate_local_;
+      local_len = migrate_local_len_;
+    }
+    if (request) {
+      request->set_value(
+          stopping ? -1
+                   : rebind_socket(local_len ? (struct sockaddr *)&local : nullptr,
+                                   local_len));
     }
-    if (!ca_loaded) {
-      setError("No CA bundle available for TLS verification");
+  }
+
+  // Worker thread. A fresh socket connected to the same server picks up the
+  // local address of the network now in use; ngtcp2 switches to that path
+  // right away (the old one is assumed dead) and probes it.
+  int rebind_socket(const struct sockaddr *bind_addr, socklen_t bind_len) {
+    int fd = socket(remote_addr_.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd == -1) {
+      setError("Failed to create UDP socket for migration");
+      return -1;
+    }
+    struct sockaddr_storage local;
+    socklen_t local_len = sizeof(local);
+    if ((bind_addr && bind(fd, bind_addr, bind_len) != 0) ||
+        ::connect(fd, (struct sockaddr *)&remote_addr_, remote_addrlen_) != 0 ||
+        getsockname(fd, (struct sockaddr *)&local, &local_len) != 0) {
+      setError("Failed to bind UDP socket for migration");
+      ::close(fd);
       return -1;
     }
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags >= 0) {
+      fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
 
+    ngtcp2_path path = {
+      .local = {.addr = (struct sockaddr *)&local, .addrlen = local_len},
+      .remote = {.addr = (struct sockaddr *)&remote_addr_,
+                 .addrlen = remote_addrlen_},
+    };
+    int rv = ngtcp2_conn_initiate_immediate_migration(conn_, &path, now_ts());
+    if (rv != 0) {
+      setError(ngtcp2_strerror(rv));
+      ::close(fd);
+      return -1;
+    }
+    dont_fragment_ = set_dont_fragment(fd, remote_addr_.ss_family);
+    {
+      // Opened before the old socket is closed, so the reactor sees a new fd
+      // number and registers it; closing the old one drops it from epoll.
+      std::lock_guard<std::mutex> lock(cleanup_mutex_);
+      ::close(fd_);
+      fd_ = fd;
+    }
+    memcpy(&local_addr_, &local, local_len);
+    local_addrlen_ = local_len;
+    init_recv_batch();
+    LOGI("migrated to a new local address");
     return 0;
   }
 
@@ -411,25 +1978,58 @@ class QuicClient {
     callbacks.extend_max_local_streams_bidi = extend_max_local_streams_bidi_cb;
     callbacks.rand = rand_cb;
     callbacks.get_new_connection_id = get_new_connection_id_cb;
+    callbacks.recv_datagram = recv_datagram_cb;
+    callbacks.lost_datagram = lost_datagram_cb;
 
     ngtcp2_settings settings;
     ngtcp2_transport_params params;
     ngtcp2_settings_default(&settings);
     settings.initial_ts = now_ts();
     settings.log_printf = log_printf;
-    settings.handshake_timeout = 10 * NGTCP2_SECONDS;
+    // One limit for both: ngtcp2 stops retransmitting at handshake_timeout
+    // and the worker fails a pending connect at the same instant.
+    settings.handshake_timeout = kHandshakeTimeout;
+    handshake_deadline_ = settings.initial_ts + kHandshakeTimeout;
+    settings.cc_algo = cc_algo_;
+    // PMTUD starts at 1200 and probes up to max_tx_udp_payload_size; it needs
+    // the DF bit (init_socket) so probes are not fragmented instead of lost.
+    if (max_udp_payload_ != 0) {
+      settings.max_tx_udp_payload_size = max_udp_payload_;
+      pmtud_probes_.clear();
+      for (uint16_t probe : kPmtudProbes) {
+        if (probe < max_udp_payload_) {
+          pmtud_probes_.push_back(probe);
+        }
+      }
+      pmtud_probes_.insert(pmtud_probes_.begin(), (uint16_t)max_udp_payload_);
+      settings.pmtud_probes = pmtud_probes_.data();
+      settings.pmtud_probeslen = pmtud_probes_.size();
+    }
+    settings.no_pmtud = (pmtud_ && dont_fragment_) ? 0 : 1;
 
     ngtcp2_transport_params_default(&params);
     /* Set all transport params explicitly so server validation passes (active_connection_id_limit>=2, max_ack_delay in range). Use non-default values so they are encoded on the wire. */
-    params.initial_max_streams_bidi = 8;
-    params.initial_max_streams_uni = 8;
-    params.initial_max_stream_data_bidi_local = 256 * 1024;
-    params.initial_max_stream_data_bidi_remote = 256 * 1024;
-    params.initial_max_stream_data_uni = 256 * 1024;
-    params.initial_max_data = 1024 * 1024;
+    params.initial_max_streams_bidi = transport_.max_streams_bidi;
+    params.initial_max_streams_uni = transport_.max_streams_uni;
+    params.initial_max_stream_data_bidi_local = transport_.max_stream_data;
+    params.initial_max_stream_data_bidi_remote = transport_.max_stream_data;
+    params.initial_max_stream_data_uni = transport_.max_stream_data;
+    params.initial_max_data = transport_.max_data;
     params.active_connection_id_limit = 8;
-    params.max_ack_delay = 1 * NGTCP2_MILLISECONDS;
-    params.max_idle_timeout = 30 * NGTCP2_SECONDS;
+    params.max_ack_delay = transport_.max_ack_delay_ms * NGTCP2_MILLISECONDS;
+    params.max_idle_timeout = transport_.idle_timeout_ms * NGTCP2_MILLISECONDS;
+    if (keep_alive_ms_ > 0) {
+      // Replaces the profile's value; the plugins refuse an explicit
+      // idleTimeoutMs together with transportKeepalive.
+      params.max_idle_timeout = keep_alive_ms_ * 3 / 2 * NGTCP2_MILLISECONDS;
+    }
+    if (datagrams_) {
+      params.max_datagram_frame_size = kMaxDatagramFrame;
+    }
+    conn_flow_.init(transport_.max_data, now_ts());
+    recv_window_.store(transport_.max_data, std::memory_order_relaxed);
+    // Receive slots are sized for this (see init_recv_batch).
+    params.max_udp_payload_size = kRecvSlotSize;
 
     ngtcp2_cid dcid, scid;
     dcid.datalen = NGTCP2_MIN_INITIAL_DCIDLEN;
@@ -458,105 +2058,312 @@ class QuicClient {
       return -1;
     }
     ngtcp2_conn_set_tls_native_handle(conn_, ssl_);
+    if (keep_alive_ms_ > 0) {
+      ngtcp2_conn_set_keep_alive_timeout(conn_,
+                                         keep_alive_ms_ * NGTCP2_MILLISECONDS);
+    }
+    if (early_data_ &&
+        ngtcp2_conn_decode_and_set_0rtt_transport_params(
+            conn_, resume_params_.data(), resume_params_.size()) != 0) {
+      // Resume without 0-RTT rather than guess at the server's limits.
+      wolfSSL_set_quic_early_data_enabled(ssl_, 0);
+      early_data_ = false;
+    }
+    resume_params_.clear();
     return 0;
   }
 
-  int init_wakeup_pipe() {
-    if (pipe(wakeup_fds_) != 0) {
-      setError("Failed to create wakeup pipe");
+  int init_wakeup_fd() {
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd_ < 0) {
+      wakeup_fd_ = -1;
+      setError("Failed to create wakeup eventfd");
       return -1;
     }
-    int flags = fcntl(wakeup_fds_[0], F_GETFL, 0);
-    if (flags >= 0) {
-      fcntl(wakeup_fds_[0], F_SETFL, flags | O_NONBLOCK);
-    }
-    flags = fcntl(wakeup_fds_[1], F_GETFL, 0);
-    if (flags >= 0) {
-      fcntl(wakeup_fds_[1], F_SETFL, flags | O_NONBLOCK);
-    }
     return 0;
   }
 
   void run_loop() {
     send_pending_packets();
     while (running_) {
-      int timeout_ms = compute_timeout_ms();
       struct pollfd fds[2];
       fds[0].fd = fd_;
       fds[0].events = POLLIN;
-      fds[1].fd = wakeup_fds_[0];
+      fds[1].fd = wakeup_fd_;
       fds[1].events = POLLIN;
 
-      int rv = poll(fds, 2, timeout_ms);
-      if (rv > 0) {
-        if (fds[1].revents & POLLIN) {
-          drain_wakeup();
-        }
-        if (fds[0].revents & POLLIN) {
-          if (read_packets() != 0) {
-            break;
-          }
-        }
-      }
-
-      if (handle_expiry() != 0) {
-        break;
+      // Sleep until exactly the next deadline rather than a rounded-down
+      // millisecond, which would spin poll() for the last fraction.
+      uint64_t deadline = next_deadline();
+      struct timespec wait;
+      struct timespec *timeout = nullptr;
+      if (deadline != kNoDeadline) {
+        uint64_t now = now_ts();
+        uint64_t delta = deadline > now ? deadline - now : 0;
+        wait.tv_sec = (time_t)(delta / NGTCP2_SECONDS);
+        wait.tv_nsec = (long)(delta % NGTCP2_SECONDS);
+        timeout = &wait;
       }
-      if (send_pending_packets() != 0) {
+      int rv = ppoll(fds, 2, timeout, nullptr);
+      bool socket_ready = rv > 0 && (fds[0].revents & POLLIN);
+      bool wakeup_ready = rv > 0 && (fds[1].revents & POLLIN);
+      if (!loop_pass(socket_ready, wakeup_ready)) {
         break;
       }
+    }
+    finish_loop();
+  }
 
-      if (close_requested_) {
-        send_connection_close();
-        break;
+  // One pass of the event loop, on the worker thread or the connection's
+  // reactor loop. False once the loop should stop.
+  bool loop_pass(bool socket_ready, bool wakeup_ready) {
+    count_wakeup(socket_ready || wakeup_ready);
+    if (wakeup_ready) {
+      drain_wakeup();
+    }
+    if (socket_ready && read_packets() != 0) {
+      return false;
+    }
+    if (replay_pending_ && replay_early_streams() != 0) {
+      return false;
+    }
+    if (migrate_pending_) {
+      serve_migrate_request(false);
+    }
+
+    if (handle_expiry() != 0) {
+      return false;
+    }
+    // One push per stream for everything this pass received.
+    deliver_stream_data(false);
+    return_credit();
+    if (send_pending_packets() != 0) {
+      return false;
+    }
+
+    if (connect_done_) {
+      // With 0-RTT the caller can start writing before the handshake ends.
+      if (connected_ || early_data_) {
+        complete_connect(0);
+      } else if (now_ts() >= handshake_deadline_) {
+        setError("QUIC handshake timed out");
+        return false;
       }
     }
 
+    if (close_requested_) {
+      send_connection_close();
+      return false;
+    }
+    return true;
+  }
+
+  void finish_loop() {
     running_ = false;
-    cv_state_.notify_all();
+    serve_migrate_request(true);
+    if (connect_done_) {
+      if (last_error_str_.empty()) {
+        setError("QUIC handshake failed");
+      }
+      complete_connect(-1);
+    }
+    wake_stream_waiters(false);
+    deliver_stream_data(true);
   }
 
-  int compute_timeout_ms() {
-    if (!conn_) {
-      return 100;
+  // Caller holds stream_mutex_.
+  void mark_push_pending(int64_t stream_id, StreamState &state) {
+    if (stream_listener_ && !state.push_pending) {
+      state.push_pending = true;
+      push_dirty_.push_back(stream_id);
     }
-    uint64_t expiry = ngtcp2_conn_get_expiry(conn_);
-    uint64_t now = now_ts();
-    if (expiry <= now) {
-      return 0;
+  }
+
+  // Push delivery: hand everything buffered for the streams touched since
+  // the last call to the listener, one call per stream, outside
+  // stream_mutex_ so the listener may call back into the client. Worker
+  // thread only; all_streams flushes end-of-stream for every stream when
+  // the connection goes away.
+  void deliver_stream_data(bool all_streams) {
+    std::shared_ptr<const StreamListener> listener;
+    push_batch_.clear();
+    {
+      std::lock_guard<std::mutex> lock(stream_mutex_);
+      if (!stream_listener_) {
+        return;
+      }
+      if (all_streams) {
+        for (auto &kv : streams_) {
+          mark_push_pending(kv.first, kv.second);
+        }
+      }
+      if (push_dirty_.empty()) {
+        return;
+      }
+      listener = stream_listener_;
+      push_buf_.clear();
+      for (int64_t stream_id : push_dirty_) {
+        StreamState &state = streams_[stream_id];
+        state.push_pending = false;
+        if (state.framed) {
+          // One callback per whole MQTT packet.
+          while (state.framer.has_packet()) {
+            PushedChunk chunk{stream_id, push_buf_.size(),
+                              state.framer.front_size(), true, false};
+            push_buf_.resize(chunk.offset + chunk.len);
+            state.framer.read(push_buf_.data() + chunk.offset, chunk.len);
+            consume_credit(stream_id, state, chunk.len);
+            push_batch_.push_back(chunk);
+          }
+        } else if (!state.recv_buf.empty()) {
+          PushedChunk chunk{stream_id, push_buf_.size(), state.recv_buf.size(),
+                            false, false};
+          push_buf_.resize(chunk.offset + chunk.len);
+          state.recv_buf.read(push_buf_.data() + chunk.offset, chunk.len);
+          consume_credit(stream_id, state, chunk.len);
+          push_batch_.push_back(chunk);
+        }
+        if (stream_ended(state) && !state.end_delivered) {
+          state.end_delivered = true;
+          push_batch_.push_back(
+              PushedChunk{stream_id, push_buf_.size(), 0, false, true});
+        }
+      }
+      push_dirty_.clear();
+    }
+    for (const PushedChunk &chunk : push_batch_) {
+      (*listener)(chunk.stream_id, push_buf_.data() + chunk.offset, chunk.len,
+                  chunk.packet, chunk.fin);
+    }
+  }
+
+  // Worker thread, no locks held.
+  void complete_connect(int result) {
+    ConnectCallback done = std::move(connect_done_);
+    connect_done_ = nullptr;
+    done(result);
+  }
+
+  // now_ts() time of the loop's next timed pass: the ngtcp2 expiry, or the
+  // handshake deadline while connect_async is pending. No cap; an idle
+  // connection sleeps until its idle timeout or keepalive.
+  uint64_t next_deadline() {
+    uint64_t deadline = conn_ ? ngtcp2_conn_get_expiry(conn_) : kNoDeadline;
+    if (connect_done_) {
+      deadline = std::min<uint64_t>(deadline, handshake_deadline_);
     }
-    uint64_t delta_ms = (expiry - now) / (NGTCP2_MILLISECONDS);
-    if (delta_ms > 1000) {
-      return 1000;
+    return deadline;
+  }
+
+  // A pass with no I/O ready before its deadline woke for nothing; idle
+  // connections should keep spurious_wakeups_ flat.
+  void count_wakeup(bool io_ready) {
+    loop_wakeups_.fetch_add(1, std::memory_order_relaxed);
+    if (!io_ready && next_deadline() > now_ts()) {
+      spurious_wakeups_.fetch_add(1, std::memory_order_relaxed);
     }
-    return (int)delta_ms;
   }
 
+  // Drains the socket, many datagrams per syscall via recvmmsg. Falls back to
+  // one recv() per datagram if the kernel lacks recvmmsg.
   int read_packets() {
-    uint8_t buf[65536];
+    if (!recv_mmsg_) {
+      return read_packets_single();
+    }
+    const size_t slots = recv_msgs_.size();
+    for (;;) {
+      for (size_t i = 0; i < slots; i++) {
+        msghdr &hdr = recv_msgs_[i].msg_hdr;
+        hdr.msg_control = recv_ctrl_.data() + i * kRecvCtrlSize;
+        hdr.msg_controllen = kRecvCtrlSize;
+        hdr.msg_flags = 0;
+      }
+      int n = recvmmsg(fd_, recv_msgs_.data(), (unsigned int)slots, 0, nullptr);
+      recv_syscalls_.fetch_add(1, std::memory_order_relaxed);
+      if (n < 0) {
+        if (errno == ENOSYS) {
+          LOGI("recvmmsg unavailable, using recv()");
+          recv_mmsg_ = false;
+          if (recv_gro_) {
+            int off = 0;
+            setsockopt(fd_, SOL_UDP, UDP_GRO, &off, sizeof(off));
+            recv_gro_ = false;
+          }
+          return read_packets_single();
+        }
+        break;
+      }
+      for (int i = 0; i < n; i++) {
+        const msghdr &hdr = recv_msgs_[i].msg_hdr;
+        if (hdr.msg_flags & MSG_TRUNC) {
+          continue;
+        }
+        const auto *data = static_cast<const uint8_t *>(recv_iov_[i].iov_base);
+        size_t len = recv_msgs_[i].msg_len;
+        size_t segment = recv_gro_ ? gro_segment_size(hdr) : 0;
+        if (segment == 0) {
+          segment = len;
+        }
+        for (size_t off = 0; off < len; off += segment) {
+          if (feed_packet(data + off, std::min(segment, len - off)) != 0) {
+            return -1;
+          }
+        }
+      }
+      // A short batch means the socket queue was empty; skip the EAGAIN call.
+      if ((size_t)n < slots) {
+        break;
+      }
+    }
+    return 0;
+  }
+
+  int read_packets_single() {
     for (;;) {
-      ssize_t nread = recv(fd_, buf, sizeof(buf), 0);
+      ssize_t nread = recv(fd_, recv_buf_.data(), recv_buf_.size(), 0);
+      recv_syscalls_.fetch_add(1, std::memory_order_relaxed);
       if (nread <= 0) {
         break;
       }
-      ngtcp2_path path = {
-        .local = {.addr = (struct sockaddr *)&local_addr_,
-                  .addrlen = local_addrlen_},
-        .remote = {.addr = (struct sockaddr *)&remote_addr_,
-                   .addrlen = remote_addrlen_},
-      };
-      ngtcp2_pkt_info pi;
-      memset(&pi, 0, sizeof(pi));
-      int rv = ngtcp2_conn_read_pkt(conn_, &path, &pi, buf, (size_t)nread,
-                                    now_ts());
-      if (rv != 0) {
-        setError(ngtcp2_strerror(rv));
+      if (feed_packet(recv_buf_.data(), (size_t)nread) != 0) {
         return -1;
       }
     }
     return 0;
   }
 
+  // Segment size of a GRO-coalesced buffer, or 0 if the kernel did not
+  // coalesce it (a single datagram).
+  static size_t gro_segment_size(const msghdr &hdr) {
+    for (cmsghdr *cm = CMSG_FIRSTHDR(const_cast<msghdr *>(&hdr)); cm;
+         cm = CMSG_NXTHDR(const_cast<msghdr *>(&hdr), cm)) {
+      if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+        int size = 0;
+        memcpy(&size, CMSG_DATA(cm), sizeof(size));
+        return size > 0 ? (size_t)size : 0;
+      }
+    }
+    return 0;
+  }
+
+  int feed_packet(const uint8_t *data, size_t len) {
+    recv_packets_.fetch_add(1, std::memory_order_relaxed);
+    ngtcp2_path path = {
+      .local = {.addr = (struct sockaddr *)&local_addr_,
+                .addrlen = local_addrlen_},
+      .remote = {.addr = (struct sockaddr *)&remote_addr_,
+                 .addrlen = remote_addrlen_},
+    };
+    ngtcp2_pkt_info pi;
+    memset(&pi, 0, sizeof(pi));
+    int rv = ngtcp2_conn_read_pkt(conn_, &path, &pi, data, len, now_ts());
+    if (rv != 0) {
+      setError(ngtcp2_strerror(rv));
+      return -1;
+    }
+    return 0;
+  }
+
   int handle_expiry() {
     if (!conn_) {
       return 0;
@@ -567,6 +2374,10 @@ class QuicClient {
       return 0;
     }
     int rv = ngtcp2_conn_handle_expiry(conn_, now);
+    if (rv == NGTCP2_ERR_HANDSHAKE_TIMEOUT) {
+      setError("QUIC handshake timed out");
+      return -1;
+    }
     if (rv != 0) {
       setError(ngtcp2_strerror(rv));
       return -1;
@@ -578,22 +2389,47 @@ class QuicClient {
     if (!conn_) {
       return 0;
     }
+    // Packets are built back to back into send_buf_ and flushed as one
+    // train, up to what the congestion controller's send quantum allows.
+    // Each slot can take the configured maximum (PMTUD probes are that
+    // large); the quantum is counted in packets of the current path size,
+    // and a train never exceeds what one UDP_SEGMENT send can carry.
+    size_t max_pkt = ngtcp2_conn_get_max_tx_udp_payload_size(conn_);
+    size_t path_pkt = ngtcp2_conn_get_path_max_tx_udp_payload_size(conn_);
+    path_max_udp_payload_.store(path_pkt, std::memory_order_relaxed);
+    size_t max_pkts = std::min(
+        {kMaxTrainPackets, std::max<size_t>(1, kMaxGsoBytes / path_pkt),
+         std::max<size_t>(1, ngtcp2_conn_get_send_quantum(conn_) / path_pkt)});
+    if (send_buf_.size() < kMaxTrainPackets * max_pkt) {
+      send_buf_.resize(kMaxTrainPackets * max_pkt);
+    }
+    size_t train_len = 0;
+    size_t npkts = 0;
+    size_t segment = 0;
+    ngtcp2_tstamp ts = now_ts();
+    // Streams that are flow-control blocked (or gone) for the rest of this
+    // pass; skipping them lets the other streams still fill packets.
+    std::vector<int64_t> skip;
     for (;;) {
       int64_t stream_id = -1;
       uint32_t flags = NGTCP2_WRITE_STREAM_FLAG_MORE;
       ngtcp2_vec datav;
       size_t datavcnt = 0;
       bool fin = false;
+      bool dgram = false;
       {
         std::lock_guard<std::mutex> lock(out_mutex_);
-        auto it = outgoing_.begin();
-        if (it != outgoing_.end() && !it->second.empty()) {
-          stream_id = it->first;
-          OutgoingChunk &chunk = it->second.front();
-          datav.base = chunk.data.data() + chunk.offset;
-          datav.len = chunk.data.size() - chunk.offset;
-          datavcnt = 1;
-          fin = chunk.fin;
+        if (!dgram_out_.empty()) {
+          // QoS 0 datagrams go first; they are small and never resent.
+          dgram = true;
+          datav.base = dgram_out_.front().data();
+          datav.len = dgram_out_.front().size();
+        } else {
+          stream_id = next_send_stream(skip);
+          if (stream_id != -1) {
+            send_bufs_[stream_id].next_unsent(&datav, &fin);
+            datavcnt = datav.len > 0 ? 1 : 0;
+          }
         }
       }
 
@@ -606,46 +2442,241 @@ class QuicClient {
       ngtcp2_pkt_info pi;
       ngtcp2_ssize nwrite = 0;
       ngtcp2_ssize wdatalen = 0;
-      uint8_t buf[1452];
-      nwrite = ngtcp2_conn_writev_stream(conn_, &ps.path, &pi, buf, sizeof(buf),
-                                         &wdatalen, flags, stream_id,
-                                         datavcnt ? &datav : nullptr, datavcnt,
-                                         now_ts());
+      if (dgram) {
+        nwrite = write_datagram_frame(&ps.path, &pi,
+                                      send_buf_.data() + train_len, max_pkt,
+                                      datav, ts);
+      } else {
+        nwrite = ngtcp2_conn_writev_stream(conn_, &ps.path, &pi,
+                                           send_buf_.data() + train_len, max_pkt,
+                                           &wdatalen, flags, stream_id,
+                                           datavcnt ? &datav : nullptr, datavcnt,
+                                           ts);
+      }
       if (nwrite < 0) {
-        if (nwrite == NGTCP2_ERR_WRITE_MORE) {
+        switch (nwrite) {
+        case NGTCP2_ERR_WRITE_MORE:
+          mark_sent(stream_id, wdatalen, fin);
+          continue;
+        case NGTCP2_ERR_STREAM_DATA_BLOCKED:
+          skip.push_back(stream_id);
+          continue;
+        case NGTCP2_ERR_STREAM_SHUT_WR:
+        case NGTCP2_ERR_STREAM_NOT_FOUND: {
+          // Nothing more can be sent on this stream (the peer sent
+          // STOP_SENDING, or it closed); drop what is left and fail later
+          // writes so the caller can move to another stream.
           std::lock_guard<std::mutex> lock(out_mutex_);
-          auto it = outgoing_.find(stream_id);
-          if (it != outgoing_.end() && !it->second.empty()) {
-            it->second.front().offset += (size_t)wdatalen;
-            if (it->second.front().offset >= it->second.front().data.size()) {
-              it->second.pop_front();
-            }
-          }
+          send_bufs_.erase(stream_id);
+          send_closed_.insert(stream_id);
           continue;
         }
+        default:
+          break;
+        }
+        flush_train(send_buf_.data(), train_len, segment, npkts);
         setError(ngtcp2_strerror((int)nwrite));
         return -1;
       }
       if (nwrite == 0) {
-        return 0;
+        int rv = flush_train(send_buf_.data(), train_len, segment, npkts);
+        ngtcp2_conn_update_pkt_tx_time(conn_, ts);
+        return rv;
       }
 
-      if (wdatalen > 0) {
-        std::lock_guard<std::mutex> lock(out_mutex_);
-        auto it = outgoing_.find(stream_id);
-        if (it != outgoing_.end() && !it->second.empty()) {
-          it->second.front().offset += (size_t)wdatalen;
-          if (it->second.front().offset >= it->second.front().data.size()) {
-            it->second.pop_front();
+      if (stream_id != -1) {
+        mark_sent(stream_id, wdatalen, fin);
+      }
+
+      if ((npkts > 0 && (size_t)nwrite > segment) || (size_t)nwrite > path_pkt) {
+        // Larger than the train's segments or the path (a PMTUD probe):
+        // send the train, then the packet on its own, so a probe the path
+        // drops (EMSGSIZE) takes no other packets with it.
+        if (flush_train(send_buf_.data(), train_len, segment, npkts) != 0 ||
+            flush_train(send_buf_.data() + train_len, (size_t)nwrite,
+                        (size_t)nwrite, 1) != 0) {
+          return -1;
+        }
+        train_len = 0;
+        npkts = 0;
+        continue;
+      }
+
+      // GSO needs every segment but the last to be the same size, so a
+      // short packet closes the train.
+      if (npkts == 0) {
+        segment = (size_t)nwrite;
+      }
+      train_len += (size_t)nwrite;
+      npkts++;
+      if ((size_t)nwrite < segment) {
+        if (flush_train(send_buf_.data(), train_len, segment, npkts) != 0) {
+          return -1;
+        }
+        train_len = 0;
+        npkts = 0;
+        continue;
+      }
+      if (npkts == max_pkts) {
+        // Send quantum used up: hand the rest to the pacing timer, which
+        // ngtcp2_conn_get_expiry includes.
+        int rv = flush_train(send_buf_.data(), train_len, segment, npkts);
+        ngtcp2_conn_update_pkt_tx_time(conn_, ts);
+        return rv;
+      }
+    }
+  }
+
+  // Sends npkts packets laid out back to back at data: one GSO send when the
+  // kernel supports UDP_SEGMENT, else sendmmsg, else one send() each.
+  // EMSGSIZE (a probe or train over the local MTU) drops the datagrams;
+  // loss recovery and PMTUD deal with it.
+  int flush_train(const uint8_t *data, size_t len, size_t segment,
+                  size_t npkts) {
+    if (npkts == 0) {
+      return 0;
+    }
+    if (npkts > 1 && send_gso_) {
+      iovec iov = {const_cast<uint8_t *>(data), len};
+      alignas(cmsghdr) uint8_t ctrl[CMSG_SPACE(sizeof(uint16_t))];
+      memset(ctrl, 0, sizeof(ctrl));
+      msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = ctrl;
+      msg.msg_controllen = sizeof(ctrl);
+      cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+      cm->cmsg_level = SOL_UDP;
+      cm->cmsg_type = UDP_SEGMENT;
+      cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      uint16_t gso_size = (uint16_t)segment;
+      memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+      ssize_t nsend = sendmsg(fd_, &msg, 0);
+      send_syscalls_.fetch_add(1, std::memory_order_relaxed);
+      if (nsend >= 0) {
+        send_packets_.fetch_add(npkts, std::memory_order_relaxed);
+        gso_einval_ = 0;
+        return 0;
+      }
+      if (errno == EMSGSIZE) {
+        return 0;
+      }
+      // EINVAL is usually about this train (its size or segment count):
+      // resend it without GSO and try GSO again on the next one. Only a run
+      // of them, or errors that do not change, turn GSO off.
+      if (errno == ENOPROTOOPT || errno == EIO ||
+          (errno == EINVAL && ++gso_einval_ >= kGsoEinvalLimit)) {
+        // No GSO on this kernel (ENOPROTOOPT) or no checksum offload on
+        // this route (EIO); those do not change, so stop trying.
+        LOGI("UDP GSO unavailable (errno=%d), using sendmmsg", errno);
+        send_gso_ = false;
+      } else if (errno != EINVAL) {
+        setError("send failed");
+        return -1;
+      }
+    }
+    if (npkts > 1 && send_mmsg_) {
+      mmsghdr msgs[kMaxTrainPackets];
+      iovec iovs[kMaxTrainPackets];
+      memset(msgs, 0, sizeof(msgs));
+      for (size_t i = 0; i < npkts; i++) {
+        size_t off = i * segment;
+        iovs[i].iov_base = const_cast<uint8_t *>(data) + off;
+        iovs[i].iov_len = std::min(segment, len - off);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+      }
+      size_t sent = 0;
+      while (sent < npkts) {
+        int n = sendmmsg(fd_, msgs + sent, (unsigned int)(npkts - sent), 0);
+        send_syscalls_.fetch_add(1, std::memory_order_relaxed);
+        if (n < 0) {
+          if (errno == EMSGSIZE) {
+            sent++;
+            continue;
+          }
+          if (errno == ENOSYS && sent == 0) {
+            LOGI("sendmmsg unavailable, using send()");
+            send_mmsg_ = false;
+            break;
           }
+          setError("send failed");
+          return -1;
+        }
+        sent += (size_t)n;
+        send_packets_.fetch_add((uint64_t)n, std::memory_order_relaxed);
+      }
+      if (sent == npkts) {
+        return 0;
+      }
+    }
+    for (size_t off = 0; off < len; off += segment) {
+      ssize_t nsend = send(fd_, data + off, std::min(segment, len - off), 0);
+      send_syscalls_.fetch_add(1, std::memory_order_relaxed);
+      if (nsend < 0) {
+        if (errno == EMSGSIZE) {
+          continue;
         }
+        setError("send failed");
+        return -1;
+      }
+      send_packets_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return 0;
+  }
+
+  // Worker thread. Writes the head of dgram_out_ as a DATAGRAM frame,
+  // leaving room for more frames in the packet (WRITE_DATAGRAM_FLAG_MORE).
+  // The head is dropped once it is in a packet, or when the server cannot
+  // take it; in that case NGTCP2_ERR_WRITE_MORE is returned so the caller
+  // simply carries on filling the packet.
+  ngtcp2_ssize write_datagram_frame(ngtcp2_path *path, ngtcp2_pkt_info *pi,
+                                    uint8_t *buf, size_t buflen,
+                                    const ngtcp2_vec &datav, ngtcp2_tstamp ts) {
+    int accepted = 0;
+    ngtcp2_ssize nwrite = ngtcp2_conn_writev_datagram(
+        conn_, path, pi, buf, buflen, &accepted,
+        NGTCP2_WRITE_DATAGRAM_FLAG_MORE, dgram_next_id_++, &datav, 1, ts);
+    bool refused = nwrite == NGTCP2_ERR_INVALID_ARGUMENT ||
+                   nwrite == NGTCP2_ERR_INVALID_STATE;
+    if (accepted || refused) {
+      std::lock_guard<std::mutex> lock(out_mutex_);
+      dgram_out_.pop_front();
+    }
+    if (accepted) {
+      datagrams_sent_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return refused ? NGTCP2_ERR_WRITE_MORE : nwrite;
+  }
+
+  // Round-robin over streams with unsent data so one busy stream cannot
+  // starve the others. Caller holds out_mutex_.
+  int64_t next_send_stream(const std::vector<int64_t> &skip) {
+    auto it = send_bufs_.upper_bound(last_send_stream_);
+    for (size_t i = 0; i < send_bufs_.size(); ++i, ++it) {
+      if (it == send_bufs_.end()) {
+        it = send_bufs_.begin();
+      }
+      if (it->second.has_unsent() &&
+          std::find(skip.begin(), skip.end(), it->first) == skip.end()) {
+        last_send_stream_ = it->first;
+        return it->first;
       }
+    }
+    return -1;
+  }
 
-      ssize_t nsend = send(fd_, buf, (size_t)nwrite, 0);
-      if (nsend < 0) {
-        setError("send failed");
-        return -1;
-      }
+  // Record what ngtcp2 consumed from the send buffer. wdatalen is -1 when no
+  // stream frame went into the packet.
+  void mark_sent(int64_t stream_id, ngtcp2_ssize wdatalen, bool fin) {
+    if (wdatalen < 0) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(out_mutex_);
+    auto it = send_bufs_.find(stream_id);
+    if (it != send_bufs_.end()) {
+      stream_bytes_sent_ += it->second.mark_sent((size_t)wdatalen, fin);
     }
   }
 
@@ -657,69 +2688,251 @@ class QuicClient {
         ngtcp2_conn_in_draining_period(conn_)) {
       return;
     }
-    uint8_t buf[1280];
+    std::vector<uint8_t> buf(ngtcp2_conn_get_path_max_tx_udp_payload_size(conn_));
     ngtcp2_path_storage ps;
     ngtcp2_path_storage_zero(&ps);
     ngtcp2_pkt_info pi;
     ngtcp2_ssize nwrite =
-      ngtcp2_conn_write_connection_close(conn_, &ps.path, &pi, buf,
-                                         sizeof(buf), &last_error_, now_ts());
+      ngtcp2_conn_write_connection_close(conn_, &ps.path, &pi, buf.data(),
+                                         buf.size(), &last_error_, now_ts());
     if (nwrite > 0) {
-      send(fd_, buf, (size_t)nwrite, 0);
+      send(fd_, buf.data(), (size_t)nwrite, 0);
     }
   }
 
+  // Called after queueing work for the worker. Only the first call since the
+  // worker last drained pays for the eventfd write; later ones find
+  // wakeup_pending_ set and are picked up by the same wakeup.
   void signal_wakeup() {
-    if (wakeup_fds_[1] != -1) {
-      uint8_t b = 1;
-      write(wakeup_fds_[1], &b, 1);
+    wakeup_enqueues_.fetch_add(1, std::memory_order_relaxed);
+    if (wakeup_pending_.exchange(true, std::memory_order_acq_rel)) {
+      return;
+    }
+    if (wakeup_fd_ != -1) {
+      uint64_t one = 1;
+      write(wakeup_fd_, &one, sizeof(one));
+      wakeups_.fetch_add(1, std::memory_order_relaxed);
     }
   }
 
+  // Worker thread. One read resets the eventfd counter. Clearing the flag is
+  // an exchange so it synchronizes with every signal_wakeup() that saw it
+  // set: their queued work is visible to the rest of this iteration, and
+  // anything queued after this point signals again.
   void drain_wakeup() {
-    uint8_t buf[64];
-    while (read(wakeup_fds_[0], buf, sizeof(buf)) > 0) {
-    }
+    uint64_t count;
+    read(wakeup_fd_, &count, sizeof(count));
+    wakeup_pending_.exchange(false, std::memory_order_acq_rel);
   }
 
   void cleanup() {
+    wake_stream_waiters(true);
     ngtcp2_conn *conn_to_del = nullptr;
     void *ssl_to_free = nullptr;
-    void *ssl_ctx_to_free = nullptr;
+    std::shared_ptr<WOLFSSL_CTX> ssl_ctx_to_release;
     int fd_to_close = -1;
-    int wake0 = -1, wake1 = -1;
+    int wake_fd = -1;
     {
       std::lock_guard<std::mutex> lock(cleanup_mutex_);
       conn_to_del = conn_;
       conn_ = nullptr;
       ssl_to_free = ssl_;
       ssl_ = nullptr;
-      ssl_ctx_to_free = ssl_ctx_;
-      ssl_ctx_ = nullptr;
+      ssl_ctx_to_release = std::move(ssl_ctx_);
       fd_to_close = fd_;
       fd_ = -1;
-      wake0 = wakeup_fds_[0];
-      wake1 = wakeup_fds_[1];
-      wakeup_fds_[0] = -1;
-      wakeup_fds_[1] = -1;
+      wake_fd = wakeup_fd_;
+      wakeup_fd_ = -1;
     }
     if (conn_to_del) {
       ngtcp2_conn_del(conn_to_del);
     }
+    {
+      // Release queued and unacked send data (runs borrowed-buffer callbacks).
+      std::lock_guard<std::mutex> lock(out_mutex_);
+      send_bufs_.clear();
+    }
     if (ssl_to_free) {
       wolfSSL_free(static_cast<WOLFSSL *>(ssl_to_free));
     }
-    if (ssl_ctx_to_free) {
-      wolfSSL_CTX_free(static_cast<WOLFSSL_CTX *>(ssl_ctx_to_free));
-    }
+    ssl_ctx_to_release.reset();
     if (fd_to_close != -1) {
       ::close(fd_to_close);
     }
-    if (wake0 != -1) {
-      ::close(wake0);
+    if (wake_fd != -1) {
+      ::close(wake_fd);
+    }
+  }
+
+  // Caller holds stream_mutex_. Framing is fixed when the stream is created.
+  StreamState &stream_state(int64_t stream_id) {
+    auto res = streams_.try_emplace(stream_id);
+    if (res.second) {
+      res.first->second.framed = mqtt_framing_;
+      res.first->second.flow.init(transport_.max_stream_data, now_ts());
+    }
+    return res.first->second;
+  }
+
+  // Caller holds out_mutex_. A write to a stream that can take no more data
+  // fails here instead of queueing bytes that would be dropped unsent.
+  bool writable(int64_t stream_id) {
+    if (send_closed_.count(stream_id)) {
+      setError("QUIC stream closed for writing");
+      return false;
+    }
+    return true;
+  }
+
+  // Caller holds stream_mutex_. Counts n bytes handed to the application;
+  // true when the worker has credit to return (see return_credit).
+  bool consume_credit(int64_t stream_id, StreamState &state, size_t n) {
+    // Datagram-borne and already counted bytes share the queue. Which bytes
+    // they were does not matter, only the running total.
+    size_t exempt = (size_t)std::min<uint64_t>(n, state.uncredited);
+    state.uncredited -= exempt;
+    return count_consumed(stream_id, state, n - exempt);
+  }
+
+  // Caller holds stream_mutex_. Counts n bytes against the stream and
+  // connection windows; true when the worker has credit to return.
+  bool count_consumed(int64_t stream_id, StreamState &state, size_t n) {
+    if (n == 0) {
+      return false;
+    }
+    bool wake = false;
+    if (state.flow.consume(n)) {
+      credit_dirty_.push_back(stream_id);
+      wake = true;
+    }
+    return conn_flow_.consume(n) || wake;
+  }
+
+  // Worker thread. Extends the stream and connection limits consumers
+  // queued, auto-tuning each window (FlowWindow::update). The connection
+  // window is kept at 1.5x the largest stream window so one busy stream
+  // cannot be starved by the connection limit.
+  void return_credit() {
+    ngtcp2_conn_info cinfo;
+    ngtcp2_conn_get_conn_info(conn_, &cinfo);
+    ngtcp2_tstamp now = now_ts();
+    uint64_t max_stream_window = std::max(kMaxStreamWindow, transport_.max_stream_data);
+    uint64_t max_conn_window = std::max(kMaxConnWindow, transport_.max_data);
+    uint64_t conn_credit = 0;
+    credit_batch_.clear();
+    {
+      std::lock_guard<std::mutex> lock(stream_mutex_);
+      for (int64_t stream_id : credit_dirty_) {
+        auto it = streams_.find(stream_id);
+        if (it == streams_.end()) {
+          continue;
+        }
+        StreamState &state = it->second;
+        uint64_t credit = state.flow.update(now, cinfo.smoothed_rtt, max_stream_window);
+        // Nothing more arrives after FIN, so no MAX_STREAM_DATA either.
+        if (credit > 0 && !state.fin_received && !state.closed) {
+          credit_batch_.emplace_back(stream_id, credit);
+        }
+        conn_flow_.window = std::max(
+            conn_flow_.window, std::min(state.flow.window / 2 * 3, max_conn_window));
+      }
+      credit_dirty_.clear();
+      if (conn_flow_.pending) {
+        conn_credit = conn_flow_.update(now, cinfo.smoothed_rtt, max_conn_window);
+      }
+    }
+    for (const auto &c : credit_batch_) {
+      // Fails only for streams ngtcp2 has already closed.
+      ngtcp2_conn_extend_max_stream_offset(conn_, c.first, c.second);
+    }
+    if (conn_credit > 0) {
+      ngtcp2_conn_extend_max_offset(conn_, conn_credit);
+    }
+    credit_updates_.fetch_add(credit_batch_.size() + (conn_credit > 0 ? 1 : 0),
+                              std::memory_order_relaxed);
+    recv_window_.store(conn_flow_.window, std::memory_order_relaxed);
+  }
+
+  // Caller holds stream_mutex_.
+  StreamState *framed_stream(int64_t stream_id) {
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end() || !it->second.framed) {
+      return nullptr;
+    }
+    return &it->second;
+  }
+
+  // Caller holds stream_mutex_.
+  void append_stream_data(int64_t stream_id, StreamState &state,
+                          const uint8_t *data, size_t datalen) {
+    if (!state.framed) {
+      state.recv_buf.append(data, datalen);
+      return;
+    }
+    if (state.framing_error) {
+      return;
+    }
+    // Credit normally waits for the reader, but the reader cannot take a
+    // packet before its last byte is here: a packet that is still partial
+    // counts as consumed as it arrives, or one larger than half the window
+    // would stall the stream (and the connection) for good. Whole packets
+    // waiting to be read still hold their credit, which bounds the queue by
+    // the window; the early-counted part is exempted when its packet is
+    // read.
+    size_t partial_before = state.framer.partial_size();
+    bool ok = state.framer.feed(data, datalen);
+    size_t partial_after = state.framer.partial_size();
+    if (partial_before + datalen > partial_after) {
+      // At least one packet completed, including the bytes counted before.
+      state.uncredited += partial_before;
+      count_consumed(stream_id, state, partial_after);
+    } else {
+      count_consumed(stream_id, state, datalen);
+    }
+    if (!ok) {
+      // Not MQTT (or corrupt): end the stream for readers rather than
+      // guessing where the next packet starts.
+      state.framing_error = true;
+      LOGE("malformed MQTT remaining length on stream %" PRId64,
+           (int64_t)stream_id);
+    }
+  }
+
+  bool stream_ended(const StreamState &state) const {
+    return state.fin_received || state.closed || state.framing_error ||
+           streams_shutdown_;
+  }
+
+  // Park on the stream's condition variable until ready() or the stream
+  // ends, for at most timeout_ns. lock holds stream_mutex_.
+  template <typename Ready>
+  void wait_readable(std::unique_lock<std::mutex> &lock, StreamState &state,
+                     uint64_t timeout_ns, Ready ready) {
+    // wait_for adds the timeout to steady_clock::now(); a caller's "forever"
+    // (Long.MAX_VALUE) would overflow that, so cap it at a day.
+    constexpr uint64_t kMaxWaitNs = 24 * 3600 * NGTCP2_SECONDS;
+    timeout_ns = std::min(timeout_ns, kMaxWaitNs);
+    ++stream_waiters_;
+    state.cv.wait_for(lock, std::chrono::nanoseconds(timeout_ns), [&]() {
+      return ready() || stream_ended(state);
+    });
+    --stream_waiters_;
+    if (streams_shutdown_) {
+      waiters_cv_.notify_all();
+    }
+  }
+
+  // The connection is gone: mark every stream ended and wake all
+  // read_stream_wait callers. With wait_for_exit this also blocks until they
+  // have all left, so the client can be torn down safely.
+  void wake_stream_waiters(bool wait_for_exit) {
+    std::unique_lock<std::mutex> lock(stream_mutex_);
+    streams_shutdown_ = true;
+    for (auto &kv : streams_) {
+      kv.second.cv.notify_all();
     }
-    if (wake1 != -1) {
-      ::close(wake1);
+    if (wait_for_exit) {
+      waiters_cv_.wait(lock, [this]() { return stream_waiters_ == 0; });
     }
   }
 
@@ -782,12 +2995,9 @@ class QuicClient {
                                          void *user_data,
                                          void *stream_user_data) {
     (void)conn;
-    (void)stream_id;
-    (void)offset;
-    (void)datalen;
-    (void)user_data;
     (void)stream_user_data;
-    return 0;
+    auto *client = static_cast<QuicClient *>(user_data);
+    return client->on_acked_stream_data(stream_id, offset, datalen);
   }
 
   static int stream_close_cb(ngtcp2_conn *conn, uint32_t flags,
@@ -798,14 +3008,44 @@ class QuicClient {
     (void)app_error_code;
     (void)stream_user_data;
     auto *client = static_cast<QuicClient *>(user_data);
-    std::lock_guard<std::mutex> lock(client->stream_mutex_);
-    auto it = client->streams_.find(stream_id);
-    if (it != client->streams_.end()) {
-      it->second.closed = true;
+    {
+      std::lock_guard<std::mutex> lock(client->stream_mutex_);
+      auto it = client->streams_.find(stream_id);
+      if (it != client->streams_.end()) {
+        it->second.closed = true;
+        client->mark_push_pending(stream_id, it->second);
+        it->second.cv.notify_all();
+      }
+    }
+    {
+      // The stream is gone, so ngtcp2 holds no more references into its
+      // send buffer.
+      std::lock_guard<std::mutex> lock(client->out_mutex_);
+      client->send_bufs_.erase(stream_id);
+      client->send_closed_.insert(stream_id);
     }
     return 0;
   }
 
+  static int recv_datagram_cb(ngtcp2_conn *conn, uint32_t flags,
+                              const uint8_t *data, size_t datalen,
+                              void *user_data) {
+    (void)conn;
+    (void)flags;
+    auto *client = static_cast<QuicClient *>(user_data);
+    client->on_recv_datagram(data, datalen);
+    return 0;
+  }
+
+  static int lost_datagram_cb(ngtcp2_conn *conn, uint64_t dgram_id,
+                              void *user_data) {
+    (void)conn;
+    (void)dgram_id;
+    auto *client = static_cast<QuicClient *>(user_data);
+    client->datagrams_lost_.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+  }
+
   static int handshake_completed_cb(ngtcp2_conn *conn, void *user_data) {
     (void)conn;
     auto *client = static_cast<QuicClient *>(user_data);
@@ -827,27 +3067,153 @@ class QuicClient {
   struct sockaddr_storage local_addr_;
   socklen_t local_addrlen_;
 
-  WOLFSSL_CTX *ssl_ctx_;
+  // Receive batch (worker thread only after init_socket).
+  static constexpr size_t kRecvSlots = 32;
+  static constexpr size_t kRecvSlotSize = 2048;
+  static constexpr size_t kRecvGroSlots = 4;
+  static constexpr size_t kRecvGroSlotSize = 65536;
+  static constexpr size_t kRecvCtrlSize = CMSG_SPACE(sizeof(int));
+  std::vector<uint8_t> recv_buf_;
+  std::vector<uint8_t> recv_ctrl_;
+  std::vector<iovec> recv_iov_;
+  std::vector<mmsghdr> recv_msgs_;
+  bool recv_mmsg_ = true;
+  bool recv_gro_ = false;
+  std::atomic<uint64_t> recv_syscalls_{0};
+  std::atomic<uint64_t> recv_packets_{0};
+
+  // Transmit train (worker thread only).
+  static constexpr size_t kMaxTrainPackets = 32;
+  // Largest IPv4 UDP payload, and so the most one GSO send can carry.
+  static constexpr size_t kMaxGsoBytes = 65507;
+  // Consecutive trains refused with EINVAL before GSO is given up on.
+  static constexpr int kGsoEinvalLimit = 8;
+  std::vector<uint8_t> send_buf_;
+  bool send_gso_ = true;
+  bool send_mmsg_ = true;
+  int gso_einval_ = 0;
+  std::atomic<uint64_t> send_syscalls_{0};
+  std::atomic<uint64_t> send_packets_{0};
+
+  // Path MTU (see set_path_mtu).
+  static constexpr uint16_t kPmtudProbes[] = {1472, 1452, 1392, 1280};
+  size_t max_udp_payload_ = 0;
+  bool pmtud_ = true;
+  bool dont_fragment_ = false;
+  std::vector<uint16_t> pmtud_probes_;
+  std::atomic<uint64_t> path_max_udp_payload_{0};
+
+  ngtcp2_cc_algo cc_algo_ = NGTCP2_CC_ALGO_CUBIC;
+  TransportConfig transport_;
+
+  // Session resumption / 0-RTT (see set_session_resumption). Worker-owned
+  // after connect_async, apart from the two stats flags.
+  bool resumption_ = false;
+  std::string session_key_;
+  std::vector<uint8_t> resume_params_;
+  bool early_data_ = false;
+  bool session_checked_ = false;
+  bool replay_pending_ = false;
+  std::atomic<bool> session_resumed_{false};
+  std::atomic<bool> early_data_accepted_{false};
+
+  uint64_t keep_alive_ms_ = 0;  // see set_keep_alive
+
+  // DATAGRAM extension (see set_datagrams). dgram_out_ is guarded by
+  // out_mutex_, dgram_stream_id_ by stream_mutex_.
+  // Advertised receive limit; the recv buffers bound it in practice.
+  static constexpr uint64_t kMaxDatagramFrame = 65535;
+  // Frame type and a 2-byte length.
+  static constexpr uint64_t kDatagramFrameOverhead = 3;
+  // A 1200-byte packet less a short header with a 20-byte connection ID
+  // and 4-byte packet number, the AEAD tag, and the frame overhead.
+  static constexpr uint64_t kDatagramMaxPayload =
+      1200 - (1 + 20 + 4) - 16 - kDatagramFrameOverhead;
+  static constexpr size_t kMaxQueuedDatagrams = 256;
+  bool datagrams_ = false;
+  bool dgram_checked_ = false;
+  std::atomic<size_t> dgram_max_payload_{0};
+  std::deque<std::vector<uint8_t>> dgram_out_;
+  uint64_t dgram_next_id_ = 0;
+  int64_t dgram_stream_id_ = -1;
+
+  std::shared_ptr<WOLFSSL_CTX> ssl_ctx_;  // from TlsContextCache
   WOLFSSL *ssl_;
   ngtcp2_conn *conn_;
   ngtcp2_crypto_conn_ref conn_ref_;
   ngtcp2_ccerr last_error_;
 
+  static constexpr ngtcp2_duration kHandshakeTimeout = 10 * NGTCP2_SECONDS;
+
   std::thread worker_;
   std::atomic<bool> running_;
   std::atomic<bool> connected_;
   std::atomic<bool> close_requested_;
 
-  int wakeup_fds_[2];
+  int wakeup_fd_ = -1;
+  std::atomic<bool> wakeup_pending_{false};
+  std::atomic<uint64_t> wakeup_enqueues_{0};
+  std::atomic<uint64_t> wakeups_{0};
+  std::atomic<uint64_t> loop_wakeups_{0};
+  std::atomic<uint64_t> spurious_wakeups_{0};
+  std::atomic<uint64_t> recv_window_{0};
+  std::atomic<uint64_t> credit_updates_{0};
+  std::atomic<uint64_t> datagrams_sent_{0};
+  std::atomic<uint64_t> datagrams_received_{0};
+  std::atomic<uint64_t> datagrams_lost_{0};
 
   std::mutex state_mutex_;
-  std::condition_variable cv_state_;
+  bool started_ = false;
+  // Set while a reactor loop owns this connection; close() waits for it.
+  bool on_reactor_ = false;
+  std::condition_variable reactor_cv_;
+
+  // Pending migrate() call, guarded by state_mutex_; migrate_pending_ lets
+  // the worker skip the lock when there is none.
+  std::shared_ptr<std::promise<int>> migrate_request_;
+  struct sockaddr_storage migrate_local_;
+  socklen_t migrate_local_len_ = 0;
+  std::atomic<bool> migrate_pending_{false};
+
+  // Pending connect_async completion and its deadline; worker-owned once
+  // the worker is started.
+  ConnectCallback connect_done_;
+  ngtcp2_tstamp handshake_deadline_ = 0;
 
   std::mutex stream_mutex_;
   std::map<int64_t, StreamState> streams_;
+  bool streams_shutdown_ = false;
+  // Receive credit (see return_credit). credit_batch_ is worker scratch.
+  static constexpr uint64_t kMaxStreamWindow = 16 * 1024 * 1024;
+  static constexpr uint64_t kMaxConnWindow = 24 * 1024 * 1024;
+  FlowWindow conn_flow_;
+  std::vector<int64_t> credit_dirty_;
+  std::vector<std::pair<int64_t, uint64_t>> credit_batch_;
+  bool mqtt_framing_ = false;
+  std::shared_ptr<const StreamListener> stream_listener_;
+  std::vector<int64_t> push_dirty_;
+
+  // Worker-only scratch for deliver_stream_data; reused across batches.
+  struct PushedChunk {
+    int64_t stream_id;
+    size_t offset;
+    size_t len;
+    bool packet;
+    bool fin;
+  };
+  std::vector<uint8_t> push_buf_;
+  std::vector<PushedChunk> push_batch_;
+  int stream_waiters_ = 0;
+  std::condition_variable waiters_cv_;
 
   std::mutex out_mutex_;
-  std::map<int64_t, std::deque<OutgoingChunk>> outgoing_;
+  std::map<int64_t, SendBuffer> send_bufs_;
+  // Streams that can take no more data (closed, shut down, or stopped by
+  // the peer); write_stream fails for them. Stream IDs are never reused.
+  std::unordered_set<int64_t> send_closed_;
+  int64_t last_send_stream_ = -1;
+  uint64_t stream_bytes_sent_ = 0;
+  uint64_t stream_bytes_acked_ = 0;
 
   mutable std::mutex err_mutex_;
   std::string last_error_str_;
@@ -855,14 +3221,150 @@ class QuicClient {
   std::mutex cleanup_mutex_;
 };
 
-static std::map<jlong, std::unique_ptr<QuicClient>> connections;
-static std::mutex connections_mutex;
-static jlong next_handle = 1;
+// Handle table for live connections (see connection_table.h).
+static ConnectionTable<QuicClient> connections;
+
+static std::shared_ptr<QuicClient> find_connection(jlong handle) {
+  return connections.find(handle);
+}
+
+static JavaVM *java_vm = nullptr;
+
+// Native threads (the QUIC worker) that attach to the VM to release Java
+// references are detached again when they exit.
+struct JniThreadAttachment {
+  bool attached = false;
+  ~JniThreadAttachment() {
+    if (attached && java_vm) {
+      java_vm->DetachCurrentThread();
+    }
+  }
+};
+static thread_local JniThreadAttachment jni_thread_attachment;
+
+static JNIEnv *current_jni_env() {
+  if (!java_vm) {
+    return nullptr;
+  }
+  JNIEnv *env = nullptr;
+  if (java_vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) == JNI_OK) {
+    return env;
+  }
+  if (java_vm->AttachCurrentThread(&env, nullptr) != JNI_OK) {
+    return nullptr;
+  }
+  jni_thread_attachment.attached = true;
+  return env;
+}
+
+// Kotlin NGTCP2Client.StreamListener pinned for push delivery. Invoked on
+// the QUIC worker, which attaches to the VM on first use and stays attached
+// until it exits.
+struct JniStreamListener {
+  jobject listener = nullptr;
+  jmethodID on_stream_data = nullptr;
+  jmethodID on_stream_packet = nullptr;
+  jmethodID on_stream_fin = nullptr;
+
+  ~JniStreamListener() {
+    if (listener) {
+      if (JNIEnv *env = current_jni_env()) {
+        env->DeleteGlobalRef(listener);
+      }
+    }
+  }
+
+  void deliver(int64_t stream_id, const uint8_t *data, size_t len, bool packet,
+               bool fin) {
+    JNIEnv *env = current_jni_env();
+    if (!env) {
+      return;
+    }
+    if (len > 0) {
+      // Wraps the worker's batch buffer; valid only during the callback.
+      jobject buf = env->NewDirectByteBuffer(const_cast<uint8_t *>(data), (jlong)len);
+      if (buf) {
+        env->CallVoidMethod(listener, packet ? on_stream_packet : on_stream_data,
+                            (jlong)stream_id, buf);
+        env->DeleteLocalRef(buf);
+      }
+      clear_exception(env);
+    }
+    if (fin) {
+      env->CallVoidMethod(listener, on_stream_fin, (jlong)stream_id);
+      clear_exception(env);
+    }
+  }
+
+  static void clear_exception(JNIEnv *env) {
+    if (env->ExceptionCheck()) {
+      LOGE("stream listener threw");
+      env->ExceptionDescribe();
+      env->ExceptionClear();
+    }
+  }
+};
+
+// Completion target for nativeConnectAsync; fired once on the worker thread.
+struct JniConnectCallback {
+  jobject callback = nullptr;
+  jmethodID on_connect_complete = nullptr;
+
+  ~JniConnectCallback() {
+    if (callback) {
+      if (JNIEnv *env = current_jni_env()) {
+        env->DeleteGlobalRef(callback);
+      }
+    }
+  }
+
+  void complete(int result) {
+    JNIEnv *env = current_jni_env();
+    if (!env) {
+      return;
+    }
+    env->CallVoidMethod(callback, on_connect_complete, (jint)result);
+    if (env->ExceptionCheck()) {
+      LOGE("connect callback threw");
+      env->ExceptionDescribe();
+      env->ExceptionClear();
+    }
+  }
+};
 
 }  // namespace
 
 extern "C" {
 
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved) {
+  (void)reserved;
+  java_vm = vm;
+  return JNI_VERSION_1_6;
+}
+
+JNIEXPORT jint JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeSetReactorThreads(
+    JNIEnv *env, jclass clazz, jint threads) {
+  if (threads <= 0) {
+    return -1;
+  }
+  return Reactor::set_threads((size_t)threads);
+}
+
+JNIEXPORT void JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeSetSessionCacheDir(
+    JNIEnv *env, jclass clazz, jstring dir) {
+  std::string path;
+  if (dir) {
+    const char *chars = env->GetStringUTFChars(dir, nullptr);
+    if (chars) {
+      path = chars;
+      env->ReleaseStringUTFChars(dir, chars);
+    }
+  }
+  SessionCache::instance().set_dir(path);
+}
+
 JNIEXPORT jlong JNICALL
 Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeCreateConnection(
     JNIEnv *env, jobject thiz, jstring host, jint port) {
@@ -873,11 +3375,8 @@ Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeCreateConnection(
   std::string host_cpp(host_str);
   env->ReleaseStringUTFChars(host, host_str);
 
-  auto client = std::make_unique<QuicClient>(host_cpp, (uint16_t)port);
-  std::lock_guard<std::mutex> lock(connections_mutex);
-  jlong handle = next_handle++;
-  connections[handle] = std::move(client);
-  return handle;
+  auto client = std::make_shared<QuicClient>(host_cpp, (uint16_t)port);
+  return connections.insert(std::move(client));
 }
 
 JNIEXPORT jlong JNICALL
@@ -894,64 +3393,107 @@ Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeCreateConnectionWithAddress(
   env->ReleaseStringUTFChars(hostnameForTls, tls_str);
   env->ReleaseStringUTFChars(connectAddress, addr_str);
 
-  auto client = std::make_unique<QuicClient>(host_for_tls, connect_addr, (uint16_t)port);
-  std::lock_guard<std::mutex> lock(connections_mutex);
-  jlong handle = next_handle++;
-  connections[handle] = std::move(client);
-  return handle;
+  auto client = std::make_shared<QuicClient>(host_for_tls, connect_addr, (uint16_t)port);
+  return connections.insert(std::move(client));
 }
 
 JNIEXPORT jint JNICALL
-Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeConnect(
-    JNIEnv *env, jobject thiz, jlong connHandle) {
-  std::lock_guard<std::mutex> lock(connections_mutex);
-  auto it = connections.find(connHandle);
-  if (it == connections.end()) {
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeConnectAsync(
+    JNIEnv *env, jobject thiz, jlong connHandle, jobject callback) {
+  auto client = find_connection(connHandle);
+  if (!client || !callback) {
     return -1;
   }
-  int rv = it->second->connect("mqtt");
-  return rv;
+  jclass cls = env->GetObjectClass(callback);
+  jmethodID on_complete = env->GetMethodID(cls, "onConnectComplete", "(I)V");
+  env->DeleteLocalRef(cls);
+  if (!on_complete) {
+    env->ExceptionClear();
+    return -1;
+  }
+  auto target = std::make_shared<JniConnectCallback>();
+  target->callback = env->NewGlobalRef(callback);
+  target->on_connect_complete = on_complete;
+  if (!target->callback) {
+    return -1;
+  }
+  return client->connect_async(
+      "mqtt", [target](int result) { target->complete(result); });
 }
 
 JNIEXPORT jlong JNICALL
 Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeOpenStream(
     JNIEnv *env, jobject thiz, jlong connHandle) {
-  std::lock_guard<std::mutex> lock(connections_mutex);
-  auto it = connections.find(connHandle);
-  if (it == connections.end()) {
+  auto client = find_connection(connHandle);
+  if (!client) {
     return -1;  // Return -1 on error (0 is a valid stream ID)
   }
-  return it->second->open_stream();
+  return client->open_stream();
 }
 
 JNIEXPORT jint JNICALL
 Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeWriteStream(
     JNIEnv *env, jobject thiz, jlong connHandle, jlong streamId, jbyteArray data) {
-  std::lock_guard<std::mutex> lock(connections_mutex);
-  auto it = connections.find(connHandle);
-  if (it == connections.end()) {
+  auto client = find_connection(connHandle);
+  if (!client) {
     return -1;
   }
   jsize len = env->GetArrayLength(data);
   if (len <= 0) {
     return 0;
   }
+  // Copy the array once, straight into storage the send buffer takes over.
   std::vector<uint8_t> buffer((size_t)len);
   env->GetByteArrayRegion(data, 0, len, reinterpret_cast<jbyte *>(buffer.data()));
-  return it->second->write_stream((int64_t)streamId, buffer.data(),
-                                  buffer.size(), false);
+  return client->write_stream((int64_t)streamId, std::move(buffer), false);
+}
+
+JNIEXPORT jint JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeWriteStreamDirect(
+    JNIEnv *env, jobject thiz, jlong connHandle, jlong streamId, jobject buffer,
+    jint offset, jint length) {
+  auto client = find_connection(connHandle);
+  if (!client) {
+    return -1;
+  }
+  if (!buffer || offset < 0 || length < 0) {
+    return -1;
+  }
+  auto *base = static_cast<uint8_t *>(env->GetDirectBufferAddress(buffer));
+  jlong capacity = env->GetDirectBufferCapacity(buffer);
+  if (!base || capacity < 0 || (jlong)offset + (jlong)length > capacity) {
+    return -1;
+  }
+  if (length == 0) {
+    return 0;
+  }
+  // Zero-copy: the send buffer borrows the direct buffer's memory and holds a
+  // global ref so it cannot be collected before the peer acks the data.
+  jobject ref = env->NewGlobalRef(buffer);
+  if (!ref) {
+    return -1;
+  }
+  int rv = client->write_stream_nocopy(
+      (int64_t)streamId, base + offset, (size_t)length, false, [ref]() {
+        if (JNIEnv *e = current_jni_env()) {
+          e->DeleteGlobalRef(ref);
+        }
+      });
+  if (rv != 0) {
+    env->DeleteGlobalRef(ref);
+  }
+  return rv;
 }
 
 JNIEXPORT jbyteArray JNICALL
 Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeReadStream(
     JNIEnv *env, jobject thiz, jlong connHandle, jlong streamId) {
-  std::lock_guard<std::mutex> lock(connections_mutex);
-  auto it = connections.find(connHandle);
-  if (it == connections.end()) {
+  auto client = find_connection(connHandle);
+  if (!client) {
     return nullptr;
   }
   uint8_t buffer[8192];
-  ssize_t nread = it->second->read_stream((int64_t)streamId, buffer, sizeof(buffer));
+  ssize_t nread = client->read_stream((int64_t)streamId, buffer, sizeof(buffer));
   if (nread <= 0) {
     return env->NewByteArray(0);
   }
@@ -960,60 +3502,322 @@ Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeReadStream(
   return result;
 }
 
+JNIEXPORT jint JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeReadStreamInto(
+    JNIEnv *env, jobject thiz, jlong connHandle, jlong streamId, jobject buffer,
+    jint offset, jint length) {
+  auto client = find_connection(connHandle);
+  if (!client) {
+    return -1;
+  }
+  if (!buffer || offset < 0 || length < 0) {
+    return -1;
+  }
+  // Caller-owned direct buffer: read_stream copies straight out of the
+  // native receive segments, with no staging buffer or jbyteArray.
+  auto *base = static_cast<uint8_t *>(env->GetDirectBufferAddress(buffer));
+  jlong capacity = env->GetDirectBufferCapacity(buffer);
+  if (!base || capacity < 0 || (jlong)offset + (jlong)length > capacity) {
+    return -1;
+  }
+  if (length == 0) {
+    return 0;
+  }
+  ssize_t nread = client->read_stream((int64_t)streamId, base + offset,
+                                          (size_t)length);
+  return (jint)nread;
+}
+
+JNIEXPORT jint JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeReadStreamWait(
+    JNIEnv *env, jobject thiz, jlong connHandle, jlong streamId, jobject buffer,
+    jint offset, jint length, jlong timeoutNs) {
+  auto client = find_connection(connHandle);
+  if (!client) {
+    return -1;
+  }
+  if (!buffer || offset < 0 || length < 0 || timeoutNs < 0) {
+    return -1;
+  }
+  auto *base = static_cast<uint8_t *>(env->GetDirectBufferAddress(buffer));
+  jlong capacity = env->GetDirectBufferCapacity(buffer);
+  if (!base || capacity < 0 || (jlong)offset + (jlong)length > capacity) {
+    return -1;
+  }
+  if (length == 0) {
+    return 0;
+  }
+  // Parks on the stream's condition variable; client keeps the connection
+  // alive even if nativeClose runs meanwhile (close() wakes us).
+  ssize_t nread = client->read_stream_wait((int64_t)streamId, base + offset,
+                                           (size_t)length, (uint64_t)timeoutNs);
+  return (jint)nread;
+}
+
+JNIEXPORT jint JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeSetMqttFraming(
+    JNIEnv *env, jobject thiz, jlong connHandle, jboolean enabled) {
+  auto client = find_connection(connHandle);
+  if (!client) {
+    return -1;
+  }
+  client->set_mqtt_framing(enabled == JNI_TRUE);
+  return 0;
+}
+
+JNIEXPORT jint JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeSetPathMtu(
+    JNIEnv *env, jobject thiz, jlong connHandle, jint maxUdpPayload, jboolean pmtud) {
+  auto client = find_connection(connHandle);
+  if (!client || maxUdpPayload < 0) {
+    return -1;
+  }
+  client->set_path_mtu((size_t)maxUdpPayload, pmtud == JNI_TRUE);
+  return 0;
+}
+
+JNIEXPORT jint JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeSetCcAlgo(
+    JNIEnv *env, jobject thiz, jlong connHandle, jint ccAlgo) {
+  auto client = find_connection(connHandle);
+  if (!client) {
+    return -1;
+  }
+  return client->set_cc_algo(ccAlgo);
+}
+
+JNIEXPORT jint JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeMigrate(
+    JNIEnv *env, jobject thiz, jlong connHandle) {
+  auto client = find_connection(connHandle);
+  if (!client) {
+    return -1;
+  }
+  return client->migrate();
+}
+
+JNIEXPORT jint JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeSetSessionResumption(
+    JNIEnv *env, jobject thiz, jlong connHandle, jboolean enabled) {
+  auto client = find_connection(connHandle);
+  if (!client) {
+    return -1;
+  }
+  client->set_session_resumption(enabled == JNI_TRUE);
+  return 0;
+}
+
+JNIEXPORT jint JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeSetKeepAlive(
+    JNIEnv *env, jobject thiz, jlong connHandle, jlong intervalMs) {
+  auto client = find_connection(connHandle);
+  if (!client || intervalMs < 0) {
+    return -1;
+  }
+  client->set_keep_alive((uint64_t)intervalMs);
+  return 0;
+}
+
+JNIEXPORT jint JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeSetDatagrams(
+    JNIEnv *env, jobject thiz, jlong connHandle, jboolean enabled) {
+  auto client = find_connection(connHandle);
+  if (!client) {
+    return -1;
+  }
+  client->set_datagrams(enabled == JNI_TRUE);
+  return 0;
+}
+
+JNIEXPORT jint JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeWriteDatagram(
+    JNIEnv *env, jobject thiz, jlong connHandle, jbyteArray data) {
+  auto client = find_connection(connHandle);
+  if (!client || !data) {
+    return -1;
+  }
+  jsize len = env->GetArrayLength(data);
+  if (len <= 0) {
+    return -1;
+  }
+  jbyte *bytes = env->GetByteArrayElements(data, nullptr);
+  if (!bytes) {
+    return -1;
+  }
+  int rv = client->write_datagram(reinterpret_cast<const uint8_t *>(bytes),
+                                  (size_t)len);
+  env->ReleaseByteArrayElements(data, bytes, JNI_ABORT);
+  return rv;
+}
+
+JNIEXPORT jint JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeSetTransportConfig(
+    JNIEnv *env, jobject thiz, jlong connHandle, jlong maxStreamsBidi, jlong maxStreamsUni,
+    jlong maxStreamData, jlong maxData, jlong maxAckDelayMs, jlong idleTimeoutMs) {
+  auto client = find_connection(connHandle);
+  if (!client || maxStreamsBidi < 0 || maxStreamsUni < 0 || maxStreamData < 0 ||
+      maxData < 0 || maxAckDelayMs < 0 || idleTimeoutMs < 0) {
+    return -1;
+  }
+  TransportConfig config;
+  config.max_streams_bidi = (uint64_t)maxStreamsBidi;
+  config.max_streams_uni = (uint64_t)maxStreamsUni;
+  config.max_stream_data = (uint64_t)maxStreamData;
+  config.max_data = (uint64_t)maxData;
+  config.max_ack_delay_ms = (uint64_t)maxAckDelayMs;
+  config.idle_timeout_ms = (uint64_t)idleTimeoutMs;
+  return client->set_transport_config(config);
+}
+
+JNIEXPORT jbyteArray JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeReadPacket(
+    JNIEnv *env, jobject thiz, jlong connHandle, jlong streamId, jlong timeoutNs) {
+  auto client = find_connection(connHandle);
+  if (!client || timeoutNs < 0) {
+    return nullptr;
+  }
+  // One call, one whole MQTT packet: empty array on timeout, null once the
+  // stream has ended (see nativeGetLastError).
+  std::vector<uint8_t> packet;
+  int rv = client->read_packet((int64_t)streamId, packet, (uint64_t)timeoutNs);
+  if (rv < 0) {
+    return nullptr;
+  }
+  jbyteArray result = env->NewByteArray((jsize)packet.size());
+  if (result && !packet.empty()) {
+    env->SetByteArrayRegion(result, 0, (jsize)packet.size(),
+                            reinterpret_cast<const jbyte *>(packet.data()));
+  }
+  return result;
+}
+
+JNIEXPORT jint JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeSetStreamListener(
+    JNIEnv *env, jobject thiz, jlong connHandle, jobject listener) {
+  auto client = find_connection(connHandle);
+  if (!client) {
+    return -1;
+  }
+  if (!listener) {
+    client->set_stream_listener(nullptr);
+    return 0;
+  }
+  // Resolve methods here, on a Java thread: the worker cannot see app classes.
+  jclass cls = env->GetObjectClass(listener);
+  jmethodID on_data = env->GetMethodID(cls, "onStreamData", "(JLjava/nio/ByteBuffer;)V");
+  jmethodID on_packet = env->GetMethodID(cls, "onStreamPacket", "(JLjava/nio/ByteBuffer;)V");
+  jmethodID on_fin = env->GetMethodID(cls, "onStreamFin", "(J)V");
+  env->DeleteLocalRef(cls);
+  if (!on_data || !on_packet || !on_fin) {
+    env->ExceptionClear();
+    return -1;
+  }
+  auto target = std::make_shared<JniStreamListener>();
+  target->listener = env->NewGlobalRef(listener);
+  target->on_stream_data = on_data;
+  target->on_stream_packet = on_packet;
+  target->on_stream_fin = on_fin;
+  if (!target->listener) {
+    return -1;
+  }
+  client->set_stream_listener(
+      [target](int64_t stream_id, const uint8_t *data, size_t len,
+               bool packet, bool fin) {
+        target->deliver(stream_id, data, len, packet, fin);
+      });
+  return 0;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeGetStats(
+    JNIEnv *env, jobject thiz, jlong connHandle) {
+  auto client = find_connection(connHandle);
+  if (!client) {
+    return nullptr;
+  }
+  ClientStats st = client->stats();
+  // Same order as ClientStats; QuicStats.fromArray decodes it.
+  jlong values[] = {
+    (jlong)st.stream_bytes_sent,
+    (jlong)st.stream_bytes_acked,
+    (jlong)st.stream_bytes_unacked,
+    (jlong)st.stream_bytes_unsent,
+    (jlong)st.send_buffer_bytes,
+    (jlong)st.wakeup_enqueues,
+    (jlong)st.wakeups,
+    (jlong)st.recv_syscalls,
+    (jlong)st.recv_packets,
+    (jlong)st.send_syscalls,
+    (jlong)st.send_packets,
+    (jlong)st.path_max_udp_payload,
+    (jlong)st.loop_wakeups,
+    (jlong)st.spurious_wakeups,
+    (jlong)st.recv_window,
+    (jlong)st.credit_updates,
+    (jlong)st.session_resumed,
+    (jlong)st.early_data_accepted,
+    (jlong)st.datagrams_sent,
+    (jlong)st.datagrams_received,
+    (jlong)st.datagrams_lost,
+  };
+  jsize n = (jsize)(sizeof(values) / sizeof(values[0]));
+  jlongArray result = env->NewLongArray(n);
+  if (result) {
+    env->SetLongArrayRegion(result, 0, n, values);
+  }
+  return result;
+}
+
 JNIEXPORT void JNICALL
 Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeClose(
     JNIEnv *env, jobject thiz, jlong connHandle) {
-  std::lock_guard<std::mutex> lock(connections_mutex);
-  auto it = connections.find(connHandle);
-  if (it == connections.end()) {
+  auto client = connections.remove(connHandle);
+  if (!client) {
     return;
   }
-  it->second->close();
-  connections.erase(it);
+  // Outside the table lock: close() wakes and waits out blocked readers,
+  // which may still hold their own reference.
+  client->close();
 }
 
 JNIEXPORT jboolean JNICALL
 Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeIsConnected(
     JNIEnv *env, jobject thiz, jlong connHandle) {
-  std::lock_guard<std::mutex> lock(connections_mutex);
-  auto it = connections.find(connHandle);
-  if (it == connections.end()) {
+  auto client = find_connection(connHandle);
+  if (!client) {
     return JNI_FALSE;
   }
-  return it->second->is_connected() ? JNI_TRUE : JNI_FALSE;
+  return client->is_connected() ? JNI_TRUE : JNI_FALSE;
 }
 
 JNIEXPORT jint JNICALL
 Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeCloseStream(
     JNIEnv *env, jobject thiz, jlong connHandle, jlong streamId) {
-  std::lock_guard<std::mutex> lock(connections_mutex);
-  auto it = connections.find(connHandle);
-  if (it == connections.end()) {
+  auto client = find_connection(connHandle);
+  if (!client) {
     return -1;
   }
-  return it->second->close_stream((int64_t)streamId);
+  return client->close_stream((int64_t)streamId);
 }
 
 JNIEXPORT jstring JNICALL
 Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeGetLastError(
     JNIEnv *env, jobject thiz, jlong connHandle) {
-  std::lock_guard<std::mutex> lock(connections_mutex);
-  auto it = connections.find(connHandle);
-  if (it == connections.end()) {
+  auto client = find_connection(connHandle);
+  if (!client) {
     return env->NewStringUTF("invalid connection");
   }
-  return env->NewStringUTF(it->second->last_error());
+  return env->NewStringUTF(client->last_error());
 }
 
 JNIEXPORT jstring JNICALL
 Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeGetLastResolvedAddress(
     JNIEnv *env, jobject thiz, jlong connHandle) {
-  std::lock_guard<std::mutex> lock(connections_mutex);
-  auto it = connections.find(connHandle);
-  if (it == connections.end()) {
+  auto client = find_connection(connHandle);
+  if (!client) {
     return nullptr;
   }
-  const std::string &addr = it->second->resolved_address();
+  const std::string &addr = client->resolved_address();
   if (addr.empty()) {
     return nullptr;
   }
@@ -0,0 +1,204 @@
+//
+// stream_buffers.h
+// MqttQuicPlugin
+//
+// Receive-side stream buffers of the QUIC core. They do not depend on ngtcp2
+// or JNI, so the host tests in android/src/test/cpp build them on their own.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+namespace mqttquic {
+
+// Segment-based receive buffer. ngtcp2 hands stream data over in chunks; keep
+// them as whole segments and serve reads with memcpy instead of moving bytes
+// through a std::deque<uint8_t> one at a time. Small chunks are packed into
+// the tail segment and drained segments are recycled, so a steady stream of
+// small frames does not allocate per chunk.
+class RecvBuffer {
+ public:
+  static constexpr size_t kMinSegmentSize = 4096;
+  static constexpr size_t kMaxSpareSegments = 2;
+
+  void append(const uint8_t *data, size_t len) {
+    size_ += len;
+    if (!segments_.empty()) {
+      std::vector<uint8_t> &tail = segments_.back().data;
+      size_t n = std::min(len, tail.capacity() - tail.size());
+      tail.insert(tail.end(), data, data + n);
+      data += n;
+      len -= n;
+    }
+    if (len == 0) {
+      return;
+    }
+    Segment seg;
+    if (!spare_.empty() && spare_.back().capacity() >= len) {
+      seg.data = std::move(spare_.back());
+      spare_.pop_back();
+    } else {
+      seg.data.reserve(std::max(len, kMinSegmentSize));
+    }
+    seg.data.assign(data, data + len);
+    segments_.push_back(std::move(seg));
+  }
+
+  size_t read(uint8_t *out, size_t maxlen) {
+    size_t copied = 0;
+    while (copied < maxlen && !segments_.empty()) {
+      Segment &head = segments_.front();
+      size_t n = std::min(head.data.size() - head.offset, maxlen - copied);
+      memcpy(out + copied, head.data.data() + head.offset, n);
+      head.offset += n;
+      copied += n;
+      if (head.offset == head.data.size()) {
+        if (spare_.size() < kMaxSpareSegments) {
+          head.data.clear();
+          spare_.push_back(std::move(head.data));
+        }
+        segments_.pop_front();
+      }
+    }
+    size_ -= copied;
+    return copied;
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  struct Segment {
+    std::vector<uint8_t> data;
+    size_t offset = 0;
+  };
+
+  std::deque<Segment> segments_;
+  std::vector<std::vector<uint8_t>> spare_;
+  size_t size_ = 0;
+};
+
+
+// Incremental MQTT framer. Each fixed header (type byte plus 1-4 byte
+// remaining length) is parsed once as bytes arrive and whole control packets
+// are queued, so handing out a packet never rescans buffered data. Byte
+// reads drain the same queue, which keeps read_stream usable on framed
+// streams.
+class MqttFramer {
+ public:
+  // Cap on up-front reservation; a hostile remaining length must not make
+  // us allocate 256 MB before any body bytes arrive.
+  static constexpr size_t kMaxReserve = 64 * 1024;
+
+  // Returns false on a malformed remaining length.
+  bool feed(const uint8_t *data, size_t len) {
+    while (len > 0) {
+      if (!in_body_) {
+        uint8_t b = *data++;
+        --len;
+        header_[header_len_++] = b;
+        if (header_len_ == 1) {
+          continue;
+        }
+        remaining_ += (size_t)(b & 0x7f) << (7 * (header_len_ - 2));
+        if (b & 0x80) {
+          if (header_len_ == sizeof(header_)) {
+            return false;
+          }
+          continue;
+        }
+        cur_.reserve(header_len_ + std::min(remaining_, kMaxReserve));
+        cur_.assign(header_, header_ + header_len_);
+        in_body_ = true;
+      } else {
+        size_t n = std::min(len, remaining_);
+        cur_.insert(cur_.end(), data, data + n);
+        data += n;
+        len -= n;
+        remaining_ -= n;
+      }
+      if (in_body_ && remaining_ == 0) {
+        bytes_ += cur_.size();
+        packets_.push_back(std::move(cur_));
+        cur_ = std::vector<uint8_t>();
+        header_len_ = 0;
+        in_body_ = false;
+      }
+    }
+    return true;
+  }
+
+  bool has_packet() const { return !packets_.empty(); }
+
+  // Queues a whole packet that arrived some other way (a DATAGRAM frame)
+  // behind the ones completed so far.
+  void push_packet(std::vector<uint8_t> packet) {
+    bytes_ += packet.size();
+    packets_.push_back(std::move(packet));
+  }
+
+  // No partially received packet is buffered.
+  bool idle() const { return header_len_ == 0; }
+
+  // Size of the next packet (less anything already taken by byte reads).
+  size_t front_size() const {
+    return packets_.empty() ? 0 : packets_.front().size() - front_offset_;
+  }
+
+  bool pop(std::vector<uint8_t> &out) {
+    if (packets_.empty()) {
+      return false;
+    }
+    std::vector<uint8_t> &front = packets_.front();
+    if (front_offset_ > 0) {
+      front.erase(front.begin(), front.begin() + (ptrdiff_t)front_offset_);
+      front_offset_ = 0;
+    }
+    bytes_ -= front.size();
+    out = std::move(front);
+    packets_.pop_front();
+    return true;
+  }
+
+  size_t read(uint8_t *out, size_t maxlen) {
+    size_t copied = 0;
+    while (copied < maxlen && !packets_.empty()) {
+      const std::vector<uint8_t> &front = packets_.front();
+      size_t n = std::min(front.size() - front_offset_, maxlen - copied);
+      memcpy(out + copied, front.data() + front_offset_, n);
+      front_offset_ += n;
+      copied += n;
+      if (front_offset_ == front.size()) {
+        packets_.pop_front();
+        front_offset_ = 0;
+      }
+    }
+    bytes_ -= copied;
+    return copied;
+  }
+
+  // Bytes in complete packets; a partially received packet is not readable.
+  size_t size() const { return bytes_; }
+
+  // Bytes of the packet still being received, fixed header included.
+  size_t partial_size() const { return in_body_ ? cur_.size() : header_len_; }
+
+ private:
+  std::deque<std::vector<uint8_t>> packets_;
+  size_t front_offset_ = 0;
+  size_t bytes_ = 0;
+
+  std::vector<uint8_t> cur_;
+  uint8_t header_[5];
+  size_t header_len_ = 0;
+  size_t remaining_ = 0;
+  bool in_body_ = false;
+};
+
+}  // namespace mqttquic
@@ -2,11 +2,15 @@ package ai.annadata.mqttquic
 
 import ai.annadata.mqttquic.client.MQTTClient
 import ai.annadata.mqttquic.mqtt.MQTT5PropertyType
+import ai.annadata.mqttquic.quic.CongestionControl
+import ai.annadata.mqttquic.quic.NGTCP2Client
+import ai.annadata.mqttquic.quic.QuicTransportConfig
 import com.getcapacitor.JSObject
 import com.getcapacitor.Plugin
 import com.getcapacitor.PluginCall
 import com.getcapacitor.PluginMethod
 import com.getcapacitor.annotation.CapacitorPlugin
+import android.content.pm.PackageManager
 import android.os.Handler
 import android.os.Looper
 import android.system.Os
@@ -53,18 +57,76 @@ class MqttQuicPlugin : Plugin() {
         return resolveHostToIp(host) ?: if (host == lastResolvedHost) lastResolvedIp else null
     }
 
-    private fun bundledCaFilePath(): String? {
+    private fun bundledCaFilePath(): String? = bundledCaBlobPath ?: bundledCaPemPath
+
+    /** mqttquic_ca.bin (build-ca-store.py output) if bundled; native maps it and skips PEM parsing. */
+    private val bundledCaBlobPath: String? by lazy {
+        bundledAssetFile("mqttquic_ca.bin")?.takeIf { file ->
+            val magic = ByteArray(4)
+            val n = file.inputStream().use { it.read(magic) }
+            n == 4 && String(magic, StandardCharsets.US_ASCII) == "MQCA"
+        }?.absolutePath
+    }
+
+    private val bundledCaPemPath: String? by lazy {
+        bundledAssetFile("mqttquic_ca.pem")?.takeIf { file ->
+            file.readText().contains("BEGIN CERTIFICATE")
+        }?.absolutePath
+    }
+
+    /**
+     * Copy of an asset in filesDir, which native can open by path; null if the asset is not bundled.
+     * Resolved once per plugin instance, and the copy is only rewritten when the app was installed or
+     * updated after it was made, so a connect neither reads the asset nor rewrites the file.
+     */
+    private fun bundledAssetFile(assetName: String): File? {
         return try {
-            val assetName = "mqttquic_ca.pem"
-            val content = context.assets.open(assetName).bufferedReader().use { it.readText() }
-            if (!content.contains("BEGIN CERTIFICATE")) {
-                return null
-            }
             val outFile = File(context.filesDir, assetName)
-            outFile.writeText(content)
-            outFile.absolutePath
+            val installed = context.packageManager.getPackageInfo(context.packageName, 0).lastUpdateTime
+            if (!outFile.exists() || outFile.lastModified() < installed) {
+                // Written aside and renamed, so native never maps a half-written file.
+                val tmp = File(context.filesDir, "$assetName.tmp")
+                context.assets.open(assetName).use { input ->
+                    tmp.outputStream().use { input.copyTo(it) }
+                }
+                if (!tmp.renameTo(outFile)) {
+                    tmp.delete()
+                    return null
+                }
+            }
+            outFile
         } catch (_: IOException) {
             null
+        } catch (_: PackageManager.NameNotFoundException) {
+            null
+        }
+    }
+
+    /** transportProfile preset with any transportConfig fields laid over it; null if the profile is unknown. */
+    private fun transportConfig(call: PluginCall): QuicTransportConfig? {
+        val base = QuicTransportConfig.forProfile(call.getString("transportProfile") ?: "default") ?: return null
+        val o = call.getObject("transportConfig") ?: return base
+        // Non-numeric values become -1, which native rejects.
+        fun field(name: String, fallback: Long): Long = if (o.has(name)) o.optLong(name, -1) else fallback
+        return base.copy(
+            maxStreamsBidi = field("maxStreamsBidi", base.maxStreamsBidi),
+            maxStreamsUni = field("maxStreamsUni", base.maxStreamsUni),
+            maxStreamData = field("maxStreamData", base.maxStreamData),
+            maxData = field("maxData", base.maxData),
+            maxAckDelayMs = field("maxAckDelayMs", base.maxAckDelayMs),
+            idleTimeoutMs = field("idleTimeoutMs", base.idleTimeoutMs)
+        )
+    }
+
+    @PluginMethod
+    fun migrate(call: PluginCall) {
+        scope.launch {
+            try {
+                client.migrate()
+                call.resolve(JSObject().put("migrated", true))
+            } catch (e: Exception) {
+                call.reject(e.message ?: "Migration failed")
+            }
         }
     }
 
@@ -81,6 +143,12 @@ class MqttQuicPlugin : Plugin() {
         val sessionExpiryInterval = call.getInt("sessionExpiryInterval")
         val caFile = call.getString("caFile")
         val caPath = call.getString("caPath")
+        val ccAlgoStr = call.getString("ccAlgo") ?: "cubic"
+        val sessionResumption = call.getBoolean("sessionResumption", false) ?: false
+        val persistSessions = call.getBoolean("persistSessions", false) ?: false
+        val transportKeepalive = call.getBoolean("transportKeepalive", false) ?: false
+        val datagrams = call.getBoolean("datagrams", false) ?: false
+        val dataStreams = call.getInt("dataStreams", 0) ?: 0
         
         val protocolVersion = when (protocolVersionStr) {
             "5.0" -> MQTTClient.ProtocolVersion.V5
@@ -92,6 +160,25 @@ class MqttQuicPlugin : Plugin() {
             call.reject("host and clientId are required")
             return
         }
+        val ccAlgo = CongestionControl.fromOption(ccAlgoStr)
+        if (ccAlgo == null) {
+            call.reject("ccAlgo must be 'cubic', 'reno' or 'bbr'")
+            return
+        }
+        val transportConfig = transportConfig(call)
+        if (transportConfig == null) {
+            call.reject("transportProfile must be 'default', 'low-power' or 'bulk'")
+            return
+        }
+        if (transportKeepalive && call.getObject("transportConfig")?.has("idleTimeoutMs") == true) {
+            // Native sets the idle timeout to 1.5x keepalive in this mode; don't drop the caller's silently.
+            call.reject("transportConfig.idleTimeoutMs cannot be used with transportKeepalive (idle timeout is 1.5x keepalive)")
+            return
+        }
+        if (dataStreams !in 0..32) {
+            call.reject("dataStreams must be between 0 and 32")
+            return
+        }
 
         scope.launch {
             try {
@@ -110,6 +197,16 @@ class MqttQuicPlugin : Plugin() {
                 } catch (_: Exception) {
                     // Ignore env setup failures; native layer will report verification errors.
                 }
+                if (sessionResumption) {
+                    // Tickets stay in the app's private cache; without persistSessions they only
+                    // live as long as the process.
+                    val dir = if (persistSessions) {
+                        File(context.cacheDir, "mqttquic_sessions").takeIf { it.isDirectory || it.mkdirs() }
+                    } else {
+                        null
+                    }
+                    NGTCP2Client.setSessionCacheDir(dir?.absolutePath)
+                }
                 if (client.getState() == MQTTClient.State.CONNECTED) {
                     client.disconnect()
                 }
@@ -136,7 +233,7 @@ class MqttQuicPlugin : Plugin() {
                     try {
                         withContext(Dispatchers.IO) {
                             val resolvedIp = resolveOrCachedIp(host)
-                            client.connect(host, port, clientId, username, password, cleanSession ?: true, keepalive ?: 20, sessionExpiryInterval, connectAddress = resolvedIp)
+                            client.connect(host, port, clientId, username, password, cleanSession ?: true, keepalive ?: 20, sessionExpiryInterval, connectAddress = resolvedIp, ccAlgo = ccAlgo, transportConfig = transportConfig, sessionResumption = sessionResumption, transportKeepalive = transportKeepalive, datagrams = datagrams, dataStreams = dataStreams)
                         }
                         // Cache resolved IP from native so reconnect can use it when Java DNS fails
                         client.getLastResolvedAddress()?.let { ip ->
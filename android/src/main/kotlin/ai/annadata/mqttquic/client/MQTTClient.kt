@@ -8,10 +8,12 @@ import ai.annadata.mqttquic.mqtt.MQTTProtocol
 import ai.annadata.mqttquic.mqtt.MQTT5Protocol
 import ai.annadata.mqttquic.mqtt.MQTT5ReasonCode
 import ai.annadata.mqttquic.mqtt.MQTTProtocolLevel
+import ai.annadata.mqttquic.quic.CongestionControl
 import ai.annadata.mqttquic.quic.NGTCP2Client
 import ai.annadata.mqttquic.quic.QuicClient
 import ai.annadata.mqttquic.quic.QuicClientStub
 import ai.annadata.mqttquic.quic.QuicStream
+import ai.annadata.mqttquic.quic.QuicTransportConfig
 import ai.annadata.mqttquic.transport.MQTTStreamReader
 import ai.annadata.mqttquic.transport.MQTTStreamWriter
 import ai.annadata.mqttquic.transport.QUICStreamReader
@@ -47,11 +49,34 @@ class MQTTClient {
         V311, V5, AUTO
     }
 
+    internal companion object {
+        /** Upper bound on one native wait in the CONNACK loop; the outer withTimeout sets the real deadline. */
+        private const val CONNACK_WAIT_SLICE_MS = 250L
+
+        /** First and longest wait before opening a data stream again after the broker refused one. */
+        private const val DATA_STREAM_RETRY_MIN_MS = 500L
+        private const val DATA_STREAM_RETRY_MAX_MS = 30_000L
+
+        /** PUBREL's type nibble; MQTTMessageType.PUBREL (0x62) includes the flags the header must carry. */
+        private val PUBREL_TYPE = (MQTTMessageType.PUBREL.toInt() and 0xF0).toByte()
+
+        /** 32-bit FNV-1a of the topic's UTF-8 bytes; iOS uses the same, so topics map to the same data stream. */
+        internal fun topicHash(topic: String): UInt {
+            var h = 0x811c9dc5u
+            for (b in topic.toByteArray(Charsets.UTF_8)) {
+                h = (h xor (b.toUInt() and 0xffu)) * 0x01000193u
+            }
+            return h
+        }
+    }
+
     private var state = State.DISCONNECTED
     private var protocolVersion = ProtocolVersion.AUTO
     private var activeProtocolVersion: Byte = 0  // 0x04 or 0x05
     /** Effective keepalive in seconds (from CONNACK Server Keep Alive, or connect param). Used when sending PINGREQ. */
     private var effectiveKeepalive: Int = 0
+    /** True while QUIC PINGs (native timer) keep the connection alive instead of PINGREQ. */
+    private var transportKeepaliveActive = false
     /** Assigned Client Identifier from CONNACK when client sent empty ClientID; null otherwise. */
     private var assignedClientIdentifier: String? = null
     private var quicClient: QuicClient? = null
@@ -75,6 +100,22 @@ class MQTTClient {
     @Volatile
     private var pendingPingresp: CompletableDeferred<Unit>? = null
     private val lock = Mutex()
+    /**
+     * Data streams (connect's dataStreams option): PUBLISH packets go on stream
+     * topicHash(topic) % dataStreamCount, opened on first use, while the stream from connect
+     * stays the control stream. Guarded by [dataStreamLock].
+     */
+    private val dataWriters = mutableMapOf<Int, MQTTStreamWriter>()
+    /** Reader loop of each data stream in [dataWriters]; cancelled by disconnect. Guarded by [dataStreamLock]. */
+    private val dataLoopJobs = mutableMapOf<Int, kotlinx.coroutines.Job>()
+    private var dataStreamCount = 0
+    /**
+     * The broker refused another stream: publishes stay on the control stream until this time
+     * (System.nanoTime() ms), then one open is tried again. The wait doubles per refusal.
+     */
+    private var dataStreamRetryAtMs = 0L
+    private var dataStreamRetryMs = DATA_STREAM_RETRY_MIN_MS
+    private val dataStreamLock = Mutex()
     private val scope = CoroutineScope(Dispatchers.Default + SupervisorJob())
 
     constructor(protocolVersion: ProtocolVersion = ProtocolVersion.AUTO) {
@@ -121,7 +162,13 @@ class MQTTClient {
         cleanSession: Boolean,
         keepalive: Int,
         sessionExpiryInterval: Int? = null,
-        connectAddress: String? = null
+        connectAddress: String? = null,
+        ccAlgo: CongestionControl = CongestionControl.CUBIC,
+        transportConfig: QuicTransportConfig = QuicTransportConfig.DEFAULT,
+        sessionResumption: Boolean = false,
+        transportKeepalive: Boolean = false,
+        datagrams: Boolean = false,
+        dataStreams: Int = 0
     ) {
         lock.withLock {
             if (state == State.CONNECTING) {
@@ -129,6 +176,12 @@ class MQTTClient {
             }
             state = State.CONNECTING
         }
+        closeDataStreams()
+        dataStreamLock.withLock {
+            dataStreamCount = if (NGTCP2Client.isAvailable()) dataStreams.coerceAtLeast(0) else 0
+            dataStreamRetryAtMs = 0L
+            dataStreamRetryMs = DATA_STREAM_RETRY_MIN_MS
+        }
 
         try {
             val useV5 = protocolVersion == ProtocolVersion.V5 || protocolVersion == ProtocolVersion.AUTO
@@ -140,8 +193,19 @@ class MQTTClient {
                 connack = MQTTProtocol.buildConnack(MQTTConnAckCode.ACCEPTED)
             }
             
+            // transportKeepalive: native sends QUIC PINGs every keepalive seconds and CONNECT
+            // carries keepalive 0, so no PINGREQ timer runs here. Liveness is the QUIC idle
+            // timeout (1.5x keepalive, as the broker would enforce).
+            val quicKeepalive = transportKeepalive && keepalive > 0 && NGTCP2Client.isAvailable()
+            val connectKeepalive = if (quicKeepalive) 0 else keepalive
             val quic: QuicClient = if (NGTCP2Client.isAvailable()) {
-                NGTCP2Client()
+                NGTCP2Client(
+                    ccAlgo = ccAlgo,
+                    transportConfig = transportConfig,
+                    sessionResumption = sessionResumption,
+                    keepAliveMs = if (quicKeepalive) keepalive * 1000L else 0L,
+                    datagrams = datagrams
+                )
             } else {
                 QuicClientStub(connack.toList())
             }
@@ -163,7 +227,7 @@ class MQTTClient {
                     clientId,
                     username,
                     password,
-                    keepalive,
+                    connectKeepalive,
                     cleanSession,
                     sessionExpiryInterval
                 )
@@ -173,7 +237,7 @@ class MQTTClient {
                     clientId,
                     username,
                     password,
-                    keepalive,
+                    connectKeepalive,
                     cleanSession
                 )
                 activeProtocolVersion = MQTTProtocolLevel.V311
@@ -223,8 +287,8 @@ class MQTTClient {
                                         else -> Log.i("MQTTClient", "CONNACK loop: skipping non-CONNACK packet type=0x${Integer.toHexString(typeByte)}")
                                     }
                                 } else {
-                                    // Only delay when no data; if we have data but no packet, retry soon (avoid suspend then timeout before next iteration)
-                                    if (avail == 0) delay(50) else delay(10)
+                                    // Incomplete packet: park until more bytes arrive (withTimeout still bounds the loop)
+                                    r.awaitData(CONNACK_WAIT_SLICE_MS)
                                 }
                             } else {
                                 // Fallback for non-QUIC reader (e.g. mock)
@@ -271,7 +335,7 @@ class MQTTClient {
                                     lock.withLock { state = State.ERROR }
                                     throw IllegalArgumentException("expected CONNACK, got $msgType")
                                 }
-                                delay(50)
+                                r.awaitData(CONNACK_WAIT_SLICE_MS)
                             }
                         } else {
                             val (msgType, remLen, fixed) = readFixedHeader(r)
@@ -300,8 +364,11 @@ class MQTTClient {
                     throw IllegalArgumentException("CONNACK refused: $reasonCode")
                 }
                 // [MQTT-3.2.2-21] Use Server Keep Alive from CONNACK if present
+                // A nonzero Server Keep Alive after CONNECT said 0 means the broker still wants PINGREQ.
                 lock.withLock {
-                    effectiveKeepalive = (props[MQTT5PropertyType.SERVER_KEEP_ALIVE.toInt()] as? Int) ?: keepalive
+                    val serverKeepalive = props[MQTT5PropertyType.SERVER_KEEP_ALIVE.toInt()] as? Int
+                    effectiveKeepalive = serverKeepalive ?: keepalive
+                    transportKeepaliveActive = quicKeepalive && (serverKeepalive ?: 0) == 0
                     assignedClientIdentifier = props[MQTT5PropertyType.ASSIGNED_CLIENT_IDENTIFIER.toInt()] as? String
                 }
             } else {
@@ -310,7 +377,10 @@ class MQTTClient {
                     lock.withLock { state = State.ERROR }
                     throw IllegalArgumentException("CONNACK refused: $returnCode")
                 }
-                lock.withLock { effectiveKeepalive = keepalive }
+                lock.withLock {
+                    effectiveKeepalive = keepalive
+                    transportKeepaliveActive = quicKeepalive
+                }
             }
 
             lock.withLock { state = State.CONNECTED }
@@ -361,6 +431,22 @@ class MQTTClient {
         } else {
             data = MQTTProtocol.buildPublish(topic, payload, pid, qos, false)
         }
+        // QoS 0 may go as a QUIC DATAGRAM (connect's datagrams option); the stream otherwise.
+        if (qos == 0 && (lock.withLock { quicClient } as? NGTCP2Client)?.sendDatagram(data) == true) {
+            return
+        }
+        dataWriter(topic)?.let { dw ->
+            try {
+                dw.write(data)
+                dw.drain()
+                return
+            } catch (e: Exception) {
+                // Only this stream failed (e.g. the broker sent STOP_SENDING); the connection is
+                // still up. Drop the stream so the topic reopens one, and send on the control stream.
+                Log.w("MQTTClient", "data stream write failed, publishing on the control stream: ${e.message}")
+                dataStreamLock.withLock { dataWriters.entries.removeAll { it.value === dw } }
+            }
+        }
         try {
             w.write(data)
             w.drain()
@@ -374,6 +460,7 @@ class MQTTClient {
                 writer = null
                 state = State.DISCONNECTED
             }
+            closeDataStreams()
             throw e
         }
     }
@@ -442,6 +529,14 @@ class MQTTClient {
         }
     }
 
+    /** Keep the session across a network change by migrating the QUIC connection (native only). */
+    suspend fun migrate() {
+        if (getState() != State.CONNECTED) throw IllegalStateException("not connected")
+        val quic = lock.withLock { quicClient } as? NGTCP2Client
+            ?: throw IllegalStateException("migration needs the native QUIC client")
+        quic.migrate()
+    }
+
     suspend fun disconnect() {
         val job = messageLoopJob
         messageLoopJob = null
@@ -449,6 +544,7 @@ class MQTTClient {
         keepaliveJob = null
         job?.cancel()
         job?.join()
+        closeDataStreams().forEach { it.join() }
 
         failPendingSubacksUnsubacks(IllegalStateException("Disconnected"))
 
@@ -542,8 +638,8 @@ class MQTTClient {
     private fun startKeepaliveLoop() {
         keepaliveJob?.cancel()
         keepaliveJob = scope.launch {
-            val ka = lock.withLock { effectiveKeepalive }
-            if (ka <= 0) return@launch
+            val (ka, transportActive) = lock.withLock { effectiveKeepalive to transportKeepaliveActive }
+            if (ka <= 0 || transportActive) return@launch
             while (isActive) {
                 delay(ka * 1000L) // seconds to ms
                 val (w, stillConnected) = lock.withLock {
@@ -558,13 +654,135 @@ class MQTTClient {
         }
     }
 
+    /** Deliver an incoming PUBLISH and acknowledge QoS 1/2 on the stream it arrived on ([replyWriter]). */
+    private suspend fun handlePublish(msgType: Byte, rest: ByteArray, replyWriter: suspend () -> MQTTStreamWriter?) {
+        val qos = (msgType.toInt() shr 1) and 0x03
+        try {
+            val (topic, packetId, payload) = lock.withLock {
+                if (activeProtocolVersion == MQTTProtocolLevel.V5) {
+                    MQTT5Protocol.parsePublishV5(rest, 0, qos, topicAliasMap)
+                } else {
+                    MQTTProtocol.parsePublish(rest, 0, qos)
+                }
+            }
+            val (cb, globalCb) = lock.withLock {
+                subscribedTopics[topic] to onPublish
+            }
+            globalCb?.invoke(topic, payload)
+            cb?.invoke(payload)
+
+            if (qos >= 1 && packetId != null) {
+                replyWriter()?.let {
+                    if (qos == 1) {
+                        it.write(MQTTProtocol.buildPuback(packetId))
+                    } else {
+                        it.write(MQTTProtocol.buildPubrec(packetId))
+                    }
+                    it.drain()
+                }
+            }
+        } catch (e: Exception) {
+            // PUBLISH parse failed: log and skip this message (don't disconnect)
+            val hex = rest.take(64).joinToString("") { "%02x".format(it) }
+            Log.w("MQTTClient", "PUBLISH parse failed: ${e.message} restLen=${rest.size} hex=$hex", e)
+        }
+    }
+
+    /**
+     * Writer of [topic]'s data stream, opened on first use, or null to use the control stream
+     * (data streams off, or the broker's stream limit reached and the retry wait not over). A topic
+     * always maps to the same stream, so its messages stay in order.
+     */
+    private suspend fun dataWriter(topic: String): MQTTStreamWriter? = dataStreamLock.withLock {
+        if (dataStreamCount <= 0) return@withLock null
+        val slot = (topicHash(topic) % dataStreamCount.toUInt()).toInt()
+        dataWriters[slot]?.let { return@withLock it }
+        val now = System.nanoTime() / 1_000_000
+        if (now < dataStreamRetryAtMs) return@withLock null
+        val quic = lock.withLock { quicClient } ?: return@withLock null
+        val s = try {
+            quic.openStream()
+        } catch (e: Exception) {
+            Log.w("MQTTClient", "no data stream available, publishing on the control stream for ${dataStreamRetryMs}ms: ${e.message}")
+            dataStreamRetryAtMs = now + dataStreamRetryMs
+            dataStreamRetryMs = (dataStreamRetryMs * 2).coerceAtMost(DATA_STREAM_RETRY_MAX_MS)
+            return@withLock null
+        }
+        dataStreamRetryMs = DATA_STREAM_RETRY_MIN_MS
+        val w = QUICStreamWriter(s)
+        dataWriters[slot] = w
+        startDataStreamLoop(slot, QUICStreamReader(s), w)
+        w
+    }
+
+    /** Forget all data streams and cancel their reader loops; returns the loops to join if wanted. */
+    private suspend fun closeDataStreams(): List<kotlinx.coroutines.Job> {
+        val jobs = dataStreamLock.withLock {
+            val j = dataLoopJobs.values.toList()
+            dataLoopJobs.clear()
+            dataWriters.clear()
+            j
+        }
+        jobs.forEach { it.cancel() }
+        return jobs
+    }
+
+    /**
+     * Acks for our own publishes, on whichever stream they arrived: PUBREC gets its PUBREL there
+     * (QoS 2 step 2), PUBACK and PUBCOMP end the flow. publish() does not wait for acks, so there
+     * is nothing further to complete.
+     */
+    private suspend fun handlePublishAck(type: Byte, rest: ByteArray, w: MQTTStreamWriter?) {
+        if (type != MQTTMessageType.PUBREC || rest.size < 2 || w == null) return
+        w.write(MQTTProtocol.buildPubrel(MQTTProtocol.parsePuback(rest, 0)))
+        w.drain()
+    }
+
+    /**
+     * Read a data stream: PUBLISH packets the broker sends there, PUBREL for QoS 2 ones, and the
+     * acks for publishes sent on it.
+     */
+    private fun startDataStreamLoop(slot: Int, r: MQTTStreamReader, w: MQTTStreamWriter) {
+        dataLoopJobs[slot] = scope.launch {
+            while (isActive) {
+                try {
+                    val packet = r.readPacket()
+                    val (msgType, _, hdrLen) = MQTTProtocol.parseFixedHeader(packet)
+                    val rest = packet.copyOfRange(hdrLen, packet.size)
+                    val type = (msgType.toInt() and 0xF0).toByte()
+                    when (type) {
+                        MQTTMessageType.PUBLISH -> handlePublish(msgType, rest) { w }
+                        PUBREL_TYPE -> if (rest.size >= 2) {
+                            w.write(MQTTProtocol.buildPubcomp(MQTTProtocol.parsePubrel(rest, 0)))
+                            w.drain()
+                        }
+                        MQTTMessageType.PUBACK, MQTTMessageType.PUBREC, MQTTMessageType.PUBCOMP ->
+                            handlePublishAck(type, rest, w)
+                    }
+                } catch (_: Exception) {
+                    break
+                }
+            }
+            // Stream gone: the next publish for its topics opens a new one.
+            dataStreamLock.withLock {
+                if (dataWriters[slot] === w) {
+                    dataWriters.remove(slot)
+                    dataLoopJobs.remove(slot)
+                }
+            }
+        }
+    }
+
     private fun startMessageLoop() {
         messageLoopJob = scope.launch {
             while (isActive) {
                 val r = lock.withLock { reader } ?: break
                 try {
-                    val (msgType, remLen, fixed) = readFixedHeader(r)
-                    val rest = r.readexactly(remLen)
+                    // One whole packet per call (natively framed on QUIC streams); split once here.
+                    val packet = r.readPacket()
+                    val (msgType, _, hdrLen) = MQTTProtocol.parseFixedHeader(packet)
+                    val fixed = packet.copyOf(hdrLen)
+                    val rest = packet.copyOfRange(hdrLen, packet.size)
                     val type = (msgType.toInt() and 0xF0).toByte()
                     when (type) {
                         MQTTMessageType.SUBACK -> {
@@ -611,40 +829,8 @@ class MQTTClient {
                                 pendingPingresp = null
                             }
                         }
-                        MQTTMessageType.PUBLISH -> {
-                            val qos = (msgType.toInt() shr 1) and 0x03
-                            try {
-                                val (topic, packetId, payload) = lock.withLock {
-                                    if (activeProtocolVersion == MQTTProtocolLevel.V5) {
-                                        MQTT5Protocol.parsePublishV5(rest, 0, qos, topicAliasMap)
-                                    } else {
-                                        MQTTProtocol.parsePublish(rest, 0, qos)
-                                    }
-                                }
-                                val (cb, globalCb) = lock.withLock {
-                                    subscribedTopics[topic] to onPublish
-                                }
-                                globalCb?.invoke(topic, payload)
-                                cb?.invoke(payload)
-
-                                if (qos >= 1 && packetId != null) {
-                                    val w = lock.withLock { writer }
-                                    w?.let {
-                                        if (qos == 1) {
-                                            it.write(MQTTProtocol.buildPuback(packetId))
-                                        } else {
-                                            it.write(MQTTProtocol.buildPubrec(packetId))
-                                        }
-                                        it.drain()
-                                    }
-                                }
-                            } catch (e: Exception) {
-                                // PUBLISH parse failed: log and skip this message (don't disconnect)
-                                val hex = rest.take(64).joinToString("") { "%02x".format(it) }
-                                Log.w("MQTTClient", "PUBLISH parse failed: ${e.message} restLen=${rest.size} hex=$hex", e)
-                            }
-                        }
-                        MQTTMessageType.PUBREL -> {
+                        MQTTMessageType.PUBLISH -> handlePublish(msgType, rest) { lock.withLock { writer } }
+                        PUBREL_TYPE -> {
                             if (rest.size < 2) break
                             val pubrelPid = MQTTProtocol.parsePubrel(rest, 0)
                             val w = lock.withLock { writer }
@@ -653,6 +839,8 @@ class MQTTClient {
                                 it.drain()
                             }
                         }
+                        MQTTMessageType.PUBACK, MQTTMessageType.PUBREC, MQTTMessageType.PUBCOMP ->
+                            handlePublishAck(type, rest, lock.withLock { writer })
                     }
                 } catch (e: Exception) {
                     if (isActive) {
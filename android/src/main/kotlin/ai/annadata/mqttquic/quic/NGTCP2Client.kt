@@ -1,7 +1,15 @@
 package ai.annadata.mqttquic.quic
 
 import android.util.Log
+import kotlinx.coroutines.CancellationException
+import kotlinx.coroutines.CompletableDeferred
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.channels.Channel
 import kotlinx.coroutines.delay
+import kotlinx.coroutines.withContext
+import kotlinx.coroutines.withTimeoutOrNull
+import java.nio.ByteBuffer
+import java.util.concurrent.TimeUnit
 
 /**
  * ngtcp2-based QUIC client implementation for Android.
@@ -13,8 +21,64 @@ import kotlinx.coroutines.delay
  * - OpenSSL 3.0+ or BoringSSL for TLS 1.3
  * - Android NDK r25+
  * - Android API 21+ (Android 5.0+)
+ *
+ * With [pushDelivery] (the default) the native worker pushes received stream data
+ * into each [NGTCP2Stream] through [StreamListener]; otherwise streams pull with
+ * nativeReadStreamInto / nativeReadStreamWait.
+ *
+ * With [mqttFraming] (the default) native splits each stream into whole MQTT packets
+ * as data arrives, and [MqttPacketStream.readPacket] hands out one per call.
+ *
+ * [maxUdpPayload] caps datagram size and is the ceiling for path MTU discovery
+ * (0 = native default, 1452); [pmtud] false keeps packets at 1200 bytes.
+ *
+ * [ccAlgo] picks the congestion controller (ngtcp2's default is CUBIC), and
+ * [transportConfig] the advertised transport parameters and receive windows.
+ *
+ * [sessionResumption] resumes the TLS session of an earlier connection to the same
+ * broker and sends the first packets as 0-RTT when the server allows it; see
+ * [setSessionCacheDir] to keep sessions across restarts. 0-RTT data can be replayed,
+ * so leave it off unless the first packets (CONNECT) are safe to repeat.
+ *
+ * [keepAliveMs] > 0 has native send QUIC PINGs at that interval on an idle connection
+ * and sets the idle timeout to 1.5x it, standing in for MQTT PINGREQs; see
+ * MQTTClient's transportKeepalive.
+ *
+ * [datagrams] offers the QUIC DATAGRAM extension: [sendDatagram] can then carry QoS 0
+ * PUBLISH packets outside the stream, and ones the broker sends that way arrive on the
+ * MQTT stream like any other packet (needs [mqttFraming]).
  */
-class NGTCP2Client : QuicClient {
+class NGTCP2Client(
+    private val pushDelivery: Boolean = true,
+    private val mqttFraming: Boolean = true,
+    private val maxUdpPayload: Int = 0,
+    private val pmtud: Boolean = true,
+    private val ccAlgo: CongestionControl = CongestionControl.CUBIC,
+    private val transportConfig: QuicTransportConfig = QuicTransportConfig.DEFAULT,
+    private val sessionResumption: Boolean = false,
+    private val keepAliveMs: Long = 0,
+    private val datagrams: Boolean = false
+) : QuicClient {
+
+    /**
+     * Called on the native QUIC worker thread. Buffers wrap native memory that is only
+     * valid during the call, so implementations must copy them. [onStreamPacket] carries
+     * exactly one MQTT packet (framed streams), [onStreamData] a raw batch. [onStreamFin]
+     * is called once per stream when it ends (FIN, reset, or connection closed).
+     */
+    interface StreamListener {
+        fun onStreamData(streamId: Long, data: ByteBuffer)
+        fun onStreamPacket(streamId: Long, packet: ByteBuffer)
+        fun onStreamFin(streamId: Long)
+    }
+
+    /**
+     * Completion for nativeConnectAsync, called exactly once on the native worker thread:
+     * 0 when the handshake completes (earlier with 0-RTT), -1 on failure, timeout or close (see nativeGetLastError).
+     */
+    interface ConnectCallback {
+        fun onConnectComplete(result: Int)
+    }
     
     companion object {
         private const val TAG = "NGTCP2Client"
@@ -36,15 +100,42 @@ class NGTCP2Client : QuicClient {
         }
 
         fun isAvailable(): Boolean = nativeAvailable
+
+        /**
+         * Serve all connections created from now on from a shared pool of [threads]
+         * native event-loop threads (epoll) instead of one worker thread each. Meant for
+         * processes holding many broker connections. Can be set once per process;
+         * returns false if the pool could not be started or was already started with a
+         * different size.
+         */
+        fun useSharedReactor(threads: Int): Boolean =
+            nativeAvailable && threads > 0 && nativeSetReactorThreads(threads) == 0
+
+        /**
+         * Keep TLS session tickets as files in [dir] (app-private, must exist) so
+         * [sessionResumption] also works after a restart; null keeps them in memory only.
+         */
+        fun setSessionCacheDir(dir: String?) {
+            if (nativeAvailable) nativeSetSessionCacheDir(dir)
+        }
+
+        @JvmStatic
+        private external fun nativeSetReactorThreads(threads: Int): Int
+
+        @JvmStatic
+        private external fun nativeSetSessionCacheDir(dir: String?)
     }
     
     // Native methods (implemented in ngtcp2_jni.cpp)
     private external fun nativeCreateConnection(host: String, port: Int): Long
     private external fun nativeCreateConnectionWithAddress(hostnameForTls: String, connectAddress: String, port: Int): Long
-    private external fun nativeConnect(connHandle: Long): Int
+    private external fun nativeConnectAsync(connHandle: Long, callback: ConnectCallback): Int
     private external fun nativeOpenStream(connHandle: Long): Long
     private external fun nativeWriteStream(connHandle: Long, streamId: Long, data: ByteArray): Int
+    private external fun nativeWriteStreamDirect(connHandle: Long, streamId: Long, buffer: ByteBuffer, offset: Int, length: Int): Int
     private external fun nativeReadStream(connHandle: Long, streamId: Long): ByteArray?
+    private external fun nativeReadStreamInto(connHandle: Long, streamId: Long, buffer: ByteBuffer, offset: Int, length: Int): Int
+    private external fun nativeReadStreamWait(connHandle: Long, streamId: Long, buffer: ByteBuffer, offset: Int, length: Int, timeoutNs: Long): Int
     private external fun nativeClose(connHandle: Long)
     private external fun nativeIsConnected(connHandle: Long): Boolean
     // Public to avoid Kotlin internal-name mangling (nativeCloseStream$module) which breaks JNI lookup
@@ -52,15 +143,78 @@ class NGTCP2Client : QuicClient {
     @JvmName("nativeGetLastError")
     external fun nativeGetLastError(connHandle: Long): String
     private external fun nativeGetLastResolvedAddress(connHandle: Long): String?
+    private external fun nativeGetStats(connHandle: Long): LongArray?
+    private external fun nativeSetStreamListener(connHandle: Long, listener: StreamListener?): Int
+    private external fun nativeSetMqttFraming(connHandle: Long, enabled: Boolean): Int
+    private external fun nativeSetPathMtu(connHandle: Long, maxUdpPayload: Int, pmtud: Boolean): Int
+    private external fun nativeSetCcAlgo(connHandle: Long, ccAlgo: Int): Int
+    private external fun nativeSetSessionResumption(connHandle: Long, enabled: Boolean): Int
+    private external fun nativeMigrate(connHandle: Long): Int
+    private external fun nativeSetKeepAlive(connHandle: Long, intervalMs: Long): Int
+    private external fun nativeSetDatagrams(connHandle: Long, enabled: Boolean): Int
+    private external fun nativeWriteDatagram(connHandle: Long, data: ByteArray): Int
+    private external fun nativeSetTransportConfig(
+        connHandle: Long,
+        maxStreamsBidi: Long,
+        maxStreamsUni: Long,
+        maxStreamData: Long,
+        maxData: Long,
+        maxAckDelayMs: Long,
+        idleTimeoutMs: Long
+    ): Int
+    private external fun nativeReadPacket(connHandle: Long, streamId: Long, timeoutNs: Long): ByteArray?
 
     /** Resolved IP used for this connection (set after init_socket in native). Use for reconnect cache when Java DNS fails. */
     fun getLastResolvedAddress(): String? = if (connHandle != 0L) nativeGetLastResolvedAddress(connHandle) else null
 
+    /** Transport counters for this connection, or null when not connected. */
+    fun getStats(): QuicStats? {
+        if (connHandle == 0L) return null
+        return nativeGetStats(connHandle)?.let { QuicStats.fromArray(it) }
+    }
+
     // Connection state
     private var connHandle: Long = 0
     private var isConnected: Boolean = false
     private val streams = mutableMapOf<Long, NGTCP2Stream>()
-    
+    /** Pushed data for streams not registered yet (arrived before openStream returned). Guarded by [streams]. */
+    private val earlyPush = mutableMapOf<Long, NGTCP2Stream.Inbox>()
+
+    private val pushListener = object : StreamListener {
+        override fun onStreamData(streamId: Long, data: ByteBuffer) {
+            inboxFor(streamId)?.put(data)
+        }
+
+        override fun onStreamPacket(streamId: Long, packet: ByteBuffer) {
+            inboxFor(streamId)?.put(packet)
+        }
+
+        override fun onStreamFin(streamId: Long) {
+            inboxFor(streamId)?.finish()
+        }
+    }
+
+    /**
+     * Inbox of [streamId], or null for a server-initiated stream (odd id): openStream never
+     * returns one, so its data would sit in [earlyPush] until close. It is dropped instead.
+     */
+    private fun inboxFor(streamId: Long): NGTCP2Stream.Inbox? = synchronized(streams) {
+        streams[streamId]?.inbox ?: if (streamId and 0x1L != 0L) {
+            null
+        } else {
+            earlyPush.getOrPut(streamId) { NGTCP2Stream.Inbox() }
+        }
+    }
+
+    /**
+     * Returns once streams can be used. With [sessionResumption] and a ticket that allows
+     * 0-RTT, that is as soon as the first flight is out, before the server has answered:
+     * the connect callback fires 0 while nativeIsConnected is still false, and only turns
+     * true when the handshake completes. If the handshake then fails or times out, there
+     * is no second callback; the connection just dies, and the next read or write fails
+     * with the error from nativeGetLastError. A 0-RTT rejection is not a failure: native
+     * resends the early data under 1-RTT keys.
+     */
     override suspend fun connect(host: String, port: Int, connectAddress: String?) {
         if (!isAvailable()) {
             throw IllegalStateException("ngtcp2 native library is not loaded")
@@ -78,11 +232,57 @@ class NGTCP2Client : QuicClient {
         if (connHandle == 0L) {
             throw IllegalStateException("Failed to create QUIC connection")
         }
+        if (mqttFraming && nativeSetMqttFraming(connHandle, true) != 0) {
+            throw IllegalStateException("Failed to enable MQTT framing")
+        }
+        if (nativeSetPathMtu(connHandle, maxUdpPayload, pmtud) != 0) {
+            throw IllegalStateException("Invalid max UDP payload: $maxUdpPayload")
+        }
+        if (nativeSetCcAlgo(connHandle, ccAlgo.nativeValue) != 0) {
+            throw IllegalStateException("Unsupported congestion control: $ccAlgo")
+        }
+        val tc = transportConfig
+        if (nativeSetTransportConfig(
+                connHandle, tc.maxStreamsBidi, tc.maxStreamsUni, tc.maxStreamData,
+                tc.maxData, tc.maxAckDelayMs, tc.idleTimeoutMs
+            ) != 0
+        ) {
+            throw IllegalStateException("Invalid transport config: $tc")
+        }
+        if (sessionResumption && nativeSetSessionResumption(connHandle, true) != 0) {
+            throw IllegalStateException("Failed to enable session resumption")
+        }
+        if (keepAliveMs > 0 && nativeSetKeepAlive(connHandle, keepAliveMs) != 0) {
+            throw IllegalStateException("Failed to set QUIC keep-alive")
+        }
+        if (datagrams && nativeSetDatagrams(connHandle, true) != 0) {
+            throw IllegalStateException("Failed to enable QUIC datagrams")
+        }
+        if (pushDelivery && nativeSetStreamListener(connHandle, pushListener) != 0) {
+            throw IllegalStateException("Failed to register QUIC stream listener")
+        }
         
-        // Connect to server
-        val result = nativeConnect(connHandle)
+        // Connect to server. The handshake runs on the native worker, so no thread is
+        // held while it is in flight; handshakes to several brokers can overlap.
+        val handle = connHandle
+        val done = CompletableDeferred<Int>()
+        val started = nativeConnectAsync(handle, object : ConnectCallback {
+            override fun onConnectComplete(result: Int) {
+                done.complete(result)
+            }
+        })
+        if (started != 0) {
+            throw Exception("QUIC connection failed: ${nativeGetLastError(handle)}")
+        }
+        val result = try {
+            done.await()
+        } catch (e: CancellationException) {
+            nativeClose(handle)
+            connHandle = 0
+            throw e
+        }
         if (result != 0) {
-            throw Exception("QUIC connection failed: ${nativeGetLastError(connHandle)}")
+            throw Exception("QUIC connection failed: ${nativeGetLastError(handle)}")
         }
         isConnected = true
     }
@@ -97,26 +297,58 @@ class NGTCP2Client : QuicClient {
             throw IllegalStateException("Failed to open QUIC stream: ${nativeGetLastError(connHandle)}")
         }
         
-        val stream = NGTCP2Stream(connHandle, streamId, this)
-        streams[streamId] = stream
+        val stream = synchronized(streams) {
+            val inbox = if (pushDelivery) earlyPush.remove(streamId) ?: NGTCP2Stream.Inbox() else null
+            NGTCP2Stream(connHandle, streamId, this, inbox, mqttFraming).also { streams[streamId] = it }
+        }
         
         return stream
     }
     
+    /**
+     * Move the connection to a new UDP socket after a network change (same server, new local
+     * address). Streams stay open and no new handshake is needed. Fails before the handshake is
+     * confirmed, or if the server disabled migration or has no spare connection ID yet.
+     */
+    suspend fun migrate() {
+        if (!isConnected) {
+            throw IllegalStateException("Not connected")
+        }
+        val handle = connHandle
+        withContext(Dispatchers.IO) {
+            if (nativeMigrate(handle) != 0) {
+                throw Exception("QUIC migration failed: ${nativeGetLastError(handle)}")
+            }
+        }
+    }
+
+    /**
+     * Queue one whole QoS 0 PUBLISH packet as a QUIC DATAGRAM (unreliable, no head-of-line
+     * blocking). False if it has to go on the stream instead: datagrams off or not supported
+     * by the broker, packet too large for one datagram, or the native queue full.
+     */
+    fun sendDatagram(packet: ByteArray): Boolean =
+        datagrams && isConnected && nativeWriteDatagram(connHandle, packet) == 0
+
     override suspend fun close() {
         if (!isConnected) {
             return
         }
         
         // Close all streams
-        streams.values.forEach { stream ->
+        val active = synchronized(streams) {
+            val list = streams.values.toList()
+            streams.clear()
+            earlyPush.clear()
+            list
+        }
+        active.forEach { stream ->
             try {
                 stream.close()
             } catch (e: Exception) {
                 // Ignore errors during stream close
             }
         }
-        streams.clear()
         
         // Close native connection
         nativeClose(connHandle)
@@ -135,6 +367,31 @@ class NGTCP2Client : QuicClient {
         return nativeWriteStream(connHandle, streamId, data)
     }
     
+    /**
+     * Internal method called by NGTCP2Stream to queue a direct buffer without copying.
+     * Native holds a global ref to [buffer] until the data is acknowledged.
+     */
+    internal fun writeStreamDataDirect(streamId: Long, buffer: ByteBuffer, offset: Int, length: Int): Int {
+        if (!isConnected) {
+            throw IllegalStateException("Not connected")
+        }
+        return nativeWriteStreamDirect(connHandle, streamId, buffer, offset, length)
+    }
+
+    /**
+     * Next whole MQTT packet from a framed stream (pull mode), parking in native up to
+     * [timeoutNs]. Returns an empty array on timeout, null once the stream has ended.
+     */
+    internal suspend fun readPacketData(streamId: Long, timeoutNs: Long): ByteArray? {
+        if (!isConnected) {
+            throw IllegalStateException("Not connected")
+        }
+        val handle = connHandle
+        return withContext(Dispatchers.IO) {
+            nativeReadPacket(handle, streamId, timeoutNs)
+        }
+    }
+
     /**
      * Internal method called to read data from stream
      */
@@ -144,6 +401,32 @@ class NGTCP2Client : QuicClient {
         }
         return nativeReadStream(connHandle, streamId)
     }
+
+    /**
+     * Internal method called to read stream data straight into a direct buffer
+     * (no intermediate byte[]). Returns bytes written at [offset], or -1 on error.
+     */
+    internal fun readStreamDataInto(streamId: Long, buffer: ByteBuffer, offset: Int, length: Int): Int {
+        if (!isConnected) {
+            throw IllegalStateException("Not connected")
+        }
+        return nativeReadStreamInto(connHandle, streamId, buffer, offset, length)
+    }
+
+    /**
+     * Blocking variant of [readStreamDataInto]: parks in native until data arrives or
+     * [timeoutNs] elapses. Returns 0 on timeout, -1 once the stream has ended. Runs on
+     * [Dispatchers.IO] so the caller's dispatcher is not blocked.
+     */
+    internal suspend fun readStreamDataWait(streamId: Long, buffer: ByteBuffer, offset: Int, length: Int, timeoutNs: Long): Int {
+        if (!isConnected) {
+            throw IllegalStateException("Not connected")
+        }
+        val handle = connHandle
+        return withContext(Dispatchers.IO) {
+            nativeReadStreamWait(handle, streamId, buffer, offset, length, timeoutNs)
+        }
+    }
 }
 
 /**
@@ -152,9 +435,91 @@ class NGTCP2Client : QuicClient {
 internal class NGTCP2Stream(
     private val connHandle: Long,
     override val streamId: Long,
-    private val client: NGTCP2Client
-) : QuicStream {
-    
+    private val client: NGTCP2Client,
+    /** Set in push mode: the native worker fills it and reads are served from it. */
+    internal val inbox: Inbox? = null,
+    override val framesMqttPackets: Boolean = false
+) : QuicStream, MqttPacketStream {
+
+    /**
+     * Receive queue for push delivery. The native worker's callback buffer is copied into
+     * one chunk per call: a whole MQTT packet on framed streams, otherwise a raw batch.
+     * Byte reads drain across chunks; [takePacket] hands out the next chunk whole.
+     * Readers park on [signal] until more arrives.
+     */
+    internal class Inbox {
+        private val chunks = ArrayDeque<ByteArray>()
+        private var headOffset = 0
+        private var finished = false
+        private val signal = Channel<Unit>(Channel.CONFLATED)
+
+        fun put(data: ByteBuffer) {
+            val chunk = ByteArray(data.remaining())
+            data.get(chunk)
+            synchronized(this) { chunks.addLast(chunk) }
+            signal.trySend(Unit)
+        }
+
+        fun finish() {
+            synchronized(this) { finished = true }
+            signal.trySend(Unit)
+        }
+
+        /** Move up to dst.remaining() bytes into dst. Returns the count, or -1 once finished and empty. */
+        fun take(dst: ByteBuffer): Int {
+            synchronized(this) {
+                if (chunks.isEmpty()) {
+                    return if (finished) -1 else 0
+                }
+                var n = 0
+                while (dst.hasRemaining() && chunks.isNotEmpty()) {
+                    val head = chunks.first()
+                    val len = minOf(head.size - headOffset, dst.remaining())
+                    dst.put(head, headOffset, len)
+                    headOffset += len
+                    n += len
+                    if (headOffset == head.size) {
+                        chunks.removeFirst()
+                        headOffset = 0
+                    }
+                }
+                return n
+            }
+        }
+
+        /** Next chunk (remainder, if byte reads took part of it), null if empty; throws once finished and empty. */
+        private fun takeChunk(): ByteArray? {
+            synchronized(this) {
+                if (chunks.isEmpty()) {
+                    if (finished) throw Exception("Failed to read from stream: QUIC stream closed")
+                    return null
+                }
+                val head = chunks.removeFirst()
+                val offset = headOffset
+                headOffset = 0
+                return if (offset == 0) head else head.copyOfRange(offset, head.size)
+            }
+        }
+
+        /** Wait up to [timeoutMillis] for data or end of stream, then [take]. */
+        suspend fun take(dst: ByteBuffer, timeoutMillis: Long): Int =
+            awaitFor(timeoutMillis, 0) { take(dst).takeIf { it != 0 } }
+
+        /** Wait up to [timeoutMillis] for the next whole packet; null on timeout. */
+        suspend fun takePacket(timeoutMillis: Long): ByteArray? =
+            awaitFor(timeoutMillis, null) { takeChunk() }
+
+        private suspend inline fun <T> awaitFor(timeoutMillis: Long, onTimeout: T, attempt: () -> T?): T {
+            val deadline = System.nanoTime() + timeoutMillis * 1_000_000L
+            while (true) {
+                attempt()?.let { return it }
+                val left = (deadline - System.nanoTime()) / 1_000_000L
+                if (left <= 0) return onTimeout
+                withTimeoutOrNull(left) { signal.receive() }
+            }
+        }
+    }
+
     private var isClosed: Boolean = false
     
     /**
@@ -168,10 +533,70 @@ internal class NGTCP2Stream(
         if (isClosed) {
             throw IllegalStateException("Stream is closed")
         }
+        if (inbox != null) {
+            val dst = ByteBuffer.allocate(maxBytes)
+            if (inbox.take(dst) <= 0) return ByteArray(0)
+            return dst.array().copyOf(dst.position())
+        }
         val data = client.readStreamData(streamId) ?: return ByteArray(0)
         return data
     }
+
+    override suspend fun readInto(dst: ByteBuffer): Int {
+        if (isClosed) {
+            throw IllegalStateException("Stream is closed")
+        }
+        if (inbox != null) {
+            return maxOf(inbox.take(dst), 0)
+        }
+        if (!dst.isDirect) {
+            return super.readInto(dst)
+        }
+        val n = client.readStreamDataInto(streamId, dst, dst.position(), dst.remaining())
+        if (n < 0) {
+            throw Exception("Failed to read from stream: ${client.nativeGetLastError(connHandle)}")
+        }
+        dst.position(dst.position() + n)
+        return n
+    }
+
+    override suspend fun readInto(dst: ByteBuffer, timeoutMillis: Long): Int {
+        if (isClosed) {
+            throw IllegalStateException("Stream is closed")
+        }
+        if (inbox != null) {
+            val n = inbox.take(dst, timeoutMillis)
+            if (n < 0) {
+                throw Exception("Failed to read from stream: QUIC stream closed")
+            }
+            return n
+        }
+        if (!dst.isDirect) {
+            return super.readInto(dst, timeoutMillis)
+        }
+        val n = client.readStreamDataWait(streamId, dst, dst.position(), dst.remaining(), TimeUnit.MILLISECONDS.toNanos(timeoutMillis))
+        if (n < 0) {
+            throw Exception("Failed to read from stream: ${client.nativeGetLastError(connHandle)}")
+        }
+        dst.position(dst.position() + n)
+        return n
+    }
     
+    override suspend fun readPacket(timeoutMillis: Long): ByteArray? {
+        if (isClosed) {
+            throw IllegalStateException("Stream is closed")
+        }
+        if (!framesMqttPackets) {
+            throw IllegalStateException("MQTT framing is not enabled on this stream")
+        }
+        if (inbox != null) {
+            return inbox.takePacket(timeoutMillis)
+        }
+        val packet = client.readPacketData(streamId, TimeUnit.MILLISECONDS.toNanos(timeoutMillis))
+            ?: throw Exception("Failed to read from stream: ${client.nativeGetLastError(connHandle)}")
+        return if (packet.isEmpty()) null else packet
+    }
+
     override suspend fun write(data: ByteArray) {
         if (isClosed) {
             throw IllegalStateException("Stream is closed")
@@ -184,6 +609,20 @@ internal class NGTCP2Stream(
         }
     }
     
+    override suspend fun write(src: ByteBuffer) {
+        if (isClosed) {
+            throw IllegalStateException("Stream is closed")
+        }
+        if (!src.isDirect) {
+            return super.write(src)
+        }
+        val result = client.writeStreamDataDirect(streamId, src, src.position(), src.remaining())
+        if (result != 0) {
+            throw Exception("Failed to write to stream: ${client.nativeGetLastError(connHandle)}")
+        }
+        src.position(src.limit())
+    }
+
     override suspend fun close() {
         if (isClosed) {
             return
@@ -1,5 +1,9 @@
 package ai.annadata.mqttquic.quic
 
+import kotlinx.coroutines.delay
+import java.nio.ByteBuffer
+import java.util.concurrent.TimeUnit
+
 /**
  * QUIC stream: one bidirectional stream per MQTT connection.
  * Phase 2: ngtcp2 client + single stream.
@@ -7,10 +11,204 @@ package ai.annadata.mqttquic.quic
 interface QuicStream {
     val streamId: Long
     suspend fun read(maxBytes: Int): ByteArray
+
+    /**
+     * Read up to dst.remaining() bytes into dst at its position and advance it.
+     * Returns the number of bytes read (0 when nothing is buffered). Implementations
+     * backed by native memory write straight into a direct buffer; the default
+     * goes through [read].
+     */
+    suspend fun readInto(dst: ByteBuffer): Int {
+        val chunk = read(dst.remaining())
+        dst.put(chunk)
+        return chunk.size
+    }
+
+    /**
+     * Like [readInto], but when nothing is buffered waits up to [timeoutMillis] for data.
+     * Returns 0 on timeout. Native streams park on the receive callback; the default polls.
+     */
+    suspend fun readInto(dst: ByteBuffer, timeoutMillis: Long): Int {
+        val start = System.nanoTime()
+        val timeoutNs = TimeUnit.MILLISECONDS.toNanos(timeoutMillis)
+        while (true) {
+            val n = readInto(dst)
+            if (n > 0 || System.nanoTime() - start >= timeoutNs) return n
+            delay(5L)
+        }
+    }
+
     suspend fun write(data: ByteArray)
+
+    /**
+     * Write src's remaining bytes and advance its position. Implementations backed
+     * by native memory queue a direct buffer without copying and keep a reference
+     * until the peer acknowledges it, so callers must not modify the bytes after
+     * this call. The default copies through [write].
+     */
+    suspend fun write(src: ByteBuffer) {
+        val data = ByteArray(src.remaining())
+        src.get(data)
+        write(data)
+    }
     suspend fun close()
 }
 
+/**
+ * A stream whose transport splits incoming data into whole MQTT control packets
+ * (fixed header + body) as it arrives, so callers get one packet per call without
+ * re-parsing buffered bytes.
+ */
+interface MqttPacketStream {
+    /** False when framing is off for this stream; [readPacket] must not be used then. */
+    val framesMqttPackets: Boolean
+
+    /** Next whole packet, waiting up to [timeoutMillis]; null on timeout. Throws once the stream has ended. */
+    suspend fun readPacket(timeoutMillis: Long): ByteArray?
+}
+
+/** Congestion controller for a connection; [nativeValue] is the ngtcp2_cc_algo value. */
+enum class CongestionControl(val nativeValue: Int) {
+    RENO(0),
+    CUBIC(1),
+    BBR(2);
+
+    companion object {
+        /** Parse a connect option ("reno", "cubic", "bbr"); null if unrecognised. */
+        fun fromOption(name: String): CongestionControl? =
+            values().firstOrNull { it.name.equals(name, ignoreCase = true) }
+    }
+}
+
+/**
+ * Transport parameters and receive windows advertised to the server. Defaults are what
+ * native has always sent; [LOW_POWER] and [BULK] trade battery against throughput.
+ */
+data class QuicTransportConfig(
+    /** Server-initiated bidirectional streams. */
+    val maxStreamsBidi: Long = 8,
+    /** Server-initiated unidirectional streams. */
+    val maxStreamsUni: Long = 8,
+    /** Per-stream receive window, bytes. */
+    val maxStreamData: Long = 256L * 1024,
+    /** Connection receive window, bytes. */
+    val maxData: Long = 1024L * 1024,
+    /** Longest we hold an ACK back; larger values batch ACKs into fewer radio wakeups. */
+    val maxAckDelayMs: Long = 1,
+    /** 0 disables the idle timeout. */
+    val idleTimeoutMs: Long = 30_000
+) {
+    companion object {
+        val DEFAULT = QuicTransportConfig()
+
+        /** Small telemetry links: 25 ms ACK batching, modest windows, 2 min idle timeout. */
+        val LOW_POWER = QuicTransportConfig(
+            maxStreamData = 64L * 1024,
+            maxData = 256L * 1024,
+            maxAckDelayMs = 25,
+            idleTimeoutMs = 120_000
+        )
+
+        /** High bandwidth-delay links: 4 MB stream and 16 MB connection windows. */
+        val BULK = QuicTransportConfig(
+            maxStreamData = 4L * 1024 * 1024,
+            maxData = 16L * 1024 * 1024,
+            maxAckDelayMs = 10
+        )
+
+        /** Preset for a connect option ("default", "low-power", "bulk"); null if unrecognised. */
+        fun forProfile(name: String): QuicTransportConfig? = when (name.lowercase()) {
+            "default" -> DEFAULT
+            "low-power" -> LOW_POWER
+            "bulk" -> BULK
+            else -> null
+        }
+    }
+}
+
+/**
+ * Snapshot of native transport counters. Stream byte counts cover application
+ * data only; [streamBytesUnacked] is data sent but still retained for
+ * retransmission until the peer acknowledges it.
+ */
+data class QuicStats(
+    val streamBytesSent: Long,
+    val streamBytesAcked: Long,
+    val streamBytesUnacked: Long,
+    val streamBytesUnsent: Long,
+    val sendBufferBytes: Long,
+    /** Worker wakeup requests; compare with [wakeups] for the coalescing ratio. */
+    val wakeupEnqueues: Long = 0,
+    /** Wakeup requests that actually signalled the worker. */
+    val wakeups: Long = 0,
+    /** Socket receive syscalls; see [recvSyscallsPerPacket]. */
+    val recvSyscalls: Long = 0,
+    /** Datagrams handed to ngtcp2 (GRO buffers count once per segment). */
+    val recvPackets: Long = 0,
+    /** Socket send syscalls; see [sendPacketsPerSyscall]. */
+    val sendSyscalls: Long = 0,
+    /** Datagrams sent. */
+    val sendPackets: Long = 0,
+    /** Max UDP payload validated on the current path (1200 until PMTUD raises it). */
+    val pathMaxUdpPayload: Long = 0,
+    /** Event loop passes. */
+    val loopWakeups: Long = 0,
+    /** Passes with no I/O ready and no timer due; should stay flat while idle. */
+    val spuriousWakeups: Long = 0,
+    /** Connection receive window, grown from the configured maxData by autotuning. */
+    val recvWindow: Long = 0,
+    /** Flow-control limit extensions (MAX_STREAM_DATA / MAX_DATA) returned to the peer. */
+    val creditUpdates: Long = 0,
+    /** The TLS handshake resumed a cached session. */
+    val sessionResumed: Boolean = false,
+    /** The server accepted 0-RTT data; false after a rejection (data was resent). */
+    val earlyDataAccepted: Boolean = false,
+    /** QoS 0 PUBLISH packets sent as DATAGRAM frames. */
+    val datagramsSent: Long = 0,
+    /** DATAGRAM frames received. */
+    val datagramsReceived: Long = 0,
+    /** DATAGRAM frames declared lost; they are not resent. */
+    val datagramsLost: Long = 0
+) {
+    /** Datagrams per send syscall: 1.0 unbatched, up to the train size with GSO/sendmmsg. */
+    val sendPacketsPerSyscall: Double
+        get() = if (sendSyscalls == 0L) 0.0 else sendPackets.toDouble() / sendSyscalls
+
+    /** Receive syscalls per datagram: 1.0 (or more) unbatched, well below 1 with recvmmsg/GRO. */
+    val recvSyscallsPerPacket: Double
+        get() = if (recvPackets == 0L) 0.0 else recvSyscalls.toDouble() / recvPackets
+
+    companion object {
+        /** Decode the array returned by the native layer (field order matches ClientStats). */
+        fun fromArray(values: LongArray): QuicStats {
+            fun at(i: Int): Long = values.getOrElse(i) { 0L }
+            return QuicStats(
+                streamBytesSent = at(0),
+                streamBytesAcked = at(1),
+                streamBytesUnacked = at(2),
+                streamBytesUnsent = at(3),
+                sendBufferBytes = at(4),
+                wakeupEnqueues = at(5),
+                wakeups = at(6),
+                recvSyscalls = at(7),
+                recvPackets = at(8),
+                sendSyscalls = at(9),
+                sendPackets = at(10),
+                pathMaxUdpPayload = at(11),
+                loopWakeups = at(12),
+                spuriousWakeups = at(13),
+                recvWindow = at(14),
+                creditUpdates = at(15),
+                sessionResumed = at(16) != 0L,
+                earlyDataAccepted = at(17) != 0L,
+                datagramsSent = at(18),
+                datagramsReceived = at(19),
+                datagramsLost = at(20)
+            )
+        }
+    }
+}
+
 /**
  * QUIC client: connect, TLS handshake, open one bidirectional stream.
  */
@@ -1,9 +1,9 @@
 package ai.annadata.mqttquic.transport
 
 import android.util.Log
-import ai.annadata.mqttquic.mqtt.MQTTProtocol
+import ai.annadata.mqttquic.quic.MqttPacketStream
 import ai.annadata.mqttquic.quic.QuicStream
-import kotlinx.coroutines.delay
+import java.nio.ByteBuffer
 
 /**
  * MQTTStreamReader over QUIC stream. Buffers excess bytes so readexactly(n)
@@ -12,48 +12,76 @@ import kotlinx.coroutines.delay
  *
  * Efficient CONNACK/packet read: call [drain] to read until the stream has no more
  * data, then [tryConsumeNextPacket] to take the first complete MQTT packet from
- * the buffer. Repeat drain + tryConsumeNextPacket (with short delay) until you
- * get a packet or timeout.
+ * the buffer. Repeat drain + tryConsumeNextPacket (parking in [awaitData] between
+ * attempts) until you get a packet or timeout.
  */
 class QUICStreamReader(private val stream: QuicStream) : MQTTStreamReader {
 
-    private val buffer = mutableListOf<Byte>()
+    /**
+     * Direct buffer the native layer reads into (see [QuicStream.readInto]).
+     * Unconsumed bytes live in [readPos, buffer.position()); buffer stays in write mode.
+     */
+    private var buffer: ByteBuffer = ByteBuffer.allocateDirect(INITIAL_CAPACITY)
+    private var readPos = 0
+
+    private val buffered: Int
+        get() = buffer.position() - readPos
 
-    override suspend fun available(): Int = buffer.size
+    override suspend fun available(): Int = buffered
 
     /** Read from stream until no more data is available (drained). Call before tryConsumeNextPacket. */
     suspend fun drain() {
         while (true) {
-            val chunk = stream.read(8192)
-            if (chunk.isEmpty()) break
-            Log.i("MQTTClient", "QUICStreamReader: drain got ${chunk.size} bytes bufferTotal=${buffer.size + chunk.size}")
-            buffer.addAll(chunk.toList())
+            ensureWritable(READ_CHUNK)
+            val n = stream.readInto(buffer)
+            if (n <= 0) break
+            Log.i("MQTTClient", "QUICStreamReader: drain got $n bytes bufferTotal=$buffered")
+        }
+    }
+
+    /**
+     * Wait up to [timeoutMillis] for more stream data and buffer it. Returns false on timeout.
+     * Parks on the native receive signal instead of polling, so a packet is seen as soon as it lands.
+     */
+    suspend fun awaitData(timeoutMillis: Long): Boolean {
+        ensureWritable(READ_CHUNK)
+        val n = stream.readInto(buffer, timeoutMillis)
+        if (n > 0) {
+            Log.i("MQTTClient", "QUICStreamReader: awaitData got $n bytes bufferTotal=$buffered")
         }
+        return n > 0
     }
 
-    /** Consume the first n bytes from buffer and return them. Caller must ensure buffer.size >= n. */
+    /** Consume the first n bytes from buffer and return them. Caller must ensure buffered >= n. */
     fun consume(n: Int): ByteArray {
-        if (buffer.size < n) throw IllegalArgumentException("buffer has ${buffer.size} < $n")
-        val out = buffer.take(n).toByteArray()
-        repeat(n) { buffer.removeAt(0) }
+        if (buffered < n) throw IllegalArgumentException("buffer has $buffered < $n")
+        val out = ByteArray(n)
+        val writePos = buffer.position()
+        buffer.position(readPos)
+        buffer.get(out, 0, n)
+        buffer.position(writePos)
+        readPos += n
+        if (readPos == writePos) {
+            buffer.clear()
+            readPos = 0
+        }
         return out
     }
 
     /**
      * If buffer contains at least one complete MQTT packet (fixed header + payload), consume and return it; else return null.
-     * Call after [drain]; if null, delay and drain again (or timeout).
+     * Call after [drain]; if null, [awaitData] and try again (or timeout).
      */
     fun tryConsumeNextPacket(): ByteArray? {
-        val buf = buffer.toByteArray()
-        val totalLen = MQTTProtocol.getNextPacketLength(buf)
+        val totalLen = nextPacketLength()
         if (totalLen == null) {
-            if (buf.isNotEmpty()) {
-                Log.w("MQTTClient", "QUICStreamReader: getNextPacketLength returned null bufferSize=${buf.size} firstByte=0x${Integer.toHexString(buf[0].toInt() and 0xFF)}")
+            if (buffered > 0) {
+                Log.w("MQTTClient", "QUICStreamReader: fixed header incomplete bufferSize=$buffered firstByte=0x${Integer.toHexString(buffer.get(readPos).toInt() and 0xFF)}")
             }
             return null
         }
-        if (buffer.size < totalLen) {
-            Log.i("MQTTClient", "QUICStreamReader: buffer.size=${buffer.size} < totalLen=$totalLen waiting for more")
+        if (buffered < totalLen) {
+            Log.i("MQTTClient", "QUICStreamReader: buffered=$buffered < totalLen=$totalLen waiting for more")
             return null
         }
         val packet = consume(totalLen)
@@ -62,36 +90,87 @@ class QUICStreamReader(private val stream: QuicStream) : MQTTStreamReader {
     }
 
     override suspend fun read(maxBytes: Int): ByteArray {
-        while (buffer.size < maxBytes) {
-            val chunk = stream.read(maxBytes - buffer.size)
-            if (chunk.isEmpty()) break
-            Log.i("MQTTClient", "QUICStreamReader: got chunk=${chunk.size} bufferSize=${buffer.size + chunk.size}")
-            buffer.addAll(chunk.toList())
+        while (buffered < maxBytes) {
+            ensureWritable(maxBytes - buffered)
+            val dst = buffer.duplicate()
+            dst.limit(dst.position() + (maxBytes - buffered))
+            val n = stream.readInto(dst)
+            if (n <= 0) break
+            buffer.position(dst.position())
+            Log.i("MQTTClient", "QUICStreamReader: got chunk=$n bufferSize=$buffered")
         }
-        val n = minOf(maxBytes, buffer.size)
+        val n = minOf(maxBytes, buffered)
         if (n == 0) return ByteArray(0)
-        val result = buffer.subList(0, n).toByteArray()
-        repeat(n) { buffer.removeAt(0) }
-        Log.i("MQTTClient", "QUICStreamReader: returning $n bytes bufferRemain=${buffer.size}")
+        val result = consume(n)
+        Log.i("MQTTClient", "QUICStreamReader: returning $n bytes bufferRemain=$buffered")
         return result
     }
 
     override suspend fun readexactly(n: Int): ByteArray {
-        Log.i("MQTTClient", "QUICStreamReader: readexactly($n) bufferHas=${buffer.size}")
-        val acc = mutableListOf<Byte>()
-        while (acc.size < n) {
-            drain()
-            val fromBuffer = minOf(n - acc.size, buffer.size)
-            if (fromBuffer > 0) {
-                acc.addAll(buffer.subList(0, fromBuffer).toList())
-                repeat(fromBuffer) { buffer.removeAt(0) }
-            } else {
-                // No data yet (e.g. message loop waiting for SUBACK/PUBLISH). Wait and retry instead of throwing.
-                delay(20L)
+        Log.i("MQTTClient", "QUICStreamReader: readexactly($n) bufferHas=$buffered")
+        while (buffered < n) {
+            ensureWritable(maxOf(READ_CHUNK, n - buffered))
+            // No data yet (e.g. message loop waiting for SUBACK/PUBLISH): park until the native
+            // receive callback signals. Bounded waits keep coroutine cancellation responsive.
+            if (stream.readInto(buffer, WAIT_SLICE_MS) > 0) {
+                drain()
             }
         }
         Log.i("MQTTClient", "QUICStreamReader: readexactly($n) done")
-        return acc.toByteArray()
+        return consume(n)
+    }
+
+    /**
+     * One whole MQTT packet. On a natively framed stream this is a single call per packet;
+     * bytes already pulled into this reader's buffer are framed here first.
+     */
+    override suspend fun readPacket(): ByteArray {
+        val framed = stream as? MqttPacketStream
+        if (framed == null || !framed.framesMqttPackets || buffered > 0) {
+            return super.readPacket()
+        }
+        while (true) {
+            framed.readPacket(WAIT_SLICE_MS)?.let { return it }
+        }
+    }
+
+    /** Total length of the packet at the head of the buffer from its fixed header, or null if the header is incomplete. */
+    private fun nextPacketLength(): Int? {
+        if (buffered < 2) return null
+        var mul = 1
+        var rem = 0
+        for (i in 1..4) {
+            if (i >= buffered) return null
+            val b = buffer.get(readPos + i).toInt() and 0xFF
+            rem += (b and 0x7F) * mul
+            if ((b and 0x80) == 0) return 1 + i + rem
+            mul *= 128
+        }
+        throw IllegalArgumentException("Invalid remaining length (max 4 bytes)")
+    }
+
+    /** Make room for at least [min] more bytes: compact consumed space first, grow only if still short. */
+    private fun ensureWritable(min: Int) {
+        if (buffer.remaining() >= min) return
+        if (readPos > 0) {
+            buffer.limit(buffer.position())
+            buffer.position(readPos)
+            buffer.compact()
+            readPos = 0
+            if (buffer.remaining() >= min) return
+        }
+        var capacity = buffer.capacity()
+        while (capacity - buffer.position() < min) capacity *= 2
+        val grown = ByteBuffer.allocateDirect(capacity)
+        buffer.flip()
+        grown.put(buffer)
+        buffer = grown
+    }
+
+    private companion object {
+        const val INITIAL_CAPACITY = 16 * 1024
+        const val READ_CHUNK = 8192
+        const val WAIT_SLICE_MS = 250L
     }
 }
 
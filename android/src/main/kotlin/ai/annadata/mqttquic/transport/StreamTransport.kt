@@ -11,6 +11,28 @@ interface MQTTStreamReader {
     suspend fun available(): Int
     suspend fun read(maxBytes: Int): ByteArray
     suspend fun readexactly(n: Int): ByteArray
+
+    /**
+     * Read one whole MQTT control packet (fixed header + body). The default frames it
+     * byte by byte via [readexactly]; readers over a natively framed stream return it
+     * in one call.
+     */
+    suspend fun readPacket(): ByteArray {
+        val header = ByteArray(5)
+        header[0] = readexactly(1)[0]
+        var len = 1
+        var remaining = 0
+        var mul = 1
+        while (true) {
+            if (len == header.size) throw IllegalArgumentException("Invalid remaining length (max 4 bytes)")
+            val b = readexactly(1)[0]
+            header[len++] = b
+            remaining += (b.toInt() and 0x7F) * mul
+            if ((b.toInt() and 0x80) == 0) break
+            mul *= 128
+        }
+        return header.copyOf(len) + readexactly(remaining)
+    }
 }
 
 /**
@@ -0,0 +1,61 @@
+//
+// ca_load_bench.cpp
+// Time to load a CA bundle into a fresh WOLFSSL_CTX as PEM and as the
+// build-ca-store.py blob made from it: what the first connect of an app
+// launch pays before the handshake starts.
+//
+//   ./build-ca-store.py bundle.pem -o bundle.bin
+//   ca_load_bench bundle.pem bundle.bin [iterations]
+//
+
+#include "ngtcp2_jni.cpp"
+
+namespace {
+
+// Milliseconds per load, median over the iterations; -1 if a load failed.
+template <typename Load>
+double median_ms(int iterations, Load load) {
+  std::vector<double> ms;
+  for (int i = 0; i < iterations; i++) {
+    WOLFSSL_CTX *ctx = wolfSSL_CTX_new(wolfTLS_client_method());
+    auto start = std::chrono::steady_clock::now();
+    bool ok = load(ctx);
+    ms.push_back(std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - start).count());
+    wolfSSL_CTX_free(ctx);
+    if (!ok) {
+      return -1;
+    }
+  }
+  std::sort(ms.begin(), ms.end());
+  return ms[ms.size() / 2];
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s bundle.pem bundle.bin [iterations]\n", argv[0]);
+    return 2;
+  }
+  const char *pem = argv[1];
+  const char *blob = argv[2];
+  int iterations = argc > 3 ? atoi(argv[3]) : 21;
+  wolfSSL_Init();
+
+  int anchors = 0;
+  double pem_ms = median_ms(iterations, [&](WOLFSSL_CTX *ctx) {
+    return wolfSSL_CTX_load_verify_locations(ctx, pem, nullptr) == WOLFSSL_SUCCESS;
+  });
+  double blob_ms = median_ms(iterations, [&](WOLFSSL_CTX *ctx) {
+    anchors = load_ca_blob(ctx, blob);
+    return anchors > 0;
+  });
+  if (pem_ms < 0 || blob_ms < 0) {
+    fprintf(stderr, "could not load %s\n", pem_ms < 0 ? pem : blob);
+    return 1;
+  }
+  printf("%d anchors, median of %d loads\n", anchors, iterations);
+  printf("%-6s %10.2f ms\n%-6s %10.2f ms\n", "pem", pem_ms, "blob", blob_ms);
+  return 0;
+}
@@ -0,0 +1,126 @@
+//
+// cc_bench.cpp
+// Upload goodput of each congestion controller (set_cc_algo) through the
+// loopback server, on a clean path and under emulated loss and delay.
+// Each run uploads for a fixed time; goodput is what the server's stream
+// handler received, so retransmissions do not count.
+//
+//   cc_bench [seconds] [loss_percent] [delay_ms]
+//
+
+#include "ngtcp2_jni.cpp"
+
+#include "loopback_server.h"
+
+namespace {
+
+using mqttquic_test::Impairment;
+using mqttquic_test::LoopbackServer;
+
+// Cap on what write_stream may queue ahead of the network, as in send_bench.
+constexpr uint64_t kMaxQueued = 4 * 1024 * 1024;
+constexpr size_t kWriteSize = 64 * 1024;
+
+struct Algo {
+  const char *name;
+  ngtcp2_cc_algo algo;
+};
+
+const Algo kAlgos[] = {
+    {"cubic", NGTCP2_CC_ALGO_CUBIC},
+    {"reno", NGTCP2_CC_ALGO_RENO},
+    {"bbr", NGTCP2_CC_ALGO_BBR},
+};
+
+std::string cert_path(const char *name) {
+  return std::string(TEST_CERT_DIR) + "/" + name;
+}
+
+struct Result {
+  double goodput_mb_per_s;
+  // Packets sent per MB delivered: retransmissions and probes push it up.
+  double pkts_per_mb;
+};
+
+bool run(ngtcp2_cc_algo algo, Impairment impairment, int seconds,
+         Result *out) {
+  LoopbackServer server(cert_path("server.pem"), cert_path("server-key.pem"));
+  std::atomic<uint64_t> received{0};
+  server.set_stream_handler(
+      [&](int64_t stream_id, const uint8_t *data, size_t len, bool fin) {
+        received.fetch_add(len, std::memory_order_relaxed);
+      });
+  server.set_impairment(impairment);
+  if (!server.start()) {
+    fprintf(stderr, "server: %s\n", server.error().c_str());
+    return false;
+  }
+
+  QuicClient client("localhost", "127.0.0.1", server.port());
+  client.set_cc_algo(algo);
+  int64_t stream_id;
+  if (client.connect("mqtt") != 0 || (stream_id = client.open_stream()) < 0) {
+    fprintf(stderr, "client: %s\n", client.last_error());
+    return false;
+  }
+
+  std::vector<uint8_t> chunk(kWriteSize, 0x5a);
+  ClientStats before = client.stats();
+  uint64_t received_before = received.load();
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + std::chrono::seconds(seconds);
+  uint64_t queued = 0;
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (client.stats().stream_bytes_sent + kMaxQueued <
+        before.stream_bytes_sent + queued) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      continue;
+    }
+    if (client.write_stream(stream_id, chunk.data(), chunk.size(), false) !=
+        0) {
+      fprintf(stderr, "client: %s\n", client.last_error());
+      return false;
+    }
+    queued += chunk.size();
+  }
+  double secs = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+  uint64_t delivered = received.load() - received_before;
+  ClientStats after = client.stats();
+  client.close();
+  server.stop();
+
+  double mb = (double)delivered / (1024 * 1024);
+  out->goodput_mb_per_s = mb / secs;
+  out->pkts_per_mb =
+      mb > 0 ? (double)(after.send_packets - before.send_packets) / mb : 0;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int seconds = argc > 1 ? atoi(argv[1]) : 10;
+  Impairment impaired;
+  impaired.loss = (argc > 2 ? atof(argv[2]) : 1.0) / 100;
+  impaired.delay_ms = (uint64_t)(argc > 3 ? atoi(argv[3]) : 20);
+  setenv("MQTT_QUIC_CA_FILE", cert_path("ca.pem").c_str(), 1);
+
+  char impaired_label[32];
+  snprintf(impaired_label, sizeof(impaired_label), "%.1f%%/%llums",
+           impaired.loss * 100, (unsigned long long)impaired.delay_ms);
+  printf("%d s per run, upload goodput\n", seconds);
+  printf("%-8s %-12s %10s %12s\n", "cc", "loss/delay", "MB/s", "pkts/MB");
+  for (const Algo &a : kAlgos) {
+    for (bool impair : {false, true}) {
+      Result r;
+      if (!run(a.algo, impair ? impaired : Impairment(), seconds, &r)) {
+        return 1;
+      }
+      printf("%-8s %-12s %10.2f %12.1f\n", a.name,
+             impair ? impaired_label : "clean", r.goodput_mb_per_s,
+             r.pkts_per_mb);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,203 @@
+//
+// conn_scale_bench.cpp
+// Client CPU, threads and RSS with 1, 100 and 1000 connections to the
+// loopback server, thread-per-connection against the shared epoll reactor
+// (Reactor::set_threads), with the connections idle or each sending a
+// small record every interval_ms. Every configuration runs in its own
+// forked process so its CPU and RSS are its alone (the reactor is also
+// process-wide and cannot be turned off again), and the server runs in
+// another so its per-connection state is not counted.
+//
+//   conn_scale_bench [seconds] [reactor_threads] [interval_ms]
+//
+
+#include "ngtcp2_jni.cpp"
+
+#include "loopback_server.h"
+
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+namespace {
+
+using mqttquic_test::LoopbackServer;
+
+constexpr size_t kRecordSize = 64;
+
+std::string cert_path(const char *name) {
+  return std::string(TEST_CERT_DIR) + "/" + name;
+}
+
+double process_cpu_seconds() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+         (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+// A "Name:   value" line of /proc/self/status, or -1.
+long proc_status(const char *name) {
+  FILE *f = fopen("/proc/self/status", "r");
+  if (!f) {
+    return -1;
+  }
+  char line[256];
+  long value = -1;
+  size_t name_len = strlen(name);
+  while (fgets(line, sizeof(line), f)) {
+    if (strncmp(line, name, name_len) == 0 && line[name_len] == ':') {
+      value = atol(line + name_len + 1);
+      break;
+    }
+  }
+  fclose(f);
+  return value;
+}
+
+// The server in a child process, which reports its port and then serves
+// until it is killed (or this process dies).
+pid_t fork_server(uint16_t *port) {
+  int port_pipe[2];
+  if (pipe(port_pipe) != 0) {
+    return -1;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    LoopbackServer server(cert_path("server.pem"), cert_path("server-key.pem"));
+    uint16_t p = 0;
+    if (server.start()) {
+      p = server.port();
+    } else {
+      fprintf(stderr, "server: %s\n", server.error().c_str());
+    }
+    (void)!write(port_pipe[1], &p, sizeof(p));
+    while (p != 0) {
+      pause();
+    }
+    _exit(1);
+  }
+  close(port_pipe[1]);
+  bool ok = pid > 0 &&
+            read(port_pipe[0], port, sizeof(*port)) == sizeof(*port) &&
+            *port != 0;
+  close(port_pipe[0]);
+  return ok ? pid : -1;
+}
+
+struct Config {
+  bool reactor;
+  bool active;
+  int connections;
+};
+
+// Runs in a forked child; prints one result row.
+int measure(const Config &cfg, uint16_t port, int seconds,
+            int reactor_threads, int interval_ms) {
+  if (cfg.reactor && Reactor::set_threads((size_t)reactor_threads) != 0) {
+    fprintf(stderr, "could not start %d reactor loops\n", reactor_threads);
+    return 1;
+  }
+  long rss_before = proc_status("VmRSS");
+  std::vector<std::unique_ptr<QuicClient>> clients;
+  std::vector<int64_t> streams;
+  auto connect_start = std::chrono::steady_clock::now();
+  for (int i = 0; i < cfg.connections; i++) {
+    clients.emplace_back(new QuicClient("localhost", "127.0.0.1", port));
+    QuicClient &client = *clients.back();
+    int64_t stream_id;
+    if (client.connect("mqtt") != 0 || (stream_id = client.open_stream()) < 0) {
+      fprintf(stderr, "connection %d: %s\n", i, client.last_error());
+      return 1;
+    }
+    streams.push_back(stream_id);
+  }
+  double connect_secs = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - connect_start)
+                            .count();
+
+  std::vector<uint8_t> record(kRecordSize, 0x5a);
+  double cpu_before = process_cpu_seconds();
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + std::chrono::seconds(seconds);
+  auto next = start;
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (cfg.active) {
+      for (size_t i = 0; i < clients.size(); i++) {
+        clients[i]->write_stream(streams[i], record.data(), record.size(),
+                                 false);
+      }
+    }
+    next += std::chrono::milliseconds(interval_ms);
+    std::this_thread::sleep_until(std::min(next, deadline));
+  }
+  double secs = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+  double cpu = process_cpu_seconds() - cpu_before;
+  long rss_after = proc_status("VmRSS");
+  long threads = proc_status("Threads");
+
+  for (auto &client : clients) {
+    client->close();
+  }
+  double rss_mb = (double)(rss_after - rss_before) / 1024;
+  printf("%-8s %-7s %6d %10.2f %8ld %10.1f %10.1f %10.2f\n",
+         cfg.reactor ? "reactor" : "threads", cfg.active ? "active" : "idle",
+         cfg.connections, connect_secs, threads, rss_mb,
+         rss_mb * 1024 / cfg.connections, cpu * 100 / secs);
+  fflush(stdout);
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int seconds = argc > 1 ? atoi(argv[1]) : 10;
+  int reactor_threads = argc > 2 ? atoi(argv[2]) : 2;
+  int interval_ms = std::max(argc > 3 ? atoi(argv[3]) : 100, 1);
+  setenv("MQTT_QUIC_CA_FILE", cert_path("ca.pem").c_str(), 1);
+
+  // Thread-per-connection needs two fds per connection.
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+
+  uint16_t port;
+  pid_t server = fork_server(&port);
+  if (server < 0) {
+    fprintf(stderr, "could not start the server process\n");
+    return 1;
+  }
+
+  printf("%d s per run, %d reactor loops, active connections send %zu B "
+         "every %d ms\n",
+         seconds, reactor_threads, kRecordSize, interval_ms);
+  printf("%-8s %-7s %6s %10s %8s %10s %10s %10s\n", "mode", "load", "conns",
+         "connect s", "threads", "RSS MB", "KB/conn", "CPU %");
+  // Or the children would inherit and print it again.
+  fflush(stdout);
+  int failures = 0;
+  for (bool active : {false, true}) {
+    for (bool reactor : {false, true}) {
+      for (int n : {1, 100, 1000}) {
+        Config cfg{reactor, active, n};
+        pid_t pid = fork();
+        if (pid == 0) {
+          _exit(measure(cfg, port, seconds, reactor_threads, interval_ms));
+        }
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) != pid ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+          failures++;
+        }
+      }
+    }
+  }
+  kill(server, SIGTERM);
+  waitpid(server, nullptr, 0);
+  return failures == 0 ? 0 : 1;
+}
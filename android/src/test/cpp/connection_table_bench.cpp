@@ -0,0 +1,111 @@
+//
+// connection_table_bench.cpp
+// Handle lookups from many threads at once, as every JNI call does: the
+// sharded ConnectionTable against the single mutex-guarded map it replaced.
+// Prints total lookups per second per thread count.
+//
+//   connection_table_bench [connections] [lookups_per_thread]
+//
+
+#include "connection_table.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using mqttquic::ConnectionTable;
+
+namespace {
+
+struct Connection {
+  int id;
+};
+
+// The table before sharding: one map, one lock for every lookup.
+class GlobalMapTable {
+ public:
+  int64_t insert(std::shared_ptr<Connection> c) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t h = next_++;
+    map_[h] = std::move(c);
+    return h;
+  }
+
+  std::shared_ptr<Connection> find(int64_t handle) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = map_.find(handle);
+    return it == map_.end() ? nullptr : it->second;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::map<int64_t, std::shared_ptr<Connection>> map_;
+  int64_t next_ = 1;
+};
+
+// Each thread looks up its own slice of the handles round-robin, holding
+// the result as briefly as a JNI call would.
+template <typename Table>
+double lookups_per_sec(Table &table, const std::vector<int64_t> &handles,
+                       int threads, int lookups) {
+  std::vector<std::thread> workers;
+  std::atomic<int64_t> sink{0};
+  auto start = std::chrono::steady_clock::now();
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&, t]() {
+      int64_t sum = 0;
+      size_t i = (size_t)t * 7919;
+      for (int n = 0; n < lookups; n++) {
+        auto c = table.find(handles[i++ % handles.size()]);
+        sum += c ? c->id : -1;
+      }
+      sink += sum;
+    });
+  }
+  for (auto &w : workers) {
+    w.join();
+  }
+  double secs = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+  return (double)threads * lookups / secs;
+}
+
+template <typename Table>
+std::vector<int64_t> fill(Table &table, int connections) {
+  std::vector<int64_t> handles;
+  for (int i = 0; i < connections; i++) {
+    handles.push_back(table.insert(std::make_shared<Connection>(Connection{i})));
+  }
+  return handles;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int connections = argc > 1 ? atoi(argv[1]) : 100;
+  int lookups = argc > 2 ? atoi(argv[2]) : 2000000;
+
+  ConnectionTable<Connection> sharded;
+  GlobalMapTable global;
+  std::vector<int64_t> sharded_handles = fill(sharded, connections);
+  std::vector<int64_t> global_handles = fill(global, connections);
+
+  printf("%d connections, %d lookups per thread (M lookups/s)\n", connections,
+         lookups);
+  printf("%-8s %12s %12s\n", "threads", "sharded", "global lock");
+  unsigned hw = std::thread::hardware_concurrency();
+  for (int threads : {1, 2, 4, 8, 16}) {
+    if (threads > 1 && (unsigned)threads > 2 * hw) {
+      break;
+    }
+    double s = lookups_per_sec(sharded, sharded_handles, threads, lookups);
+    double g = lookups_per_sec(global, global_handles, threads, lookups);
+    printf("%-8d %12.1f %12.1f\n", threads, s / 1e6, g / 1e6);
+  }
+  return 0;
+}
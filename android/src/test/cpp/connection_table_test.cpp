@@ -0,0 +1,139 @@
+//
+// connection_table_test.cpp
+// Unit tests for the JNI handle table in connection_table.h.
+//
+
+#include "connection_table.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
+using mqttquic::ConnectionTable;
+
+namespace {
+
+// Enough inserts that every shard hands out more than one slot.
+constexpr int kMany = 200;
+
+}  // namespace
+
+TEST(ConnectionTableTest, FindsWhatWasInserted) {
+  ConnectionTable<int> table;
+  std::vector<int64_t> handles;
+  for (int i = 0; i < kMany; i++) {
+    handles.push_back(table.insert(std::make_shared<int>(i)));
+  }
+  std::set<int64_t> distinct(handles.begin(), handles.end());
+  EXPECT_EQ(distinct.size(), handles.size());
+  for (int i = 0; i < kMany; i++) {
+    ASSERT_NE(handles[i], 0);
+    auto entry = table.find(handles[i]);
+    ASSERT_TRUE(entry);
+    EXPECT_EQ(*entry, i);
+  }
+}
+
+TEST(ConnectionTableTest, RemoveHandsOverTheEntryOnce) {
+  ConnectionTable<int> table;
+  int64_t h = table.insert(std::make_shared<int>(7));
+  auto entry = table.remove(h);
+  ASSERT_TRUE(entry);
+  EXPECT_EQ(*entry, 7);
+  EXPECT_FALSE(table.find(h));
+  EXPECT_FALSE(table.remove(h));
+}
+
+TEST(ConnectionTableTest, EntryOutlivesRemoveWhileReferenced) {
+  ConnectionTable<int> table;
+  int64_t h = table.insert(std::make_shared<int>(1));
+  auto held = table.find(h);
+  std::weak_ptr<int> watch = held;
+  table.remove(h);
+  EXPECT_FALSE(watch.expired());
+  held.reset();
+  EXPECT_TRUE(watch.expired());
+}
+
+// A removed slot is reused under a new generation: the old handle must not
+// resolve to the new entry, and no handle is ever 0.
+TEST(ConnectionTableTest, StaleHandleAfterSlotReuse) {
+  ConnectionTable<int> table;
+  std::vector<int64_t> old_handles;
+  for (int i = 0; i < kMany; i++) {
+    old_handles.push_back(table.insert(std::make_shared<int>(i)));
+  }
+  for (int64_t h : old_handles) {
+    ASSERT_TRUE(table.remove(h));
+  }
+  std::vector<int64_t> new_handles;
+  for (int i = 0; i < kMany; i++) {
+    new_handles.push_back(table.insert(std::make_shared<int>(1000 + i)));
+  }
+  std::set<int64_t> old_set(old_handles.begin(), old_handles.end());
+  for (int i = 0; i < kMany; i++) {
+    EXPECT_NE(new_handles[i], 0);
+    EXPECT_EQ(old_set.count(new_handles[i]), 0u);
+    EXPECT_FALSE(table.find(old_handles[i]));
+    EXPECT_FALSE(table.remove(old_handles[i]));
+    auto entry = table.find(new_handles[i]);
+    ASSERT_TRUE(entry);
+    EXPECT_EQ(*entry, 1000 + i);
+  }
+}
+
+TEST(ConnectionTableTest, RepeatedReuseOfOneSlot) {
+  ConnectionTable<int> table;
+  std::set<int64_t> seen;
+  // One shard in 16 gets each insert; 16 * 50 inserts reuse every shard's
+  // first slot 50 times.
+  for (int i = 0; i < 16 * 50; i++) {
+    int64_t h = table.insert(std::make_shared<int>(i));
+    ASSERT_NE(h, 0);
+    EXPECT_TRUE(seen.insert(h).second) << "handle reused: " << h;
+    ASSERT_TRUE(table.remove(h));
+  }
+  for (int64_t h : seen) {
+    EXPECT_FALSE(table.find(h));
+  }
+}
+
+TEST(ConnectionTableTest, GarbageHandlesResolveToNothing) {
+  ConnectionTable<int> table;
+  int64_t h = table.insert(std::make_shared<int>(1));
+  for (int64_t bad : {int64_t{0}, int64_t{-1}, h + 16, h ^ (int64_t{1} << 40),
+                      INT64_MAX, INT64_MIN}) {
+    EXPECT_FALSE(table.find(bad)) << bad;
+    EXPECT_FALSE(table.remove(bad)) << bad;
+  }
+  EXPECT_TRUE(table.find(h));
+}
+
+TEST(ConnectionTableTest, ConcurrentInsertFindRemove) {
+  ConnectionTable<int> table;
+  std::atomic<int> errors{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < 2000; i++) {
+        int value = t * 100000 + i;
+        int64_t h = table.insert(std::make_shared<int>(value));
+        auto found = table.find(h);
+        if (!found || *found != value) {
+          errors++;
+        }
+        auto removed = table.remove(h);
+        if (!removed || *removed != value || table.find(h)) {
+          errors++;
+        }
+      }
+    });
+  }
+  for (auto &th : threads) {
+    th.join();
+  }
+  EXPECT_EQ(errors.load(), 0);
+}
@@ -0,0 +1,198 @@
+//
+// datagram_bench.cpp
+// QoS 0 tail latency under loss: timestamped PUBLISH packets on a fixed
+// cadence go to the loopback server once on the stream and once as QUIC
+// DATAGRAM frames (set_datagrams / write_datagram), through emulated loss
+// and delay. On the stream a lost packet holds back everything behind it
+// until it is retransmitted; a lost datagram is simply gone. Prints the
+// share delivered and p50/p99/p99.9/max delivery delay for each.
+//
+//   datagram_bench [seconds] [loss_percent] [delay_ms] [interval_ms]
+//
+
+#include "ngtcp2_jni.cpp"
+
+#include "loopback_server.h"
+
+namespace {
+
+using mqttquic_test::Impairment;
+using mqttquic_test::LoopbackServer;
+
+const char *const kTopic = "sensors/vibration";
+// Timestamp plus padding, a typical telemetry sample.
+constexpr size_t kPayload = 128;
+
+std::string cert_path(const char *name) {
+  return std::string(TEST_CERT_DIR) + "/" + name;
+}
+
+// QoS 0 PUBLISH.
+std::vector<uint8_t> build_publish(const std::string &topic,
+                                   const uint8_t *payload, size_t len) {
+  size_t remaining = 2 + topic.size() + len;
+  std::vector<uint8_t> out;
+  out.reserve(remaining + 5);
+  out.push_back(0x30);
+  do {
+    uint8_t b = remaining & 0x7f;
+    remaining >>= 7;
+    out.push_back(remaining ? (b | 0x80) : b);
+  } while (remaining);
+  out.push_back((uint8_t)(topic.size() >> 8));
+  out.push_back((uint8_t)topic.size());
+  out.insert(out.end(), topic.begin(), topic.end());
+  out.insert(out.end(), payload, payload + len);
+  return out;
+}
+
+// Records each PUBLISH's delay, from either path, on the server thread.
+class DelaySink {
+ public:
+  void on_stream(const uint8_t *data, size_t len) {
+    framer_.feed(data, len);
+    std::vector<uint8_t> packet;
+    while (framer_.pop(packet)) {
+      on_packet(packet.data(), packet.size());
+    }
+  }
+
+  void on_packet(const uint8_t *packet, size_t len) {
+    uint64_t arrived = now_ts();
+    size_t off = 1;
+    while (off < len && (packet[off++] & 0x80)) {
+    }
+    if (off + 2 > len) {
+      return;
+    }
+    size_t topic_len = ((size_t)packet[off] << 8) | packet[off + 1];
+    off += 2 + topic_len;
+    if (off + 8 > len) {
+      return;
+    }
+    uint64_t sent;
+    memcpy(&sent, packet + off, 8);
+    std::lock_guard<std::mutex> lock(mutex_);
+    delays_ns_.push_back(arrived - sent);
+  }
+
+  std::vector<uint64_t> delays() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return delays_ns_;
+  }
+
+ private:
+  MqttFramer framer_;  // server thread only
+  std::mutex mutex_;
+  std::vector<uint64_t> delays_ns_;
+};
+
+struct Result {
+  size_t sent;
+  size_t delivered;
+  double p50_ms;
+  double p99_ms;
+  double p999_ms;
+  double max_ms;
+};
+
+bool run(bool datagrams, int seconds, int interval_ms, Impairment impairment,
+         Result *out) {
+  LoopbackServer server(cert_path("server.pem"), cert_path("server-key.pem"));
+  DelaySink sink;
+  server.set_stream_handler(
+      [&](int64_t stream_id, const uint8_t *data, size_t len, bool fin) {
+        sink.on_stream(data, len);
+      });
+  server.set_datagram_handler(
+      [&](const uint8_t *data, size_t len) { sink.on_packet(data, len); });
+  server.set_impairment(impairment);
+  if (!server.start()) {
+    fprintf(stderr, "server: %s\n", server.error().c_str());
+    return false;
+  }
+
+  QuicClient client("localhost", "127.0.0.1", server.port());
+  client.set_datagrams(datagrams);
+  int64_t stream_id;
+  if (client.connect("mqtt") != 0 || (stream_id = client.open_stream()) < 0) {
+    fprintf(stderr, "client: %s\n", client.last_error());
+    return false;
+  }
+
+  uint8_t payload[kPayload] = {};
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+  size_t sent = 0;
+  size_t fell_back = 0;
+  while (std::chrono::steady_clock::now() < deadline) {
+    uint64_t ts = now_ts();
+    memcpy(payload, &ts, sizeof(ts));
+    std::vector<uint8_t> packet = build_publish(kTopic, payload, sizeof(payload));
+    // As MQTTClient does: the stream whenever a datagram cannot be sent.
+    if (!datagrams || client.write_datagram(packet.data(), packet.size()) != 0) {
+      fell_back += datagrams ? 1 : 0;
+      client.write_stream(stream_id, packet.data(), packet.size(), false);
+    }
+    sent++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+  }
+  if (fell_back > 0) {
+    fprintf(stderr, "%zu of %zu publishes fell back to the stream\n",
+            fell_back, sent);
+  }
+
+  // Stream data still in retransmission has time to arrive; lost
+  // datagrams never will.
+  std::vector<uint64_t> delays;
+  for (int i = 0; i < 50 && (delays = sink.delays()).size() < sent; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  client.close();
+  server.stop();
+  if (delays.empty()) {
+    fprintf(stderr, "nothing arrived\n");
+    return false;
+  }
+
+  std::sort(delays.begin(), delays.end());
+  auto ms = [&](double q) {
+    return (double)delays[(size_t)(q * (double)(delays.size() - 1))] /
+           NGTCP2_MILLISECONDS;
+  };
+  out->sent = sent;
+  out->delivered = delays.size();
+  out->p50_ms = ms(0.5);
+  out->p99_ms = ms(0.99);
+  out->p999_ms = ms(0.999);
+  out->max_ms = ms(1.0);
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int seconds = argc > 1 ? atoi(argv[1]) : 10;
+  Impairment impairment;
+  impairment.loss = (argc > 2 ? atof(argv[2]) : 2.0) / 100;
+  impairment.delay_ms = (uint64_t)(argc > 3 ? atoi(argv[3]) : 20);
+  int interval_ms = std::max(argc > 4 ? atoi(argv[4]) : 5, 1);
+  setenv("MQTT_QUIC_CA_FILE", cert_path("ca.pem").c_str(), 1);
+
+  printf("%.1f%% loss, %llu ms delay, a QoS 0 publish every %d ms for %d s\n",
+         impairment.loss * 100, (unsigned long long)impairment.delay_ms,
+         interval_ms, seconds);
+  printf("%-9s %11s %9s %9s %9s %9s\n", "path", "delivered", "p50 ms",
+         "p99 ms", "p99.9 ms", "max ms");
+  for (bool datagrams : {false, true}) {
+    Result r;
+    if (!run(datagrams, seconds, interval_ms, impairment, &r)) {
+      return 1;
+    }
+    printf("%-9s %10.1f%% %9.2f %9.2f %9.2f %9.2f\n",
+           datagrams ? "datagram" : "stream",
+           100.0 * (double)r.delivered / (double)r.sent, r.p50_ms, r.p99_ms,
+           r.p999_ms, r.max_ms);
+  }
+  return 0;
+}
@@ -0,0 +1,88 @@
+//
+// fake_jni.h
+// Just enough of a JNIEnv for benchmarks that call the JNI entry points in
+// ngtcp2_jni.cpp without a JVM: a byte[] is heap memory, a direct
+// ByteBuffer is a pointer and a capacity, and a global ref is the object
+// itself. Nothing here models JNI transitions or GC.
+//
+
+#pragma once
+
+#include <jni.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace mqttquic_test {
+
+struct FakeArray {
+  std::vector<jbyte> bytes;
+};
+
+struct FakeDirectBuffer {
+  uint8_t *base;
+  jlong capacity;
+};
+
+class FakeJni {
+ public:
+  FakeJni() {
+    memset(&fns_, 0, sizeof(fns_));
+    fns_.NewByteArray = [](JNIEnv *, jsize len) -> jbyteArray {
+      arrays_allocated_++;
+      return wrap(new FakeArray{std::vector<jbyte>((size_t)len)});
+    };
+    fns_.GetArrayLength = [](JNIEnv *, jarray a) -> jsize {
+      return (jsize)array(a)->bytes.size();
+    };
+    fns_.GetByteArrayRegion = [](JNIEnv *, jbyteArray a, jsize start,
+                                 jsize len, jbyte *buf) {
+      memcpy(buf, array(a)->bytes.data() + start, (size_t)len);
+    };
+    fns_.SetByteArrayRegion = [](JNIEnv *, jbyteArray a, jsize start,
+                                 jsize len, const jbyte *buf) {
+      memcpy(array(a)->bytes.data() + start, buf, (size_t)len);
+    };
+    // Only arrays from NewByteArray are ever passed here.
+    fns_.DeleteLocalRef = [](JNIEnv *, jobject o) { delete array(o); };
+    fns_.GetDirectBufferAddress = [](JNIEnv *, jobject o) -> void * {
+      return reinterpret_cast<FakeDirectBuffer *>(o)->base;
+    };
+    fns_.GetDirectBufferCapacity = [](JNIEnv *, jobject o) -> jlong {
+      return reinterpret_cast<FakeDirectBuffer *>(o)->capacity;
+    };
+    fns_.NewGlobalRef = [](JNIEnv *, jobject o) { return o; };
+    fns_.DeleteGlobalRef = [](JNIEnv *, jobject) {};
+    env_.functions = &fns_;
+  }
+
+  FakeJni(const FakeJni &) = delete;
+  FakeJni &operator=(const FakeJni &) = delete;
+
+  JNIEnv *env() { return &env_; }
+
+  static jbyteArray wrap(FakeArray *a) {
+    return reinterpret_cast<jbyteArray>(a);
+  }
+  static jobject wrap(FakeDirectBuffer *b) {
+    return reinterpret_cast<jobject>(b);
+  }
+
+  // byte[]s created through NewByteArray so far, process-wide.
+  static uint64_t arrays_allocated() { return arrays_allocated_.load(); }
+
+ private:
+  template <typename J>
+  static FakeArray *array(J a) {
+    return reinterpret_cast<FakeArray *>(a);
+  }
+
+  static inline std::atomic<uint64_t> arrays_allocated_{0};
+
+  JNINativeInterface_ fns_;
+  JNIEnv env_;
+};
+
+}  // namespace mqttquic_test
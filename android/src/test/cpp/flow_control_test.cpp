@@ -0,0 +1,145 @@
+//
+// flow_control_test.cpp
+// Receive flow control on framed streams against the loopback server: MQTT
+// packets several times larger than the stream and connection windows
+// must flow through without stalling, mixed with small ones, for long
+// enough that the windows are extended many times over.
+//
+
+#include "ngtcp2_jni.cpp"
+
+#include "loopback_server.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using mqttquic_test::LoopbackServer;
+
+// LOW_POWER-sized windows: a 64 KB stream window and 128 KB for the
+// connection.
+constexpr uint64_t kStreamWindow = 64 * 1024;
+constexpr uint64_t kConnWindow = 128 * 1024;
+
+// Cap on what the server queues ahead of the client's acks.
+constexpr uint64_t kMaxQueued = 8 * 1024 * 1024;
+
+std::string cert_path(const char *name) {
+  return std::string(TEST_CERT_DIR) + "/" + name;
+}
+
+// PUBLISH-typed packet of body_len bytes; the body encodes seq so the
+// reader can check each packet is intact and in order.
+std::vector<uint8_t> mqtt_packet(uint32_t seq, size_t body_len) {
+  std::vector<uint8_t> p{0x30};
+  size_t len = body_len;
+  do {
+    uint8_t b = len % 128;
+    len /= 128;
+    p.push_back(len > 0 ? (uint8_t)(b | 0x80) : b);
+  } while (len > 0);
+  size_t header = p.size();
+  p.resize(header + body_len);
+  for (size_t i = 0; i < body_len; i++) {
+    p[header + i] = (uint8_t)(seq * 31 + i);
+  }
+  return p;
+}
+
+bool intact(const std::vector<uint8_t> &p, uint32_t seq, size_t body_len) {
+  std::vector<uint8_t> want = mqtt_packet(seq, body_len);
+  return p == want;
+}
+
+class FlowControlTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(server_.start()) << server_.error();
+    setenv("MQTT_QUIC_CA_FILE", cert_path("ca.pem").c_str(), 1);
+    client_.reset(new QuicClient("localhost", "127.0.0.1", server_.port()));
+    TransportConfig config;
+    config.max_stream_data = kStreamWindow;
+    config.max_data = kConnWindow;
+    ASSERT_EQ(client_->set_transport_config(config), 0);
+    client_->set_mqtt_framing(true);
+    ASSERT_EQ(client_->connect("mqtt"), 0) << client_->last_error();
+    stream_id_ = client_->open_stream();
+    ASSERT_GE(stream_id_, 0) << client_->last_error();
+    // The server can only send on the stream once it has seen it.
+    uint8_t pingreq[] = {0xc0, 0x00};
+    ASSERT_EQ(client_->write_stream(stream_id_, pingreq, sizeof(pingreq), false), 0);
+  }
+
+  void TearDown() override {
+    if (client_) {
+      client_->close();
+    }
+    server_.stop();
+  }
+
+  // Server sends packets of the given body sizes, cycling, until total
+  // bytes are queued; the client reads them all back with read_packet.
+  void transfer(const std::vector<size_t> &sizes, uint64_t total) {
+    std::atomic<bool> abort{false};
+    std::thread sender([&]() {
+      uint64_t queued = 0;
+      for (uint32_t seq = 0; queued < total && !abort; seq++) {
+        while (server_.stream_bytes_unacked() > kMaxQueued && !abort) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        size_t body = sizes[seq % sizes.size()];
+        std::vector<uint8_t> p = mqtt_packet(seq, body);
+        queued += p.size();
+        server_.send_stream(stream_id_, std::move(p));
+      }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t received = 0;
+    std::vector<uint8_t> packet;
+    for (uint32_t seq = 0; received < total; seq++) {
+      int rv = client_->read_packet(stream_id_, packet, 10 * NGTCP2_SECONDS);
+      if (rv != 1) {
+        abort = true;
+        sender.join();
+      }
+      ASSERT_EQ(rv, 1) << "stalled after " << received << " bytes, packet "
+                       << seq << " (" << client_->last_error() << ")";
+      if (!intact(packet, seq, sizes[seq % sizes.size()])) {
+        abort = true;
+        sender.join();
+        FAIL() << "packet " << seq << " corrupt, " << packet.size() << " bytes";
+      }
+      received += packet.size();
+    }
+    double secs = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start).count();
+    sender.join();
+    ClientStats st = client_->stats();
+    printf("%.1f MB in %.2f s (%.1f MB/s), %" PRIu64 " credit updates, "
+           "window %" PRIu64 " KB\n",
+           (double)received / (1024 * 1024), secs,
+           (double)received / (1024 * 1024) / secs, st.credit_updates,
+           st.recv_window / 1024);
+  }
+
+  LoopbackServer server_{cert_path("server.pem"), cert_path("server-key.pem")};
+  std::unique_ptr<QuicClient> client_;
+  int64_t stream_id_ = -1;
+};
+
+// One packet already larger than half the stream window stalled the stream
+// when only whole packets earned credit.
+TEST_F(FlowControlTest, PacketLargerThanWindow) {
+  transfer({4 * kStreamWindow}, 8 * kStreamWindow);
+}
+
+// Sizes around and far above both windows, with small packets between
+// them so partial packets start at varying offsets.
+TEST_F(FlowControlTest, MixedSizesLongRun) {
+  transfer({100, kStreamWindow / 2 + 1, 3000, kStreamWindow + 17, 16,
+            3 * kConnWindow + 5, kStreamWindow - 7, 1024 * 1024},
+           256ull * 1024 * 1024);
+}
+
+}  // namespace
@@ -0,0 +1,26 @@
+//
+// android/log.h for host builds of the native core: LOGE lines go to
+// stderr, LOGI lines only when MQTT_QUIC_TEST_LOG is set.
+//
+
+#pragma once
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+enum { ANDROID_LOG_INFO = 4, ANDROID_LOG_WARN = 5, ANDROID_LOG_ERROR = 6 };
+
+inline int __android_log_print(int prio, const char *tag, const char *fmt, ...) {
+  static const bool verbose = getenv("MQTT_QUIC_TEST_LOG") != nullptr;
+  if (prio < ANDROID_LOG_WARN && !verbose) {
+    return 0;
+  }
+  va_list ap;
+  va_start(ap, fmt);
+  fprintf(stderr, "%s: ", tag);
+  int n = vfprintf(stderr, fmt, ap);
+  fputc('\n', stderr);
+  va_end(ap);
+  return n;
+}
@@ -0,0 +1,157 @@
+//
+// jni_read_bench.cpp
+// The JNI read entry points, called as Kotlin would, draining data the
+// loopback server has already delivered: nativeReadStream (staging buffer,
+// new byte[] per call) against nativeReadStreamInto (straight into a
+// caller-owned direct buffer). There is no JVM here: FakeJni backs byte[]
+// with heap memory and direct buffers with plain memory, so this measures
+// the native side of each call (copies, allocations) but not the JNI
+// transition or GC cost, which only an on-device run shows.
+//
+//   jni_read_bench [total_mb]
+//
+
+#include "ngtcp2_jni.cpp"
+
+#include "fake_jni.h"
+#include "loopback_server.h"
+
+namespace {
+
+using mqttquic_test::FakeDirectBuffer;
+using mqttquic_test::FakeJni;
+using mqttquic_test::LoopbackServer;
+
+constexpr size_t kServerChunk = 1024 * 1024;
+
+std::string cert_path(const char *name) {
+  return std::string(TEST_CERT_DIR) + "/" + name;
+}
+
+struct Result {
+  double mb_per_s;
+  double ns_per_read;
+  uint64_t reads;
+  uint64_t arrays;
+};
+
+// Has the server send total bytes on stream_id and waits until the client
+// has acknowledged (so buffered) all of it.
+bool fill(LoopbackServer &server, int64_t stream_id, size_t total) {
+  for (size_t sent = 0; sent < total; sent += kServerChunk) {
+    server.send_stream(stream_id,
+                       std::vector<uint8_t>(std::min(kServerChunk,
+                                                     total - sent),
+                                            0x5a));
+  }
+  for (int i = 0; i < 30000 && server.stream_bytes_unacked() > 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return server.stream_bytes_unacked() == 0;
+}
+
+template <typename ReadOnce>
+bool drain(size_t total, ReadOnce read_once, Result *out) {
+  uint64_t arrays_before = FakeJni::arrays_allocated();
+  uint64_t reads = 0;
+  size_t got = 0;
+  auto start = std::chrono::steady_clock::now();
+  while (got < total) {
+    jint n = read_once();
+    if (n <= 0) {
+      fprintf(stderr, "read returned %d after %zu bytes\n", (int)n, got);
+      return false;
+    }
+    got += (size_t)n;
+    reads++;
+  }
+  double secs = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+  out->mb_per_s = (double)total / (1024 * 1024) / secs;
+  out->ns_per_read = secs * 1e9 / (double)reads;
+  out->reads = reads;
+  out->arrays = FakeJni::arrays_allocated() - arrays_before;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  size_t total = (size_t)(argc > 1 ? atoi(argv[1]) : 32) * 1024 * 1024;
+  setenv("MQTT_QUIC_CA_FILE", cert_path("ca.pem").c_str(), 1);
+
+  LoopbackServer server(cert_path("server.pem"), cert_path("server-key.pem"));
+  if (!server.start()) {
+    fprintf(stderr, "server: %s\n", server.error().c_str());
+    return 1;
+  }
+  auto client = std::make_shared<QuicClient>("localhost", "127.0.0.1",
+                                             server.port());
+  // Windows large enough that the whole run sits in the receive buffer.
+  TransportConfig config;
+  config.max_stream_data = total + kServerChunk;
+  config.max_data = total + kServerChunk;
+  int64_t stream_id;
+  uint8_t hello = 0;
+  if (client->set_transport_config(config) != 0 ||
+      client->connect("mqtt") != 0 ||
+      (stream_id = client->open_stream()) < 0 ||
+      client->write_stream(stream_id, &hello, 1, false) != 0) {
+    fprintf(stderr, "client: %s\n", client->last_error());
+    return 1;
+  }
+  jlong handle = connections.insert(client);
+
+  FakeJni jni;
+  JNIEnv *env = jni.env();
+  std::vector<uint8_t> direct_mem(64 * 1024);
+  FakeDirectBuffer direct{direct_mem.data(), (jlong)direct_mem.size()};
+  jobject direct_obj = FakeJni::wrap(&direct);
+
+  printf("%zu MB buffered per run\n", total / (1024 * 1024));
+  printf("%-22s %10s %10s %10s %10s\n", "read", "MB/s", "ns/read", "reads",
+         "byte[]s");
+  struct Variant {
+    const char *name;
+    std::function<jint()> read_once;
+  };
+  std::vector<Variant> variants = {
+      {"byte[] (8 KB staging)",
+       [&]() -> jint {
+         jbyteArray a = Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeReadStream(
+             env, nullptr, handle, stream_id);
+         jint n = a ? env->GetArrayLength(a) : -1;
+         if (a) {
+           env->DeleteLocalRef(a);
+         }
+         return n;
+       }},
+      {"direct, 8 KB",
+       [&]() -> jint {
+         return Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeReadStreamInto(
+             env, nullptr, handle, stream_id, direct_obj, 0, 8 * 1024);
+       }},
+      {"direct, 64 KB",
+       [&]() -> jint {
+         return Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeReadStreamInto(
+             env, nullptr, handle, stream_id, direct_obj, 0, 64 * 1024);
+       }},
+  };
+  for (const Variant &v : variants) {
+    Result r;
+    if (!fill(server, stream_id, total)) {
+      fprintf(stderr, "server data was not acknowledged\n");
+      return 1;
+    }
+    if (!drain(total, v.read_once, &r)) {
+      return 1;
+    }
+    printf("%-22s %10.1f %10.1f %10" PRIu64 " %10" PRIu64 "\n", v.name,
+           r.mb_per_s, r.ns_per_read, r.reads, r.arrays);
+  }
+
+  connections.remove(handle);
+  client->close();
+  server.stop();
+  return 0;
+}
@@ -0,0 +1,174 @@
+//
+// jni_write_bench.cpp
+// Publish-sized writes through the JNI write entry points to the loopback
+// server, at 64 B, 1 KB and 64 KB: nativeWriteStream (byte[], copied once
+// into the send buffer), nativeWriteStreamDirect (direct buffer, borrowed
+// until acked), and the old path's two copies (staging vector, then
+// write_stream copying again) for reference. Prints MB/s, writes per
+// second and client CPU per MB. FakeJni stands in for the JVM, so JNI
+// transition and GC cost are not included.
+//
+//   jni_write_bench [seconds]
+//
+
+#include "ngtcp2_jni.cpp"
+
+#include "fake_jni.h"
+#include "loopback_server.h"
+
+#include <sys/resource.h>
+
+namespace {
+
+using mqttquic_test::FakeArray;
+using mqttquic_test::FakeDirectBuffer;
+using mqttquic_test::FakeJni;
+using mqttquic_test::LoopbackServer;
+
+// Cap on what may be queued ahead of the network, as in send_bench.
+constexpr uint64_t kMaxQueued = 4 * 1024 * 1024;
+
+std::string cert_path(const char *name) {
+  return std::string(TEST_CERT_DIR) + "/" + name;
+}
+
+double process_cpu_seconds() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+         (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+enum class WritePath { kTwoCopies, kByteArray, kDirect };
+
+const char *path_name(WritePath path) {
+  switch (path) {
+  case WritePath::kTwoCopies:
+    return "two copies (old)";
+  case WritePath::kByteArray:
+    return "byte[]";
+  case WritePath::kDirect:
+    return "direct";
+  }
+  return "?";
+}
+
+struct Result {
+  double mb_per_s;
+  double writes_per_s;
+  double cpu_ms_per_mb;
+};
+
+bool run(WritePath path, size_t payload, int seconds, Result *out) {
+  LoopbackServer server(cert_path("server.pem"), cert_path("server-key.pem"));
+  std::atomic<uint64_t> received{0};
+  server.set_stream_handler(
+      [&](int64_t stream_id, const uint8_t *data, size_t len, bool fin) {
+        received.fetch_add(len, std::memory_order_relaxed);
+      });
+  if (!server.start()) {
+    fprintf(stderr, "server: %s\n", server.error().c_str());
+    return false;
+  }
+  auto client = std::make_shared<QuicClient>("localhost", "127.0.0.1",
+                                             server.port());
+  int64_t stream_id;
+  if (client->connect("mqtt") != 0 ||
+      (stream_id = client->open_stream()) < 0) {
+    fprintf(stderr, "client: %s\n", client->last_error());
+    return false;
+  }
+  jlong handle = connections.insert(client);
+
+  FakeJni jni;
+  JNIEnv *env = jni.env();
+  FakeArray array{std::vector<jbyte>(payload, 0x5a)};
+  jbyteArray array_obj = FakeJni::wrap(&array);
+  // Left unchanged for the whole run, so borrowing it for every write is
+  // safe.
+  std::vector<uint8_t> direct_mem(payload, 0x5a);
+  FakeDirectBuffer direct{direct_mem.data(), (jlong)direct_mem.size()};
+  jobject direct_obj = FakeJni::wrap(&direct);
+
+  ClientStats before = client->stats();
+  double cpu_before = process_cpu_seconds() - server.thread_cpu_seconds();
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + std::chrono::seconds(seconds);
+  uint64_t queued = 0;
+  uint64_t writes = 0;
+  int rv = 0;
+  while (rv == 0 && std::chrono::steady_clock::now() < deadline) {
+    if (client->stats().stream_bytes_sent + kMaxQueued <
+        before.stream_bytes_sent + queued) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      continue;
+    }
+    // Sixteen writes per check keeps the pacing out of the 64 B numbers.
+    for (int i = 0; i < 16 && rv == 0; i++) {
+      switch (path) {
+      case WritePath::kTwoCopies: {
+        std::vector<uint8_t> staging(payload);
+        env->GetByteArrayRegion(array_obj, 0, (jsize)payload,
+                                reinterpret_cast<jbyte *>(staging.data()));
+        rv = client->write_stream(stream_id, staging.data(), staging.size(),
+                                  false);
+        break;
+      }
+      case WritePath::kByteArray:
+        rv = Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeWriteStream(
+            env, nullptr, handle, stream_id, array_obj);
+        break;
+      case WritePath::kDirect:
+        rv = Java_ai_annadata_mqttquic_quic_NGTCP2Client_nativeWriteStreamDirect(
+            env, nullptr, handle, stream_id, direct_obj, 0, (jint)payload);
+        break;
+      }
+      queued += payload;
+      writes++;
+    }
+  }
+  while (rv == 0 && received.load(std::memory_order_relaxed) < queued) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  double secs = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+  double cpu = process_cpu_seconds() - server.thread_cpu_seconds() - cpu_before;
+  if (rv != 0) {
+    fprintf(stderr, "write failed: %s\n", client->last_error());
+  }
+  connections.remove(handle);
+  client->close();
+  server.stop();
+  if (rv != 0) {
+    return false;
+  }
+
+  double mb = (double)queued / (1024 * 1024);
+  out->mb_per_s = mb / secs;
+  out->writes_per_s = (double)writes / secs;
+  out->cpu_ms_per_mb = cpu * 1000 / mb;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int seconds = argc > 1 ? atoi(argv[1]) : 3;
+  setenv("MQTT_QUIC_CA_FILE", cert_path("ca.pem").c_str(), 1);
+
+  printf("%d s per run\n", seconds);
+  printf("%-8s %-18s %10s %12s %12s\n", "payload", "write", "MB/s", "writes/s",
+         "CPU ms/MB");
+  for (size_t payload : {(size_t)64, (size_t)1024, (size_t)64 * 1024}) {
+    for (WritePath path :
+         {WritePath::kTwoCopies, WritePath::kByteArray, WritePath::kDirect}) {
+      Result r;
+      if (!run(path, payload, seconds, &r)) {
+        return 1;
+      }
+      printf("%-8zu %-18s %10.1f %12.0f %12.2f\n", payload, path_name(path),
+             r.mb_per_s, r.writes_per_s, r.cpu_ms_per_mb);
+    }
+  }
+  return 0;
+}
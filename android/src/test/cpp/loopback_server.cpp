@@ -0,0 +1,661 @@
+//
+// loopback_server.cpp
+//
+
+#include "loopback_server.h"
+
+#include <ngtcp2/ngtcp2.h>
+#include <ngtcp2/ngtcp2_crypto.h>
+#include <ngtcp2/ngtcp2_crypto_wolfssl.h>
+
+#include <wolfssl/ssl.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <map>
+
+namespace mqttquic_test {
+
+namespace {
+
+constexpr uint64_t kStreamWindow = 1024 * 1024;
+// Length of every connection ID the server issues, so short-header
+// packets can be routed.
+constexpr size_t kCidLen = 8;
+constexpr uint64_t kConnWindow = 16 * 1024 * 1024;
+// Longest the loop sleeps, so stop() is noticed promptly.
+constexpr int kMaxPollMs = 5;
+// wolfSSL's SSL_TLSEXT_ERR_OK, which only its OpenSSL compat header defines.
+constexpr int kAlpnOk = 0;
+
+uint64_t now_ns() {
+  struct timespec tp;
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+  return (uint64_t)tp.tv_sec * NGTCP2_SECONDS + (uint64_t)tp.tv_nsec;
+}
+
+double clock_seconds(clockid_t clock) {
+  struct timespec tp;
+  if (clock_gettime(clock, &tp) != 0) {
+    return 0;
+  }
+  return (double)tp.tv_sec + (double)tp.tv_nsec / 1e9;
+}
+
+std::string format_address(const struct sockaddr_storage &addr) {
+  char host[INET6_ADDRSTRLEN] = "?";
+  uint16_t port = 0;
+  if (addr.ss_family == AF_INET) {
+    const auto *in = (const struct sockaddr_in *)&addr;
+    inet_ntop(AF_INET, &in->sin_addr, host, sizeof(host));
+    port = ntohs(in->sin_port);
+  } else if (addr.ss_family == AF_INET6) {
+    const auto *in6 = (const struct sockaddr_in6 *)&addr;
+    inet_ntop(AF_INET6, &in6->sin6_addr, host, sizeof(host));
+    port = ntohs(in6->sin6_port);
+  }
+  return std::string(host) + ":" + std::to_string(port);
+}
+
+// Picks the client's first protocol, whatever it is.
+int select_alpn(WOLFSSL *ssl, const unsigned char **out, unsigned char *outlen,
+                const unsigned char *in, unsigned int inlen, void *arg) {
+  if (inlen == 0 || in[0] == 0 || (unsigned int)in[0] + 1 > inlen) {
+    return 3;  // SSL_TLSEXT_ERR_NOACK
+  }
+  *out = in + 1;
+  *outlen = in[0];
+  return kAlpnOk;
+}
+
+void rand_cb(uint8_t *dest, size_t destlen, const ngtcp2_rand_ctx *rand_ctx) {
+  wolfSSL_RAND_bytes(dest, (int)destlen);
+}
+
+std::string cid_key(const uint8_t *data, size_t len) {
+  return std::string(reinterpret_cast<const char *>(data), len);
+}
+
+}  // namespace
+
+// Data queued for one stream. ngtcp2 may resend any byte it has written
+// until the client acknowledges it, so chunks stay put until then; acks
+// arrive in order, so they are released from the front.
+struct LoopbackServer::OutStream {
+  std::deque<std::vector<uint8_t>> chunks;
+  uint64_t front_offset = 0;  // stream offset of chunks.front()
+  size_t unsent_chunk = 0;    // first chunk with bytes not yet written
+  size_t unsent_off = 0;      // bytes of it already written
+
+  bool has_unsent() const { return unsent_chunk < chunks.size(); }
+
+  ngtcp2_vec next_unsent() {
+    std::vector<uint8_t> &c = chunks[unsent_chunk];
+    return ngtcp2_vec{c.data() + unsent_off, c.size() - unsent_off};
+  }
+
+  void mark_sent(size_t n) {
+    unsent_off += n;
+    while (has_unsent() && unsent_off >= chunks[unsent_chunk].size()) {
+      unsent_off -= chunks[unsent_chunk].size();
+      unsent_chunk++;
+    }
+  }
+
+  // Releases chunks acknowledged up to offset; returns their total size.
+  uint64_t ack(uint64_t offset) {
+    uint64_t released = 0;
+    while (!chunks.empty() && unsent_chunk > 0 &&
+           front_offset + chunks.front().size() <= offset) {
+      front_offset += chunks.front().size();
+      released += chunks.front().size();
+      chunks.pop_front();
+      unsent_chunk--;
+    }
+    return released;
+  }
+
+  uint64_t queued() const {
+    uint64_t n = 0;
+    for (const auto &c : chunks) {
+      n += c.size();
+    }
+    return n;
+  }
+};
+
+struct LoopbackServer::Conn {
+  ngtcp2_conn *conn = nullptr;
+  WOLFSSL *ssl = nullptr;
+  ngtcp2_crypto_conn_ref conn_ref;
+  const StreamHandler *handler = nullptr;
+  const DatagramHandler *datagram_handler = nullptr;
+  std::atomic<uint64_t> *unacked = nullptr;
+  std::map<int64_t, OutStream> out;
+  std::map<std::string, Conn *> *routes = nullptr;
+  std::vector<std::string> cids;  // keys of this connection in routes
+  bool dirty = false;             // may have packets to write
+
+  void add_cid(const uint8_t *data, size_t len) {
+    cids.push_back(cid_key(data, len));
+    (*routes)[cids.back()] = this;
+  }
+
+  ~Conn() {
+    for (const auto &kv : out) {
+      *unacked -= kv.second.queued();
+    }
+    if (conn) {
+      ngtcp2_conn_del(conn);
+    }
+    if (ssl) {
+      wolfSSL_free(ssl);
+    }
+  }
+
+  static ngtcp2_conn *get_conn(ngtcp2_crypto_conn_ref *ref) {
+    return static_cast<Conn *>(ref->user_data)->conn;
+  }
+
+  static int recv_stream_data_cb(ngtcp2_conn *conn, uint32_t flags,
+                                 int64_t stream_id, uint64_t offset,
+                                 const uint8_t *data, size_t datalen,
+                                 void *user_data, void *stream_user_data) {
+    auto *c = static_cast<Conn *>(user_data);
+    if (*c->handler) {
+      (*c->handler)(stream_id, data, datalen,
+                    (flags & NGTCP2_STREAM_DATA_FLAG_FIN) != 0);
+    }
+    // A sink: everything is consumed as soon as it arrives.
+    ngtcp2_conn_extend_max_stream_offset(conn, stream_id, datalen);
+    ngtcp2_conn_extend_max_offset(conn, datalen);
+    return 0;
+  }
+
+  static int recv_datagram_cb(ngtcp2_conn *conn, uint32_t flags,
+                              const uint8_t *data, size_t datalen,
+                              void *user_data) {
+    auto *c = static_cast<Conn *>(user_data);
+    (*c->datagram_handler)(data, datalen);
+    return 0;
+  }
+
+  static int acked_stream_data_offset_cb(ngtcp2_conn *conn, int64_t stream_id,
+                                         uint64_t offset, uint64_t datalen,
+                                         void *user_data,
+                                         void *stream_user_data) {
+    auto *c = static_cast<Conn *>(user_data);
+    auto it = c->out.find(stream_id);
+    if (it != c->out.end()) {
+      *c->unacked -= it->second.ack(offset + datalen);
+    }
+    return 0;
+  }
+
+  static int get_new_connection_id_cb(ngtcp2_conn *conn, ngtcp2_cid *cid,
+                                      uint8_t *token, size_t cidlen,
+                                      void *user_data) {
+    if (wolfSSL_RAND_bytes(cid->data, (int)cidlen) != 1 ||
+        wolfSSL_RAND_bytes(token, NGTCP2_STATELESS_RESET_TOKENLEN) != 1) {
+      return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+    cid->datalen = cidlen;
+    static_cast<Conn *>(user_data)->add_cid(cid->data, cid->datalen);
+    return 0;
+  }
+
+  static int remove_connection_id_cb(ngtcp2_conn *conn, const ngtcp2_cid *cid,
+                                     void *user_data) {
+    auto *c = static_cast<Conn *>(user_data);
+    std::string key = cid_key(cid->data, cid->datalen);
+    c->routes->erase(key);
+    c->cids.erase(std::remove(c->cids.begin(), c->cids.end(), key),
+                  c->cids.end());
+    return 0;
+  }
+
+  static int stream_close_cb(ngtcp2_conn *conn, uint32_t flags,
+                             int64_t stream_id, uint64_t app_error_code,
+                             void *user_data, void *stream_user_data) {
+    auto *c = static_cast<Conn *>(user_data);
+    auto it = c->out.find(stream_id);
+    if (it != c->out.end()) {
+      *c->unacked -= it->second.queued();
+      c->out.erase(it);
+    }
+    if ((stream_id & 0x2) == 0) {
+      ngtcp2_conn_extend_max_streams_bidi(conn, 1);
+    } else {
+      ngtcp2_conn_extend_max_streams_uni(conn, 1);
+    }
+    return 0;
+  }
+};
+
+LoopbackServer::LoopbackServer(std::string cert_file, std::string key_file)
+    : cert_file_(std::move(cert_file)), key_file_(std::move(key_file)) {
+  memset(&local_addr_, 0, sizeof(local_addr_));
+  memset(&last_from_, 0, sizeof(last_from_));
+}
+
+LoopbackServer::~LoopbackServer() {
+  stop();
+  if (tls_ctx_) {
+    wolfSSL_CTX_free(tls_ctx_);
+  }
+  if (fd_ != -1) {
+    close(fd_);
+  }
+  if (wake_fd_ != -1) {
+    close(wake_fd_);
+  }
+}
+
+bool LoopbackServer::start() {
+  tls_ctx_ = wolfSSL_CTX_new(wolfTLSv1_3_server_method());
+  if (!tls_ctx_ ||
+      ngtcp2_crypto_wolfssl_configure_server_context(tls_ctx_) != 0) {
+    error_ = "could not create the server TLS context";
+    return false;
+  }
+  if (wolfSSL_CTX_use_certificate_chain_file(tls_ctx_, cert_file_.c_str()) !=
+          WOLFSSL_SUCCESS ||
+      wolfSSL_CTX_use_PrivateKey_file(tls_ctx_, key_file_.c_str(),
+                                      WOLFSSL_FILETYPE_PEM) != WOLFSSL_SUCCESS) {
+    error_ = "could not load " + cert_file_ + " / " + key_file_;
+    return false;
+  }
+  wolfSSL_CTX_set_alpn_select_cb(tls_ctx_, select_alpn, nullptr);
+
+  fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  local_addrlen_ = sizeof(local_addr_);
+  if (fd_ == -1 || bind(fd_, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      getsockname(fd_, (struct sockaddr *)&local_addr_, &local_addrlen_) != 0) {
+    error_ = std::string("could not bind the server socket: ") + strerror(errno);
+    return false;
+  }
+  port_ = ntohs(((struct sockaddr_in *)&local_addr_)->sin_port);
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd_ == -1) {
+    error_ = std::string("could not create the wakeup eventfd: ") + strerror(errno);
+    return false;
+  }
+
+  stopping_ = false;
+  thread_ = std::thread([this]() { run(); });
+  return true;
+}
+
+void LoopbackServer::stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+  stopping_ = true;
+  thread_.join();
+}
+
+void LoopbackServer::send_stream(int64_t stream_id, std::vector<uint8_t> data) {
+  if (data.empty()) {
+    return;
+  }
+  unacked_ += data.size();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    outbox_.emplace_back(stream_id, std::move(data));
+  }
+  uint64_t one = 1;
+  (void)!write(wake_fd_, &one, sizeof(one));
+}
+
+// Server thread: moves send_stream's data to the newest connection's
+// streams.
+void LoopbackServer::take_outbox() {
+  std::vector<std::pair<int64_t, std::vector<uint8_t>>> batch;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    batch.swap(outbox_);
+  }
+  for (auto &item : batch) {
+    if (!newest_) {
+      unacked_ -= item.second.size();
+      continue;
+    }
+    newest_->out[item.first].chunks.push_back(std::move(item.second));
+    newest_->dirty = true;
+  }
+}
+
+std::vector<std::string> LoopbackServer::client_addresses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return addresses_;
+}
+
+double LoopbackServer::thread_cpu_seconds() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cpu_clock_valid_ ? clock_seconds(cpu_clock_) : final_cpu_seconds_;
+}
+
+void LoopbackServer::run() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cpu_clock_valid_ = pthread_getcpuclockid(pthread_self(), &cpu_clock_) == 0;
+  }
+  std::vector<uint8_t> buf(65536);
+  while (!stopping_) {
+    uint64_t now = now_ns();
+    uint64_t wake = now + (uint64_t)kMaxPollMs * NGTCP2_MILLISECONDS;
+    for (Conn *c : conns_) {
+      wake = std::min<uint64_t>(wake, ngtcp2_conn_get_expiry(c->conn));
+    }
+    if (!delayed_.empty()) {
+      wake = std::min(wake, delayed_.front().due_ns);
+    }
+    int timeout_ms = wake > now
+        ? (int)((wake - now + NGTCP2_MILLISECONDS - 1) / NGTCP2_MILLISECONDS)
+        : 0;
+
+    struct pollfd pfds[2] = {{fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+    if (poll(pfds, 2, timeout_ms) > 0) {
+      uint64_t wakeups;
+      (void)!read(wake_fd_, &wakeups, sizeof(wakeups));
+      for (;;) {
+        struct sockaddr_storage from;
+        memset(&from, 0, sizeof(from));
+        socklen_t fromlen = sizeof(from);
+        ssize_t n = recvfrom(fd_, buf.data(), buf.size(), 0,
+                             (struct sockaddr *)&from, &fromlen);
+        if (n < 0) {
+          break;
+        }
+        datagrams_received_.fetch_add(1, std::memory_order_relaxed);
+        note_address(from);
+        if (drop_by_impairment()) {
+          continue;
+        }
+        if (impairment_.delay_ms > 0) {
+          delayed_.push_back({now_ns() + impairment_.delay_ms * NGTCP2_MILLISECONDS,
+                              from, fromlen,
+                              std::vector<uint8_t>(buf.begin(), buf.begin() + n)});
+          continue;
+        }
+        on_datagram(buf.data(), (size_t)n, from, fromlen);
+      }
+    }
+
+    now = now_ns();
+    while (!delayed_.empty() && delayed_.front().due_ns <= now) {
+      Delayed d = std::move(delayed_.front());
+      delayed_.pop_front();
+      on_datagram(d.data.data(), d.data.size(), d.from, d.fromlen);
+    }
+    handle_expiries();
+    take_outbox();
+    write_dirty();
+  }
+  while (!conns_.empty()) {
+    drop_connection(conns_.back());
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (cpu_clock_valid_) {
+    final_cpu_seconds_ = clock_seconds(cpu_clock_);
+    cpu_clock_valid_ = false;
+  }
+}
+
+void LoopbackServer::on_datagram(const uint8_t *data, size_t len,
+                                 const struct sockaddr_storage &from,
+                                 socklen_t fromlen) {
+  ngtcp2_version_cid vc;
+  if (ngtcp2_pkt_decode_version_cid(&vc, data, len, kCidLen) != 0) {
+    return;
+  }
+  Conn *c;
+  auto it = routes_.find(cid_key(vc.dcid, vc.dcidlen));
+  if (it != routes_.end()) {
+    c = it->second;
+  } else if (!(c = accept(data, len, from, fromlen))) {
+    return;
+  }
+  ngtcp2_path path = {
+    .local = {.addr = (struct sockaddr *)&local_addr_, .addrlen = local_addrlen_},
+    .remote = {.addr = (struct sockaddr *)&from, .addrlen = fromlen},
+  };
+  ngtcp2_pkt_info pi;
+  memset(&pi, 0, sizeof(pi));
+  int rv = ngtcp2_conn_read_pkt(c->conn, &path, &pi, data, len, now_ns());
+  if (rv != 0) {
+    // Draining after the client's CONNECTION_CLOSE, or a fatal error.
+    drop_connection(c);
+    return;
+  }
+  c->dirty = true;
+}
+
+LoopbackServer::Conn *LoopbackServer::accept(const uint8_t *data, size_t len,
+                            const struct sockaddr_storage &from,
+                            socklen_t fromlen) {
+  ngtcp2_pkt_hd hd;
+  if (ngtcp2_accept(&hd, data, len) != 0) {
+    return nullptr;
+  }
+
+  ngtcp2_callbacks callbacks;
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.recv_client_initial = ngtcp2_crypto_recv_client_initial_cb;
+  callbacks.recv_crypto_data = ngtcp2_crypto_recv_crypto_data_cb;
+  callbacks.encrypt = ngtcp2_crypto_encrypt_cb;
+  callbacks.decrypt = ngtcp2_crypto_decrypt_cb;
+  callbacks.hp_mask = ngtcp2_crypto_hp_mask_cb;
+  callbacks.update_key = ngtcp2_crypto_update_key_cb;
+  callbacks.delete_crypto_aead_ctx = ngtcp2_crypto_delete_crypto_aead_ctx_cb;
+  callbacks.delete_crypto_cipher_ctx = ngtcp2_crypto_delete_crypto_cipher_ctx_cb;
+  callbacks.get_path_challenge_data = ngtcp2_crypto_get_path_challenge_data_cb;
+  callbacks.version_negotiation = ngtcp2_crypto_version_negotiation_cb;
+  callbacks.recv_stream_data = Conn::recv_stream_data_cb;
+  callbacks.acked_stream_data_offset = Conn::acked_stream_data_offset_cb;
+  callbacks.stream_close = Conn::stream_close_cb;
+  callbacks.rand = rand_cb;
+  callbacks.get_new_connection_id = Conn::get_new_connection_id_cb;
+  callbacks.remove_connection_id = Conn::remove_connection_id_cb;
+  if (datagram_handler_) {
+    callbacks.recv_datagram = Conn::recv_datagram_cb;
+  }
+
+  ngtcp2_settings settings;
+  ngtcp2_settings_default(&settings);
+  settings.initial_ts = now_ns();
+
+  ngtcp2_transport_params params;
+  ngtcp2_transport_params_default(&params);
+  params.original_dcid = hd.dcid;
+  params.original_dcid_present = 1;
+  params.initial_max_streams_bidi = 256;
+  params.initial_max_streams_uni = 16;
+  params.initial_max_stream_data_bidi_local = kStreamWindow;
+  params.initial_max_stream_data_bidi_remote = kStreamWindow;
+  params.initial_max_stream_data_uni = kStreamWindow;
+  params.initial_max_data = kConnWindow;
+  params.max_idle_timeout = 30 * NGTCP2_SECONDS;
+  if (datagram_handler_) {
+    params.max_datagram_frame_size = 65535;
+  }
+
+  ngtcp2_cid scid;
+  scid.datalen = kCidLen;
+  if (wolfSSL_RAND_bytes(scid.data, (int)scid.datalen) != 1) {
+    return nullptr;
+  }
+  ngtcp2_path path = {
+    .local = {.addr = (struct sockaddr *)&local_addr_, .addrlen = local_addrlen_},
+    .remote = {.addr = (struct sockaddr *)&from, .addrlen = fromlen},
+  };
+
+  auto *c = new Conn();
+  c->conn_ref.get_conn = Conn::get_conn;
+  c->conn_ref.user_data = c;
+  c->handler = &handler_;
+  c->datagram_handler = &datagram_handler_;
+  c->unacked = &unacked_;
+  c->routes = &routes_;
+  if (ngtcp2_conn_server_new(&c->conn, &hd.scid, &scid, &path, hd.version,
+                             &callbacks, &settings, &params, nullptr, c) != 0 ||
+      !(c->ssl = wolfSSL_new(tls_ctx_))) {
+    for (const std::string &key : c->cids) {
+      routes_.erase(key);
+    }
+    delete c;
+    return nullptr;
+  }
+  wolfSSL_set_app_data(c->ssl, &c->conn_ref);
+  wolfSSL_set_accept_state(c->ssl);
+  if (early_data_) {
+    wolfSSL_set_quic_early_data_enabled(c->ssl, 1);
+  }
+  ngtcp2_conn_set_tls_native_handle(c->conn, c->ssl);
+  // Until the client switches to scid, its packets carry the DCID it
+  // picked for the Initial.
+  c->add_cid(hd.dcid.data, hd.dcid.datalen);
+  c->add_cid(scid.data, scid.datalen);
+  conns_.push_back(c);
+  newest_ = c;
+  live_connections_++;
+  return c;
+}
+
+void LoopbackServer::handle_expiries() {
+  uint64_t now = now_ns();
+  std::vector<Conn *> failed;
+  for (Conn *c : conns_) {
+    if (ngtcp2_conn_get_expiry(c->conn) > now) {
+      continue;
+    }
+    if (ngtcp2_conn_handle_expiry(c->conn, now) != 0) {
+      failed.push_back(c);
+    } else {
+      c->dirty = true;
+    }
+  }
+  for (Conn *c : failed) {
+    drop_connection(c);
+  }
+}
+
+// Only connections that received, timed out or got data to send since
+// their last write, so idle ones cost nothing per pass.
+void LoopbackServer::write_dirty() {
+  std::vector<Conn *> failed;
+  for (Conn *c : conns_) {
+    if (c->dirty && !write_packets(c)) {
+      failed.push_back(c);
+    }
+  }
+  for (Conn *c : failed) {
+    drop_connection(c);
+  }
+}
+
+bool LoopbackServer::write_packets(Conn *c) {
+  c->dirty = false;
+  uint8_t buf[65536];
+  size_t max = std::min(sizeof(buf),
+                        ngtcp2_conn_get_max_tx_udp_payload_size(c->conn));
+  ngtcp2_tstamp now = now_ns();
+  // Streams that are flow-control blocked (or not open yet) for the rest
+  // of this pass.
+  std::vector<int64_t> skip;
+  for (;;) {
+    int64_t stream_id = -1;
+    ngtcp2_vec vec;
+    size_t veccnt = 0;
+    for (auto &kv : c->out) {
+      if (kv.second.has_unsent() &&
+          std::find(skip.begin(), skip.end(), kv.first) == skip.end()) {
+        stream_id = kv.first;
+        vec = kv.second.next_unsent();
+        veccnt = 1;
+        break;
+      }
+    }
+    ngtcp2_path_storage ps;
+    ngtcp2_path_storage_zero(&ps);
+    ngtcp2_pkt_info pi;
+    ngtcp2_ssize ndatalen = -1;
+    ngtcp2_ssize n = ngtcp2_conn_writev_stream(
+        c->conn, &ps.path, &pi, buf, max, &ndatalen,
+        NGTCP2_WRITE_STREAM_FLAG_MORE, stream_id, veccnt ? &vec : nullptr,
+        veccnt, now);
+    if (ndatalen > 0) {
+      c->out[stream_id].mark_sent((size_t)ndatalen);
+    }
+    if (n == NGTCP2_ERR_WRITE_MORE) {
+      continue;
+    }
+    if (n == NGTCP2_ERR_STREAM_DATA_BLOCKED ||
+        n == NGTCP2_ERR_STREAM_NOT_FOUND || n == NGTCP2_ERR_STREAM_SHUT_WR) {
+      skip.push_back(stream_id);
+      continue;
+    }
+    if (n < 0) {
+      return false;
+    }
+    if (n == 0) {
+      break;
+    }
+    sendto(fd_, buf, (size_t)n, 0, ps.path.remote.addr,
+           ps.path.remote.addrlen);
+  }
+  ngtcp2_conn_update_pkt_tx_time(c->conn, now);
+  return true;
+}
+
+void LoopbackServer::drop_connection(Conn *c) {
+  for (const std::string &key : c->cids) {
+    routes_.erase(key);
+  }
+  conns_.erase(std::remove(conns_.begin(), conns_.end(), c), conns_.end());
+  if (newest_ == c) {
+    newest_ = nullptr;
+  }
+  live_connections_--;
+  delete c;
+}
+
+void LoopbackServer::note_address(const struct sockaddr_storage &from) {
+  if (memcmp(&from, &last_from_, sizeof(from)) == 0) {
+    return;
+  }
+  memcpy(&last_from_, &from, sizeof(from));
+  std::string addr = format_address(from);
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (std::find(addresses_.begin(), addresses_.end(), addr) ==
+      addresses_.end()) {
+    addresses_.push_back(addr);
+  }
+}
+
+// xorshift64: reproducible loss patterns across runs.
+bool LoopbackServer::drop_by_impairment() {
+  if (impairment_.loss <= 0) {
+    return false;
+  }
+  rng_state_ ^= rng_state_ << 13;
+  rng_state_ ^= rng_state_ >> 7;
+  rng_state_ ^= rng_state_ << 17;
+  return (double)(rng_state_ >> 11) / (double)(1ULL << 53) < impairment_.loss;
+}
+
+}  // namespace mqttquic_test
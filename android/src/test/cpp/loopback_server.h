@@ -0,0 +1,152 @@
+//
+// loopback_server.h
+// In-process QUIC server on 127.0.0.1 for the host tests and benchmarks
+// that drive the real QuicClient. It serves any number of connections at
+// once, routed by connection ID, accepts whatever ALPN the client offers
+// first, hands every received stream chunk to a callback on its own
+// thread, and sends the clients only what send_stream queues. Session tickets are issued as wolfSSL does by
+// default, so clients can resume; 0-RTT is only accepted after
+// set_early_data. Optional impairment (random loss, fixed one-way delay) is
+// applied to the client's datagrams before they reach ngtcp2.
+//
+
+#pragma once
+
+#include <sys/socket.h>
+#include <time.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct WOLFSSL_CTX;
+
+namespace mqttquic_test {
+
+struct Impairment {
+  double loss = 0;         // fraction of client datagrams dropped
+  uint64_t delay_ms = 0;   // added before each client datagram is read
+};
+
+class LoopbackServer {
+ public:
+  // Runs on the server thread; data is only valid during the call.
+  using StreamHandler = std::function<void(int64_t stream_id,
+                                           const uint8_t *data, size_t len,
+                                           bool fin)>;
+  // Runs on the server thread with one DATAGRAM frame's payload.
+  using DatagramHandler = std::function<void(const uint8_t *data, size_t len)>;
+
+  LoopbackServer(std::string cert_file, std::string key_file);
+  ~LoopbackServer();
+
+  LoopbackServer(const LoopbackServer &) = delete;
+  LoopbackServer &operator=(const LoopbackServer &) = delete;
+
+  // All must be set before start().
+  void set_stream_handler(StreamHandler handler) { handler_ = std::move(handler); }
+  void set_impairment(Impairment impairment) { impairment_ = impairment; }
+  // The server only offers the DATAGRAM extension (RFC 9221) when a
+  // handler is set.
+  void set_datagram_handler(DatagramHandler handler) {
+    datagram_handler_ = std::move(handler);
+  }
+  // Accept 0-RTT from resumed sessions. Needs wolfSSL built with
+  // --enable-earlydata; without it resumed clients fall back to 1-RTT.
+  void set_early_data(bool enabled) { early_data_ = enabled; }
+
+  // Binds 127.0.0.1 on an ephemeral port and starts the server thread.
+  // false (see error()) if the TLS context or socket could not be set up.
+  bool start();
+  void stop();
+
+  // Queues data on stream_id, a stream the client opened, of the newest
+  // connection. Thread-safe. The server thread sends it as flow control allows and
+  // keeps it until the client acknowledges it; whatever is left when the
+  // connection ends is dropped.
+  void send_stream(int64_t stream_id, std::vector<uint8_t> data);
+  // Bytes queued with send_stream and not yet acknowledged.
+  uint64_t stream_bytes_unacked() const { return unacked_.load(); }
+
+  uint16_t port() const { return port_; }
+  // Connections accepted and not yet closed or timed out.
+  size_t connections() const { return live_connections_.load(); }
+  const std::string &error() const { return error_; }
+
+  // "addr:port" of every client address a datagram arrived from, in the
+  // order they were first seen.
+  std::vector<std::string> client_addresses() const;
+  uint64_t datagrams_received() const { return datagrams_received_.load(); }
+  // CPU time the server thread has used, so benchmarks can take it out of
+  // a process-wide measurement.
+  double thread_cpu_seconds() const;
+
+ private:
+  struct Delayed {
+    uint64_t due_ns;
+    struct sockaddr_storage from;
+    socklen_t fromlen;
+    std::vector<uint8_t> data;
+  };
+  struct Conn;
+  struct OutStream;
+
+  void run();
+  void take_outbox();
+  void on_datagram(const uint8_t *data, size_t len,
+                   const struct sockaddr_storage &from, socklen_t fromlen);
+  Conn *accept(const uint8_t *data, size_t len,
+               const struct sockaddr_storage &from, socklen_t fromlen);
+  void handle_expiries();
+  void write_dirty();
+  // false if the connection failed and has to be dropped.
+  bool write_packets(Conn *c);
+  void drop_connection(Conn *c);
+  void note_address(const struct sockaddr_storage &from);
+  bool drop_by_impairment();
+
+  std::string cert_file_;
+  std::string key_file_;
+  StreamHandler handler_;
+  DatagramHandler datagram_handler_;
+  Impairment impairment_;
+  bool early_data_ = false;
+  std::string error_;
+
+  int fd_ = -1;
+  int wake_fd_ = -1;  // eventfd; send_stream wakes the loop
+  uint16_t port_ = 0;
+  struct sockaddr_storage local_addr_;
+  socklen_t local_addrlen_ = 0;
+  WOLFSSL_CTX *tls_ctx_ = nullptr;
+  // Server thread only. Every connection ID a connection answers to
+  // (including the client's original DCID) maps to it.
+  std::vector<Conn *> conns_;
+  std::map<std::string, Conn *> routes_;
+  Conn *newest_ = nullptr;  // where send_stream's data goes
+  std::deque<Delayed> delayed_;
+  struct sockaddr_storage last_from_;
+  uint64_t rng_state_ = 0x9e3779b97f4a7c15ULL;
+
+  std::thread thread_;
+  std::atomic<bool> stopping_{false};
+  mutable std::mutex mutex_;
+  std::vector<std::string> addresses_;
+  std::vector<std::pair<int64_t, std::vector<uint8_t>>> outbox_;
+  std::atomic<uint64_t> unacked_{0};
+  std::atomic<size_t> live_connections_{0};
+  std::atomic<uint64_t> datagrams_received_{0};
+  // The server thread's CPU clock while it runs, its total once it exits;
+  // guarded by mutex_.
+  bool cpu_clock_valid_ = false;
+  clockid_t cpu_clock_;
+  double final_cpu_seconds_ = 0;
+};
+
+}  // namespace mqttquic_test
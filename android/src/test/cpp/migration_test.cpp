@@ -0,0 +1,169 @@
+//
+// migration_test.cpp
+// QuicClient::migrate against the loopback server: a stream carries a
+// small record every millisecond while the client moves to a new local
+// address, and every record must arrive, in order, from the new address.
+// Prints the longest delivery delay around the switch.
+//
+
+#include "ngtcp2_jni.cpp"
+
+#include "loopback_server.h"
+
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+
+namespace {
+
+using mqttquic_test::LoopbackServer;
+
+// seq (u64) then send time (u64, now_ts), native byte order.
+constexpr size_t kRecordSize = 16;
+
+std::string cert_path(const char *name) {
+  return std::string(TEST_CERT_DIR) + "/" + name;
+}
+
+struct Arrival {
+  uint64_t seq;
+  uint64_t sent_ns;
+  uint64_t arrived_ns;
+};
+
+// Collects the records of the first stream on the server thread.
+class RecordSink {
+ public:
+  void on_data(const uint8_t *data, size_t len) {
+    uint64_t arrived = now_ts();
+    std::lock_guard<std::mutex> lock(mutex_);
+    partial_.insert(partial_.end(), data, data + len);
+    size_t off = 0;
+    for (; partial_.size() - off >= kRecordSize; off += kRecordSize) {
+      Arrival a;
+      memcpy(&a.seq, partial_.data() + off, 8);
+      memcpy(&a.sent_ns, partial_.data() + off + 8, 8);
+      a.arrived_ns = arrived;
+      arrivals_.push_back(a);
+    }
+    partial_.erase(partial_.begin(), partial_.begin() + off);
+    cv_.notify_all();
+  }
+
+  std::vector<Arrival> wait_for(size_t count, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait_for(lock, timeout, [&]() { return arrivals_.size() >= count; });
+    return arrivals_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<uint8_t> partial_;
+  std::vector<Arrival> arrivals_;
+};
+
+class MigrationTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    server_.set_stream_handler(
+        [this](int64_t stream_id, const uint8_t *data, size_t len, bool fin) {
+          sink_.on_data(data, len);
+        });
+    ASSERT_TRUE(server_.start()) << server_.error();
+    setenv("MQTT_QUIC_CA_FILE", cert_path("ca.pem").c_str(), 1);
+  }
+
+  // Streams records for 300 ms, migrates (to `local` if given), streams
+  // for another 300 ms, and checks delivery.
+  void run(const struct sockaddr *local, socklen_t local_len) {
+    QuicClient client("localhost", "127.0.0.1", server_.port());
+    ASSERT_EQ(client.connect("mqtt"), 0) << client.last_error();
+    int64_t stream_id = client.open_stream();
+    ASSERT_GE(stream_id, 0) << client.last_error();
+
+    std::atomic<bool> sending{true};
+    std::atomic<uint64_t> sent{0};
+    std::atomic<int> write_errors{0};
+    std::thread sender([&]() {
+      uint8_t record[kRecordSize];
+      for (uint64_t seq = 0; sending; seq++) {
+        uint64_t ts = now_ts();
+        memcpy(record, &seq, 8);
+        memcpy(record + 8, &ts, 8);
+        if (client.write_stream(stream_id, record, sizeof(record), false) != 0) {
+          write_errors++;
+          return;
+        }
+        sent = seq + 1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    uint64_t migrated_at = now_ts();
+    int rv = client.migrate(local, local_len);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    sending = false;
+    sender.join();
+    ASSERT_EQ(rv, 0) << client.last_error();
+    ASSERT_EQ(write_errors, 0) << client.last_error();
+
+    std::vector<Arrival> arrivals =
+        sink_.wait_for(sent, std::chrono::seconds(5));
+    ASSERT_EQ(arrivals.size(), sent.load());
+    uint64_t worst_delay = 0;
+    uint64_t worst_gap = 0;
+    for (size_t i = 0; i < arrivals.size(); i++) {
+      ASSERT_EQ(arrivals[i].seq, i);
+      if (arrivals[i].sent_ns >= migrated_at) {
+        worst_delay = std::max(worst_delay,
+                               arrivals[i].arrived_ns - arrivals[i].sent_ns);
+      }
+      if (i > 0) {
+        worst_gap = std::max(worst_gap,
+                             arrivals[i].arrived_ns - arrivals[i - 1].arrived_ns);
+      }
+    }
+    printf("%zu records, worst delay after migrate %.2f ms, worst arrival gap "
+           "%.2f ms\n",
+           arrivals.size(), (double)worst_delay / NGTCP2_MILLISECONDS,
+           (double)worst_gap / NGTCP2_MILLISECONDS);
+    // Loopback has no loss: anything near a PTO means the new path stalled.
+    EXPECT_LT(worst_delay, 250 * NGTCP2_MILLISECONDS);
+
+    client.close();
+  }
+
+  LoopbackServer server_{cert_path("server.pem"), cert_path("server-key.pem")};
+  RecordSink sink_;
+};
+
+TEST_F(MigrationTest, RefusedBeforeHandshake) {
+  QuicClient client("localhost", "127.0.0.1", server_.port());
+  EXPECT_EQ(client.migrate(), -1);
+}
+
+// Same interface, new socket: the kernel picks a new ephemeral port.
+TEST_F(MigrationTest, NewLocalPort) {
+  run(nullptr, 0);
+  std::vector<std::string> addrs = server_.client_addresses();
+  ASSERT_EQ(addrs.size(), 2u);
+  EXPECT_NE(addrs[0], addrs[1]);
+}
+
+// A different local IP, as after a Wi-Fi to cellular handover. All of
+// 127/8 is local on Linux, so 127.0.0.2 stands in for the second network.
+TEST_F(MigrationTest, SecondLocalAddress) {
+  struct sockaddr_in second;
+  memset(&second, 0, sizeof(second));
+  second.sin_family = AF_INET;
+  inet_pton(AF_INET, "127.0.0.2", &second.sin_addr);
+  run((struct sockaddr *)&second, sizeof(second));
+  std::vector<std::string> addrs = server_.client_addresses();
+  ASSERT_EQ(addrs.size(), 2u);
+  EXPECT_EQ(addrs[0].rfind("127.0.0.1:", 0), 0u);
+  EXPECT_EQ(addrs[1].rfind("127.0.0.2:", 0), 0u);
+}
+
+}  // namespace
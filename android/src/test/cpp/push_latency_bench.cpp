@@ -0,0 +1,202 @@
+//
+// push_latency_bench.cpp
+// Delivery latency of server-sent messages to the reader, for the three
+// ways the client can receive: push (set_stream_listener, called on the
+// worker as data arrives), a blocking read parked on the stream
+// (read_stream_wait), and polling read_stream on a fixed cadence as the
+// Kotlin default readInto does. The server sends a timestamped record
+// every interval_ms; each mode prints p50/p99/max delay from send_stream
+// to the reader seeing the record, and client CPU per second.
+//
+//   push_latency_bench [seconds] [interval_ms] [poll_ms]
+//
+
+#include "ngtcp2_jni.cpp"
+
+#include "loopback_server.h"
+
+#include <sys/resource.h>
+
+namespace {
+
+using mqttquic_test::LoopbackServer;
+
+// A send timestamp and padding, about a small PUBLISH.
+constexpr size_t kRecordSize = 64;
+
+std::string cert_path(const char *name) {
+  return std::string(TEST_CERT_DIR) + "/" + name;
+}
+
+double process_cpu_seconds() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+         (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+enum class Mode { kPush, kWait, kPoll };
+
+const char *mode_name(Mode mode) {
+  switch (mode) {
+  case Mode::kPush:
+    return "push";
+  case Mode::kWait:
+    return "blocking read";
+  case Mode::kPoll:
+    return "poll";
+  }
+  return "?";
+}
+
+// Splits the byte stream back into records, whatever the read sizes, and
+// records each one's delay.
+class RecordSink {
+ public:
+  void on_data(const uint8_t *data, size_t len) {
+    uint64_t now = now_ts();
+    pending_.insert(pending_.end(), data, data + len);
+    size_t off = 0;
+    for (; off + kRecordSize <= pending_.size(); off += kRecordSize) {
+      uint64_t sent;
+      memcpy(&sent, pending_.data() + off, sizeof(sent));
+      delays_ns_.push_back(now - sent);
+    }
+    pending_.erase(pending_.begin(), pending_.begin() + (long)off);
+  }
+
+  const std::vector<uint64_t> &delays() const { return delays_ns_; }
+
+ private:
+  std::vector<uint8_t> pending_;
+  std::vector<uint64_t> delays_ns_;
+};
+
+struct Result {
+  size_t records;
+  double p50_ms;
+  double p99_ms;
+  double max_ms;
+  double cpu_ms_per_s;
+};
+
+bool run(Mode mode, int seconds, int interval_ms, int poll_ms, Result *out) {
+  LoopbackServer server(cert_path("server.pem"), cert_path("server-key.pem"));
+  if (!server.start()) {
+    fprintf(stderr, "server: %s\n", server.error().c_str());
+    return false;
+  }
+  QuicClient client("localhost", "127.0.0.1", server.port());
+  RecordSink sink;
+  std::mutex sink_mutex;
+  if (mode == Mode::kPush) {
+    client.set_stream_listener([&](int64_t stream_id, const uint8_t *data,
+                                   size_t len, bool packet, bool fin) {
+      std::lock_guard<std::mutex> lock(sink_mutex);
+      sink.on_data(data, len);
+    });
+  }
+  int64_t stream_id;
+  uint8_t hello = 0;
+  if (client.connect("mqtt") != 0 || (stream_id = client.open_stream()) < 0 ||
+      client.write_stream(stream_id, &hello, 1, false) != 0) {
+    fprintf(stderr, "client: %s\n", client.last_error());
+    return false;
+  }
+
+  std::atomic<bool> running{true};
+  std::thread reader;
+  if (mode != Mode::kPush) {
+    reader = std::thread([&]() {
+      uint8_t buf[16 * 1024];
+      while (running) {
+        ssize_t n;
+        if (mode == Mode::kWait) {
+          n = client.read_stream_wait(stream_id, buf, sizeof(buf),
+                                      50 * NGTCP2_MILLISECONDS);
+        } else {
+          n = client.read_stream(stream_id, buf, sizeof(buf));
+          if (n == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(poll_ms));
+          }
+        }
+        if (n < 0) {
+          return;
+        }
+        if (n > 0) {
+          std::lock_guard<std::mutex> lock(sink_mutex);
+          sink.on_data(buf, (size_t)n);
+        }
+      }
+    });
+  }
+
+  double cpu_before = process_cpu_seconds() - server.thread_cpu_seconds();
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + std::chrono::seconds(seconds);
+  size_t sent = 0;
+  while (std::chrono::steady_clock::now() < deadline) {
+    std::vector<uint8_t> record(kRecordSize, 0);
+    uint64_t ts = now_ts();
+    memcpy(record.data(), &ts, sizeof(ts));
+    server.send_stream(stream_id, std::move(record));
+    sent++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+  }
+  for (int i = 0; i < 100; i++) {
+    std::lock_guard<std::mutex> lock(sink_mutex);
+    if (sink.delays().size() >= sent) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  double secs = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+  double cpu = process_cpu_seconds() - server.thread_cpu_seconds() - cpu_before;
+  running = false;
+  if (reader.joinable()) {
+    reader.join();
+  }
+  client.close();
+  server.stop();
+
+  std::vector<uint64_t> delays = sink.delays();
+  if (delays.empty()) {
+    fprintf(stderr, "%s: no records arrived\n", mode_name(mode));
+    return false;
+  }
+  std::sort(delays.begin(), delays.end());
+  auto ms = [&](double q) {
+    return (double)delays[(size_t)(q * (double)(delays.size() - 1))] /
+           NGTCP2_MILLISECONDS;
+  };
+  out->records = delays.size();
+  out->p50_ms = ms(0.5);
+  out->p99_ms = ms(0.99);
+  out->max_ms = ms(1.0);
+  out->cpu_ms_per_s = cpu * 1000 / secs;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int seconds = argc > 1 ? atoi(argv[1]) : 5;
+  int interval_ms = argc > 2 ? atoi(argv[2]) : 2;
+  int poll_ms = argc > 3 ? atoi(argv[3]) : 5;
+  setenv("MQTT_QUIC_CA_FILE", cert_path("ca.pem").c_str(), 1);
+
+  printf("record every %d ms for %d s, poll every %d ms\n", interval_ms,
+         seconds, poll_ms);
+  printf("%-14s %8s %10s %10s %10s %12s\n", "delivery", "records", "p50 ms",
+         "p99 ms", "max ms", "CPU ms/s");
+  for (Mode mode : {Mode::kPush, Mode::kWait, Mode::kPoll}) {
+    Result r;
+    if (!run(mode, seconds, interval_ms, poll_ms, &r)) {
+      return 1;
+    }
+    printf("%-14s %8zu %10.3f %10.3f %10.3f %12.2f\n", mode_name(mode),
+           r.records, r.p50_ms, r.p99_ms, r.max_ms, r.cpu_ms_per_s);
+  }
+  return 0;
+}
@@ -0,0 +1,101 @@
+//
+// recv_buffer_bench.cpp
+// RecvBuffer against the per-byte std::deque<uint8_t> it replaced: the same
+// stream of ngtcp2-sized chunks is appended and drained through read_stream
+// sized reads. Prints throughput and heap allocations per MB.
+//
+//   recv_buffer_bench [total_mb]
+//
+
+#include "stream_buffers.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <new>
+#include <vector>
+
+using mqttquic::RecvBuffer;
+
+static size_t g_allocs = 0;
+
+void *operator new(size_t n) {
+  ++g_allocs;
+  if (void *p = std::malloc(n ? n : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+// The receive path before RecvBuffer: one push_back per byte on arrival,
+// front()/pop_front() per byte on read.
+struct ByteDeque {
+  std::deque<uint8_t> q;
+
+  void append(const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+      q.push_back(data[i]);
+    }
+  }
+
+  size_t read(uint8_t *out, size_t maxlen) {
+    size_t n = 0;
+    while (n < maxlen && !q.empty()) {
+      out[n++] = q.front();
+      q.pop_front();
+    }
+    return n;
+  }
+};
+
+struct Result {
+  double mb_per_s;
+  double allocs_per_mb;
+};
+
+// Appends `backlog` chunks, then reads 8 KB (nativeReadStream's buffer)
+// until drained, repeating until total bytes have gone through.
+template <typename Buffer>
+Result run(size_t chunk, size_t backlog, size_t total) {
+  std::vector<uint8_t> in(chunk, 0x5a);
+  std::vector<uint8_t> out(8192);
+  Buffer buf;
+  size_t moved = 0;
+  size_t allocs = g_allocs;
+  auto start = std::chrono::steady_clock::now();
+  while (moved < total) {
+    for (size_t i = 0; i < backlog; i++) {
+      buf.append(in.data(), in.size());
+    }
+    size_t n;
+    while ((n = buf.read(out.data(), out.size())) > 0) {
+      moved += n;
+    }
+  }
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double mb = (double)moved / (1024 * 1024);
+  return {mb / secs, (double)(g_allocs - allocs) / mb};
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  size_t total = (size_t)(argc > 1 ? atoi(argv[1]) : 256) * 1024 * 1024;
+  printf("%-8s %-8s %14s %14s %14s %14s\n", "chunk", "backlog", "deque MB/s",
+         "segment MB/s", "deque alloc/MB", "segment alloc/MB");
+  for (size_t chunk : {64, 1200, 16384}) {
+    for (size_t backlog : {1, 16}) {
+      Result d = run<ByteDeque>(chunk, backlog, total);
+      Result s = run<RecvBuffer>(chunk, backlog, total);
+      printf("%-8zu %-8zu %14.1f %14.1f %14.1f %14.1f\n", chunk, backlog,
+             d.mb_per_s, s.mb_per_s, d.allocs_per_mb, s.allocs_per_mb);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,130 @@
+//
+// resume_bench.cpp
+// Reconnect latency with session resumption off and on: each round opens a
+// new QuicClient to the same loopback server, writes a CONNECT-sized packet
+// and waits for the server's CONNACK-sized reply, as the MQTT client does
+// on every reconnect. With resumption the CONNECT rides in 0-RTT, so the
+// reply should come one round trip sooner. The server's one-way delay on
+// client datagrams stands in for the round trip.
+//
+//   resume_bench [rounds] [delay_ms]
+//
+
+#include "ngtcp2_jni.cpp"
+
+#include "loopback_server.h"
+
+namespace {
+
+using mqttquic_test::Impairment;
+using mqttquic_test::LoopbackServer;
+
+const uint8_t kConnect[] = {0x10, 0x10, 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x05,
+                            0x02, 0x00, 0x3c, 0x00, 0x00, 0x03, 'b', 'e',
+                            'n'};
+const uint8_t kConnack[] = {0x20, 0x03, 0x00, 0x00, 0x00};
+
+std::string cert_path(const char *name) {
+  return std::string(TEST_CERT_DIR) + "/" + name;
+}
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start).count();
+}
+
+struct Result {
+  std::vector<double> connect_ms;  // connect() returning
+  std::vector<double> reply_ms;    // CONNACK arriving
+  int resumed = 0;
+  int early_data = 0;
+};
+
+double percentile(std::vector<double> v, double q) {
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(q * (double)(v.size() - 1))];
+}
+
+bool run(bool resumption, int rounds, Impairment impairment, Result *out) {
+  LoopbackServer server(cert_path("server.pem"), cert_path("server-key.pem"));
+  server.set_early_data(true);
+  server.set_impairment(impairment);
+  server.set_stream_handler(
+      [&](int64_t stream_id, const uint8_t *data, size_t len, bool fin) {
+        if (len > 0) {
+          server.send_stream(stream_id,
+                             std::vector<uint8_t>(kConnack,
+                                                  kConnack + sizeof(kConnack)));
+        }
+      });
+  if (!server.start()) {
+    fprintf(stderr, "server: %s\n", server.error().c_str());
+    return false;
+  }
+
+  // Round 0 is a full handshake either way; it only fetches a ticket.
+  for (int round = 0; round <= rounds; round++) {
+    QuicClient client("localhost", "127.0.0.1", server.port());
+    client.set_session_resumption(resumption);
+    client.set_mqtt_framing(true);
+    auto start = std::chrono::steady_clock::now();
+    if (client.connect("mqtt") != 0) {
+      fprintf(stderr, "client: %s\n", client.last_error());
+      return false;
+    }
+    double connect_ms = ms_since(start);
+    int64_t stream_id = client.open_stream();
+    std::vector<uint8_t> reply;
+    if (stream_id < 0 ||
+        client.write_stream(stream_id, kConnect, sizeof(kConnect), false) !=
+            0 ||
+        client.read_packet(stream_id, reply, 10 * NGTCP2_SECONDS) != 1) {
+      fprintf(stderr, "round %d: %s\n", round, client.last_error());
+      return false;
+    }
+    double reply_ms = ms_since(start);
+
+    // The next ticket comes after the handshake completes, which with
+    // 0-RTT can be after the reply; give it a round trip to land.
+    for (int i = 0; i < 10000 && !client.is_connected(); i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(2 * impairment.delay_ms + 10));
+    ClientStats st = client.stats();
+    client.close();
+    if (round == 0) {
+      continue;
+    }
+    out->connect_ms.push_back(connect_ms);
+    out->reply_ms.push_back(reply_ms);
+    out->resumed += st.session_resumed ? 1 : 0;
+    out->early_data += st.early_data_accepted ? 1 : 0;
+  }
+  server.stop();
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int rounds = std::max(argc > 1 ? atoi(argv[1]) : 20, 1);
+  Impairment impairment;
+  impairment.delay_ms = (uint64_t)(argc > 2 ? atoi(argv[2]) : 50);
+  setenv("MQTT_QUIC_CA_FILE", cert_path("ca.pem").c_str(), 1);
+
+  printf("%d reconnects per run, %llu ms delay\n", rounds,
+         (unsigned long long)impairment.delay_ms);
+  printf("%-11s %8s %8s %12s %12s %12s\n", "resumption", "resumed", "0-RTT",
+         "connect ms", "CONNACK p50", "CONNACK p99");
+  for (bool resumption : {false, true}) {
+    Result r;
+    if (!run(resumption, rounds, impairment, &r)) {
+      return 1;
+    }
+    printf("%-11s %8d %8d %12.1f %12.1f %12.1f\n", resumption ? "on" : "off",
+           r.resumed, r.early_data, percentile(r.connect_ms, 0.5),
+           percentile(r.reply_ms, 0.5), percentile(r.reply_ms, 0.99));
+  }
+  return 0;
+}
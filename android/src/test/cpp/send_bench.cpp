@@ -0,0 +1,110 @@
+//
+// send_bench.cpp
+// Bulk upload through QuicClient to the loopback server, with packet trains
+// (UDP GSO, else sendmmsg) and with one send() per packet. Prints
+// throughput, packets per send syscall and client CPU per MB; the server
+// thread's CPU is taken out of the process total.
+//
+//   send_bench [total_mb] [write_kb]
+//
+
+#include "ngtcp2_jni.cpp"
+
+#include "loopback_server.h"
+
+#include <sys/resource.h>
+
+namespace {
+
+using mqttquic_test::LoopbackServer;
+
+// Caps what write_stream may queue ahead of the network, like the MQTT
+// client's own flow.
+constexpr uint64_t kMaxQueued = 4 * 1024 * 1024;
+
+std::string cert_path(const char *name) {
+  return std::string(TEST_CERT_DIR) + "/" + name;
+}
+
+double process_cpu_seconds() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+         (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+struct Result {
+  double mb_per_s;
+  double pkts_per_syscall;
+  double cpu_ms_per_mb;
+};
+
+bool run(bool batching, size_t total, size_t write_size, Result *out) {
+  LoopbackServer server(cert_path("server.pem"), cert_path("server-key.pem"));
+  std::atomic<uint64_t> received{0};
+  server.set_stream_handler(
+      [&](int64_t stream_id, const uint8_t *data, size_t len, bool fin) {
+        received.fetch_add(len, std::memory_order_relaxed);
+      });
+  if (!server.start()) {
+    fprintf(stderr, "server: %s\n", server.error().c_str());
+    return false;
+  }
+
+  QuicClient client("localhost", "127.0.0.1", server.port());
+  client.set_send_batching(batching);
+  int64_t stream_id;
+  if (client.connect("mqtt") != 0 || (stream_id = client.open_stream()) < 0) {
+    fprintf(stderr, "client: %s\n", client.last_error());
+    return false;
+  }
+
+  std::vector<uint8_t> chunk(write_size, 0x5a);
+  ClientStats before = client.stats();
+  double cpu_before = process_cpu_seconds() - server.thread_cpu_seconds();
+  auto start = std::chrono::steady_clock::now();
+  for (size_t queued = 0; queued < total; queued += chunk.size()) {
+    while (client.stats().stream_bytes_sent + kMaxQueued <
+           before.stream_bytes_sent + queued) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    client.write_stream(stream_id, chunk.data(), chunk.size(), false);
+  }
+  while (received.load(std::memory_order_relaxed) < total) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  double secs =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double cpu = process_cpu_seconds() - server.thread_cpu_seconds() - cpu_before;
+  ClientStats after = client.stats();
+  client.close();
+  server.stop();
+
+  double mb = (double)total / (1024 * 1024);
+  uint64_t syscalls = after.send_syscalls - before.send_syscalls;
+  out->mb_per_s = mb / secs;
+  out->pkts_per_syscall = syscalls
+      ? (double)(after.send_packets - before.send_packets) / (double)syscalls
+      : 0;
+  out->cpu_ms_per_mb = cpu * 1000 / mb;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  size_t total = (size_t)(argc > 1 ? atoi(argv[1]) : 256) * 1024 * 1024;
+  size_t write_size = (size_t)(argc > 2 ? atoi(argv[2]) : 64) * 1024;
+  setenv("MQTT_QUIC_CA_FILE", cert_path("ca.pem").c_str(), 1);
+
+  printf("%-10s %10s %14s %12s\n", "send", "MB/s", "pkts/syscall", "CPU ms/MB");
+  for (bool batching : {true, false}) {
+    Result r;
+    if (!run(batching, total, write_size, &r)) {
+      return 1;
+    }
+    printf("%-10s %10.1f %14.2f %12.2f\n", batching ? "train" : "per-packet",
+           r.mb_per_s, r.pkts_per_syscall, r.cpu_ms_per_mb);
+  }
+  return 0;
+}
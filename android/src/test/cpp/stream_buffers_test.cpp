@@ -0,0 +1,322 @@
+//
+// stream_buffers_test.cpp
+// Unit tests for the receive buffers in stream_buffers.h.
+//
+
+#include "stream_buffers.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+
+using mqttquic::MqttFramer;
+using mqttquic::RecvBuffer;
+
+namespace {
+
+std::vector<uint8_t> pattern(size_t len, uint8_t seed) {
+  std::vector<uint8_t> v(len);
+  for (size_t i = 0; i < len; i++) {
+    v[i] = (uint8_t)(seed + i * 7);
+  }
+  return v;
+}
+
+std::vector<uint8_t> read_all(RecvBuffer &buf, size_t chunk) {
+  std::vector<uint8_t> out;
+  std::vector<uint8_t> tmp(chunk);
+  size_t n;
+  while ((n = buf.read(tmp.data(), tmp.size())) > 0) {
+    out.insert(out.end(), tmp.begin(), tmp.begin() + (ptrdiff_t)n);
+  }
+  return out;
+}
+
+// Fixed header with the remaining length encoded as MQTT does.
+std::vector<uint8_t> mqtt_packet(uint8_t type, size_t body_len) {
+  std::vector<uint8_t> p{type};
+  size_t len = body_len;
+  do {
+    uint8_t b = len % 128;
+    len /= 128;
+    p.push_back(len > 0 ? (uint8_t)(b | 0x80) : b);
+  } while (len > 0);
+  std::vector<uint8_t> body = pattern(body_len, type);
+  p.insert(p.end(), body.begin(), body.end());
+  return p;
+}
+
+std::vector<std::vector<uint8_t>> pop_all(MqttFramer &framer) {
+  std::vector<std::vector<uint8_t>> out;
+  std::vector<uint8_t> p;
+  while (framer.pop(p)) {
+    out.push_back(p);
+  }
+  return out;
+}
+
+}  // namespace
+
+TEST(RecvBufferTest, EmptyReadsNothing) {
+  RecvBuffer buf;
+  uint8_t out[8];
+  EXPECT_TRUE(buf.empty());
+  EXPECT_EQ(buf.read(out, sizeof(out)), 0u);
+  buf.append(out, 0);
+  EXPECT_TRUE(buf.empty());
+  EXPECT_EQ(buf.read(out, sizeof(out)), 0u);
+}
+
+TEST(RecvBufferTest, ReadsSpanChunksInOrder) {
+  RecvBuffer buf;
+  std::vector<uint8_t> want;
+  for (uint8_t i = 0; i < 5; i++) {
+    std::vector<uint8_t> chunk = pattern(100 + i * 37, i);
+    buf.append(chunk.data(), chunk.size());
+    want.insert(want.end(), chunk.begin(), chunk.end());
+  }
+  EXPECT_EQ(buf.size(), want.size());
+  // 33-byte reads cut every chunk at a different offset.
+  EXPECT_EQ(read_all(buf, 33), want);
+  EXPECT_TRUE(buf.empty());
+}
+
+TEST(RecvBufferTest, ZeroLengthReadLeavesData) {
+  RecvBuffer buf;
+  std::vector<uint8_t> chunk = pattern(10, 1);
+  buf.append(chunk.data(), chunk.size());
+  uint8_t out[1];
+  EXPECT_EQ(buf.read(out, 0), 0u);
+  EXPECT_EQ(buf.size(), 10u);
+}
+
+TEST(RecvBufferTest, ChunkLargerThanSegment) {
+  RecvBuffer buf;
+  std::vector<uint8_t> big = pattern(RecvBuffer::kMinSegmentSize * 3 + 5, 9);
+  std::vector<uint8_t> small = pattern(17, 3);
+  buf.append(small.data(), small.size());
+  buf.append(big.data(), big.size());
+  std::vector<uint8_t> want = small;
+  want.insert(want.end(), big.begin(), big.end());
+  EXPECT_EQ(read_all(buf, 1000), want);
+}
+
+// Drained segments go to the spare list and come back for later chunks;
+// data must survive any number of such round trips, including reads that
+// stop exactly on a segment end and appends that partly fill a recycled
+// segment's tail.
+TEST(RecvBufferTest, RecycledSegmentsWrapAround) {
+  RecvBuffer buf;
+  std::deque<uint8_t> model;
+  const size_t seg = RecvBuffer::kMinSegmentSize;
+  const size_t sizes[] = {seg, seg - 1, 1, seg + 1, seg / 2, 3 * seg};
+  uint8_t seed = 0;
+  for (int round = 0; round < 50; round++) {
+    for (size_t len : sizes) {
+      std::vector<uint8_t> chunk = pattern(len, seed++);
+      buf.append(chunk.data(), chunk.size());
+      model.insert(model.end(), chunk.begin(), chunk.end());
+    }
+    // Leave a remainder behind every round so the head segment is partly
+    // consumed when the next appends arrive.
+    std::vector<uint8_t> out(model.size() - seg / 3);
+    ASSERT_EQ(buf.read(out.data(), out.size()), out.size());
+    for (uint8_t b : out) {
+      ASSERT_EQ(b, model.front());
+      model.pop_front();
+    }
+    ASSERT_EQ(buf.size(), model.size());
+  }
+  std::vector<uint8_t> rest = read_all(buf, seg);
+  EXPECT_EQ(rest, std::vector<uint8_t>(model.begin(), model.end()));
+}
+
+// Random appends and reads against a byte deque, the buffer this one
+// replaced.
+TEST(RecvBufferTest, MatchesByteDeque) {
+  std::mt19937 rng(12345);
+  RecvBuffer buf;
+  std::deque<uint8_t> model;
+  std::vector<uint8_t> out;
+  for (int i = 0; i < 20000; i++) {
+    if (rng() % 2 == 0) {
+      std::vector<uint8_t> chunk = pattern(rng() % 3000, (uint8_t)i);
+      buf.append(chunk.data(), chunk.size());
+      model.insert(model.end(), chunk.begin(), chunk.end());
+    } else {
+      out.resize(rng() % 5000);
+      size_t n = buf.read(out.data(), out.size());
+      ASSERT_EQ(n, std::min(out.size(), model.size()));
+      for (size_t j = 0; j < n; j++) {
+        ASSERT_EQ(out[j], model.front());
+        model.pop_front();
+      }
+    }
+    ASSERT_EQ(buf.size(), model.size());
+  }
+}
+
+TEST(MqttFramerTest, WholePacketsInOneFeed) {
+  std::vector<uint8_t> a = mqtt_packet(0x30, 10);
+  std::vector<uint8_t> b = mqtt_packet(0xd0, 0);  // PINGRESP, empty body
+  std::vector<uint8_t> c = mqtt_packet(0x40, 2);
+  std::vector<uint8_t> all = a;
+  all.insert(all.end(), b.begin(), b.end());
+  all.insert(all.end(), c.begin(), c.end());
+  MqttFramer framer;
+  ASSERT_TRUE(framer.feed(all.data(), all.size()));
+  EXPECT_TRUE(framer.idle());
+  EXPECT_EQ(framer.size(), all.size());
+  EXPECT_EQ(pop_all(framer), (std::vector<std::vector<uint8_t>>{a, b, c}));
+  EXPECT_EQ(framer.size(), 0u);
+}
+
+TEST(MqttFramerTest, ByteAtATime) {
+  std::vector<std::vector<uint8_t>> want = {
+      mqtt_packet(0x30, 0), mqtt_packet(0x32, 127), mqtt_packet(0x30, 128),
+      mqtt_packet(0x90, 3), mqtt_packet(0x30, 16384)};
+  MqttFramer framer;
+  std::vector<std::vector<uint8_t>> got;
+  for (const auto &p : want) {
+    for (size_t i = 0; i < p.size(); i++) {
+      ASSERT_TRUE(framer.feed(&p[i], 1));
+      // Nothing is readable until the last byte of the packet is in.
+      ASSERT_EQ(framer.has_packet(), i + 1 == p.size());
+      ASSERT_EQ(framer.idle(), i + 1 == p.size());
+    }
+    std::vector<uint8_t> out;
+    ASSERT_TRUE(framer.pop(out));
+    got.push_back(out);
+  }
+  EXPECT_EQ(got, want);
+}
+
+// Remaining length boundaries: 1 byte up to 127, 4 bytes from 2,097,152.
+TEST(MqttFramerTest, RemainingLengthEncodings) {
+  for (size_t len : {(size_t)0, (size_t)127, (size_t)128, (size_t)16383,
+                     (size_t)16384, (size_t)2097151, (size_t)2097152}) {
+    std::vector<uint8_t> p = mqtt_packet(0x30, len);
+    MqttFramer framer;
+    // Header split from the body, body in two halves.
+    size_t header = p.size() - len;
+    ASSERT_TRUE(framer.feed(p.data(), header));
+    ASSERT_TRUE(framer.feed(p.data() + header, len / 2));
+    EXPECT_EQ(framer.has_packet(), len == 0) << len;
+    ASSERT_TRUE(framer.feed(p.data() + header + len / 2, len - len / 2));
+    std::vector<uint8_t> out;
+    ASSERT_TRUE(framer.pop(out)) << len;
+    EXPECT_EQ(out.size(), p.size()) << len;
+    EXPECT_TRUE(out == p) << len;
+  }
+}
+
+TEST(MqttFramerTest, HeaderSplitAcrossFeeds) {
+  std::vector<uint8_t> p = mqtt_packet(0x30, 300000);  // 3-byte length
+  MqttFramer framer;
+  ASSERT_TRUE(framer.feed(p.data(), 1));
+  ASSERT_TRUE(framer.feed(p.data() + 1, 2));
+  EXPECT_FALSE(framer.idle());
+  ASSERT_TRUE(framer.feed(p.data() + 3, p.size() - 3));
+  std::vector<uint8_t> out;
+  ASSERT_TRUE(framer.pop(out));
+  EXPECT_TRUE(out == p);
+}
+
+// partial_size tracks the packet still arriving, header first, and drops
+// to what is left over once it completes.
+TEST(MqttFramerTest, PartialSize) {
+  std::vector<uint8_t> a = mqtt_packet(0x30, 300000);  // 3-byte length
+  std::vector<uint8_t> b = mqtt_packet(0x30, 10);
+  MqttFramer framer;
+  EXPECT_EQ(framer.partial_size(), 0u);
+  ASSERT_TRUE(framer.feed(a.data(), 2));
+  EXPECT_EQ(framer.partial_size(), 2u);
+  ASSERT_TRUE(framer.feed(a.data() + 2, 1000));
+  EXPECT_EQ(framer.partial_size(), 1002u);
+  EXPECT_EQ(framer.size(), 0u);
+  std::vector<uint8_t> rest(a.begin() + 1002, a.end());
+  rest.insert(rest.end(), b.begin(), b.begin() + 5);
+  ASSERT_TRUE(framer.feed(rest.data(), rest.size()));
+  EXPECT_EQ(framer.size(), a.size());
+  EXPECT_EQ(framer.partial_size(), 5u);
+  ASSERT_TRUE(framer.feed(b.data() + 5, b.size() - 5));
+  EXPECT_EQ(framer.partial_size(), 0u);
+  EXPECT_EQ(framer.size(), a.size() + b.size());
+}
+
+// A fourth length byte with the continuation bit set would be a fifth
+// length byte, which MQTT does not allow.
+TEST(MqttFramerTest, FifthLengthByteIsMalformed) {
+  const uint8_t bad[] = {0x30, 0xff, 0xff, 0xff, 0x80, 0x01};
+  MqttFramer framer;
+  EXPECT_FALSE(framer.feed(bad, sizeof(bad)));
+  EXPECT_FALSE(framer.has_packet());
+
+  MqttFramer bytewise;
+  bool ok = true;
+  for (uint8_t b : bad) {
+    ok = bytewise.feed(&b, 1);
+    if (!ok) {
+      break;
+    }
+  }
+  EXPECT_FALSE(ok);
+}
+
+// The largest length MQTT allows (268,435,455) is accepted without
+// reserving it up front.
+TEST(MqttFramerTest, MaximumLengthHeaderAccepted) {
+  const uint8_t header[] = {0x30, 0xff, 0xff, 0xff, 0x7f};
+  MqttFramer framer;
+  EXPECT_TRUE(framer.feed(header, sizeof(header)));
+  EXPECT_FALSE(framer.has_packet());
+  EXPECT_FALSE(framer.idle());
+  EXPECT_EQ(framer.size(), 0u);
+}
+
+// read_packet's -2 path: front_size reports the whole packet so the caller
+// can size its buffer, and byte reads may take part of a packet first.
+TEST(MqttFramerTest, FrontSizeAndPartialReads) {
+  std::vector<uint8_t> a = mqtt_packet(0x30, 40);
+  std::vector<uint8_t> b = mqtt_packet(0x30, 5);
+  MqttFramer framer;
+  ASSERT_TRUE(framer.feed(a.data(), a.size()));
+  ASSERT_TRUE(framer.feed(b.data(), b.size()));
+  EXPECT_EQ(framer.front_size(), a.size());
+
+  uint8_t head[10];
+  ASSERT_EQ(framer.read(head, sizeof(head)), sizeof(head));
+  EXPECT_TRUE(std::equal(head, head + sizeof(head), a.begin()));
+  EXPECT_EQ(framer.front_size(), a.size() - sizeof(head));
+  EXPECT_EQ(framer.size(), a.size() + b.size() - sizeof(head));
+
+  std::vector<uint8_t> rest;
+  ASSERT_TRUE(framer.pop(rest));
+  EXPECT_TRUE(rest == std::vector<uint8_t>(a.begin() + sizeof(head), a.end()));
+  EXPECT_EQ(framer.front_size(), b.size());
+
+  // A read may run across packet boundaries.
+  std::vector<uint8_t> tail(b.size() + 10);
+  EXPECT_EQ(framer.read(tail.data(), tail.size()), b.size());
+  EXPECT_EQ(framer.front_size(), 0u);
+  EXPECT_EQ(framer.size(), 0u);
+}
+
+// Packets pushed from elsewhere (DATAGRAM frames) queue behind the ones
+// completed so far and do not disturb a partly received one.
+TEST(MqttFramerTest, PushedPacketsKeepOrder) {
+  std::vector<uint8_t> a = mqtt_packet(0x30, 3);
+  std::vector<uint8_t> b = mqtt_packet(0x32, 20);
+  std::vector<uint8_t> d = mqtt_packet(0x30, 1);
+  MqttFramer framer;
+  ASSERT_TRUE(framer.feed(a.data(), a.size()));
+  ASSERT_TRUE(framer.feed(b.data(), 4));
+  framer.push_packet(d);
+  EXPECT_FALSE(framer.idle());
+  EXPECT_EQ(framer.size(), a.size() + d.size());
+  ASSERT_TRUE(framer.feed(b.data() + 4, b.size() - 4));
+  EXPECT_EQ(pop_all(framer), (std::vector<std::vector<uint8_t>>{a, d, b}));
+}
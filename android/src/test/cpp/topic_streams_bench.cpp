@@ -0,0 +1,236 @@
+//
+// topic_streams_bench.cpp
+// Head-of-line blocking between topics: small timestamped PUBLISH packets
+// on a few sensor topics share the connection with a bulk topic sending
+// 64 KB PUBLISH packets, over emulated loss and delay. Runs once with every
+// topic on one stream and once with topics spread over streams by FNV-1a
+// (the client's dataStreams mapping), and prints the delivery delay of the
+// small messages.
+//
+//   topic_streams_bench [seconds] [loss_percent] [delay_ms] [streams]
+//
+
+#include "ngtcp2_jni.cpp"
+
+#include "loopback_server.h"
+
+namespace {
+
+using mqttquic_test::Impairment;
+using mqttquic_test::LoopbackServer;
+
+// Cap on bulk data queued ahead of the network, as in send_bench.
+constexpr uint64_t kMaxQueued = 1024 * 1024;
+constexpr size_t kBulkPayload = 64 * 1024;
+constexpr auto kProbeInterval = std::chrono::milliseconds(5);
+
+// Each lands on its own slot of four, away from the bulk topic.
+const char *const kProbeTopics[] = {"sensors/temp", "sensors/humidity",
+                                    "sensors/power"};
+const char *const kBulkTopic = "camera/frames";
+
+std::string cert_path(const char *name) {
+  return std::string(TEST_CERT_DIR) + "/" + name;
+}
+
+// Same as MQTTClient.topicHash on Android and iOS.
+uint32_t topic_hash(const std::string &topic) {
+  uint32_t h = 0x811c9dc5u;
+  for (unsigned char c : topic) {
+    h = (h ^ c) * 0x01000193u;
+  }
+  return h;
+}
+
+// QoS 0 PUBLISH.
+std::vector<uint8_t> build_publish(const std::string &topic,
+                                   const uint8_t *payload, size_t len) {
+  size_t remaining = 2 + topic.size() + len;
+  std::vector<uint8_t> out;
+  out.reserve(remaining + 5);
+  out.push_back(0x30);
+  do {
+    uint8_t b = remaining & 0x7f;
+    remaining >>= 7;
+    out.push_back(remaining ? (b | 0x80) : b);
+  } while (remaining);
+  out.push_back((uint8_t)(topic.size() >> 8));
+  out.push_back((uint8_t)topic.size());
+  out.insert(out.end(), topic.begin(), topic.end());
+  out.insert(out.end(), payload, payload + len);
+  return out;
+}
+
+// Frames each stream on the server thread and records how long every
+// sensor message took from write_stream to arrival.
+class DelaySink {
+ public:
+  void on_data(int64_t stream_id, const uint8_t *data, size_t len) {
+    uint64_t arrived = now_ts();
+    MqttFramer &framer = framers_[stream_id];
+    framer.feed(data, len);
+    std::vector<uint8_t> packet;
+    while (framer.pop(packet)) {
+      size_t off = 1;
+      while (packet[off++] & 0x80) {
+      }
+      size_t topic_len = ((size_t)packet[off] << 8) | packet[off + 1];
+      off += 2;
+      if (topic_len == strlen(kBulkTopic) &&
+          memcmp(packet.data() + off, kBulkTopic, topic_len) == 0) {
+        continue;
+      }
+      uint64_t sent;
+      memcpy(&sent, packet.data() + off + topic_len, 8);
+      std::lock_guard<std::mutex> lock(mutex_);
+      delays_ns_.push_back(arrived - sent);
+    }
+  }
+
+  std::vector<uint64_t> delays() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return delays_ns_;
+  }
+
+ private:
+  std::map<int64_t, MqttFramer> framers_;  // server thread only
+  std::mutex mutex_;
+  std::vector<uint64_t> delays_ns_;
+};
+
+struct Result {
+  size_t probes;
+  double p50_ms;
+  double p99_ms;
+  double max_ms;
+  double bulk_mb_per_s;
+};
+
+bool run(int streams, int seconds, Impairment impairment, Result *out) {
+  LoopbackServer server(cert_path("server.pem"), cert_path("server-key.pem"));
+  DelaySink sink;
+  server.set_stream_handler(
+      [&](int64_t stream_id, const uint8_t *data, size_t len, bool fin) {
+        sink.on_data(stream_id, data, len);
+      });
+  server.set_impairment(impairment);
+  if (!server.start()) {
+    fprintf(stderr, "server: %s\n", server.error().c_str());
+    return false;
+  }
+
+  QuicClient client("localhost", "127.0.0.1", server.port());
+  if (client.connect("mqtt") != 0) {
+    fprintf(stderr, "client: %s\n", client.last_error());
+    return false;
+  }
+  std::vector<int64_t> ids;
+  for (int i = 0; i < streams; i++) {
+    int64_t id = client.open_stream();
+    if (id < 0) {
+      fprintf(stderr, "client: %s\n", client.last_error());
+      return false;
+    }
+    ids.push_back(id);
+  }
+  auto stream_for = [&](const std::string &topic) {
+    return ids[topic_hash(topic) % (uint32_t)streams];
+  };
+
+  std::atomic<bool> running{true};
+  std::atomic<uint64_t> bulk_bytes{0};
+  std::thread bulk([&]() {
+    std::vector<uint8_t> payload(kBulkPayload, 0x5a);
+    std::vector<uint8_t> packet =
+        build_publish(kBulkTopic, payload.data(), payload.size());
+    int64_t id = stream_for(kBulkTopic);
+    uint64_t base = client.stats().stream_bytes_sent;
+    uint64_t queued = 0;
+    while (running) {
+      if (client.stats().stream_bytes_sent - base + kMaxQueued < queued) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        continue;
+      }
+      if (client.write_stream(id, packet.data(), packet.size(), false) != 0) {
+        return;
+      }
+      queued += packet.size();
+      bulk_bytes += packet.size();
+    }
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + std::chrono::seconds(seconds);
+  size_t sent = 0;
+  while (std::chrono::steady_clock::now() < deadline) {
+    for (const char *topic : kProbeTopics) {
+      uint64_t ts = now_ts();
+      std::vector<uint8_t> packet =
+          build_publish(topic, (const uint8_t *)&ts, sizeof(ts));
+      client.write_stream(stream_for(topic), packet.data(), packet.size(),
+                          false);
+      sent++;
+    }
+    std::this_thread::sleep_for(kProbeInterval);
+  }
+  running = false;
+  bulk.join();
+  double secs = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+
+  // Let the sensor messages still queued behind bulk data arrive.
+  std::vector<uint64_t> delays;
+  for (int i = 0; i < 300 && (delays = sink.delays()).size() < sent; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  client.close();
+  server.stop();
+  if (delays.empty()) {
+    fprintf(stderr, "no sensor messages arrived\n");
+    return false;
+  }
+
+  std::sort(delays.begin(), delays.end());
+  auto ms = [&](double q) {
+    return (double)delays[(size_t)(q * (double)(delays.size() - 1))] /
+           NGTCP2_MILLISECONDS;
+  };
+  out->probes = delays.size();
+  out->p50_ms = ms(0.5);
+  out->p99_ms = ms(0.99);
+  out->max_ms = ms(1.0);
+  out->bulk_mb_per_s = (double)bulk_bytes / (1024 * 1024) / secs;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int seconds = argc > 1 ? atoi(argv[1]) : 5;
+  Impairment impairment;
+  impairment.loss = (argc > 2 ? atof(argv[2]) : 1.0) / 100;
+  impairment.delay_ms = (uint64_t)(argc > 3 ? atoi(argv[3]) : 20);
+  int streams = argc > 4 ? atoi(argv[4]) : 4;
+  setenv("MQTT_QUIC_CA_FILE", cert_path("ca.pem").c_str(), 1);
+
+  printf("%.1f%% loss, %llu ms delay, %d s per run\n", impairment.loss * 100,
+         (unsigned long long)impairment.delay_ms, seconds);
+  for (const char *topic : kProbeTopics) {
+    printf("  %-18s stream %u of %d\n", topic, topic_hash(topic) % streams,
+           streams);
+  }
+  printf("  %-18s stream %u of %d (bulk)\n", kBulkTopic,
+         topic_hash(kBulkTopic) % streams, streams);
+
+  printf("%-8s %8s %10s %10s %10s %10s\n", "streams", "msgs", "p50 ms",
+         "p99 ms", "max ms", "bulk MB/s");
+  for (int n : {1, streams}) {
+    Result r;
+    if (!run(n, seconds, impairment, &r)) {
+      return 1;
+    }
+    printf("%-8d %8zu %10.2f %10.2f %10.2f %10.1f\n", n, r.probes, r.p50_ms,
+           r.p99_ms, r.max_ms, r.bulk_mb_per_s);
+  }
+  return 0;
+}
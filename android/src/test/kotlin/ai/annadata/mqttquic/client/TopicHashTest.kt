@@ -0,0 +1,21 @@
+package ai.annadata.mqttquic.client
+
+import org.junit.Assert.assertEquals
+import org.junit.Test
+
+class TopicHashTest {
+
+    /** Published 32-bit FNV-1a vectors; iOS checks the same ones, so both pick the same data stream. */
+    @Test
+    fun knownVectors() {
+        assertEquals(0x811c9dc5u, MQTTClient.topicHash(""))
+        assertEquals(0xe40c292cu, MQTTClient.topicHash("a"))
+        assertEquals(0xbf9cf968u, MQTTClient.topicHash("foobar"))
+    }
+
+    @Test
+    fun hashesUtf8Bytes() {
+        assertEquals(0xc0cac0f0u, MQTTClient.topicHash("sensors/température"))
+        assertEquals(0x123b6cc3u, MQTTClient.topicHash("home/+/状态"))
+    }
+}
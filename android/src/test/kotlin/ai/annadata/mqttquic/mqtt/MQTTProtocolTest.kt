@@ -89,4 +89,14 @@ class MQTTProtocolTest {
         val written = buf.consumeWrite()
         assertEquals(byteArrayOf(6, 7, 8).toList(), written.toList())
     }
+
+    @Test
+    fun readPacketFramesBackToBackPackets() = runBlocking {
+        val big = MQTTProtocol.buildPublish("t/big", ByteArray(300) { it.toByte() })
+        val small = MQTTProtocol.buildPingresp()
+        val reader = MockStreamReader(MockStreamBuffer(big + small))
+
+        assertEquals(big.toList(), reader.readPacket().toList())
+        assertEquals(small.toList(), reader.readPacket().toList())
+    }
 }
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""Precompile a PEM CA bundle into the trust-anchor blob the native TLS layer mmaps.
+
+Usage: ./build-ca-store.py bundle.pem [more.pem ...] -o mqttquic_ca.bin
+
+Point caFile (or MQTT_QUIC_CA_FILE) at the output, or drop it next to the bundled
+mqttquic_ca.pem as mqttquic_ca.bin, and connects load the anchors as DER instead of
+decoding PEM. Layout (little-endian), version 2:
+
+  header  "MQCA" | u32 version | u32 count | u32 reserved
+  index   count x { u32 offset | u32 length }
+  data    the DER certificates; offsets are from the start of the file
+
+Native adds every anchor to the TLS context, so the index only records where
+each certificate starts and ends. Identical certificates are stored once (the
+DER bytes are compared here, before writing). Version 1 also had a u64 subject
+hash in front of each index entry; native ignored it and still loads such blobs.
+"""
+
+import argparse
+import base64
+import re
+import struct
+import sys
+
+MAGIC = b"MQCA"
+VERSION = 2
+HEADER = struct.Struct("<4sIII")
+ENTRY = struct.Struct("<II")
+
+PEM_RE = re.compile(
+    rb"-----BEGIN CERTIFICATE-----(.+?)-----END CERTIFICATE-----", re.DOTALL
+)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("bundles", nargs="+", help="PEM files with one or more certificates")
+    parser.add_argument("-o", "--output", required=True, help="blob to write")
+    args = parser.parse_args()
+
+    certs = []
+    seen = set()
+    for path in args.bundles:
+        with open(path, "rb") as f:
+            pem = f.read()
+        for match in PEM_RE.finditer(pem):
+            der = base64.b64decode(b"".join(match.group(1).split()))
+            if der in seen:
+                continue
+            seen.add(der)
+            certs.append(der)
+    if not certs:
+        sys.exit("no certificates found")
+
+    offset = HEADER.size + ENTRY.size * len(certs)
+    index = bytearray()
+    for der in certs:
+        index += ENTRY.pack(offset, len(der))
+        offset += len(der)
+
+    with open(args.output, "wb") as f:
+        f.write(HEADER.pack(MAGIC, VERSION, len(certs), 0))
+        f.write(index)
+        for der in certs:
+            f.write(der)
+    print(f"{args.output}: {len(certs)} anchors, {offset} bytes")
+
+
+if __name__ == "__main__":
+    main()
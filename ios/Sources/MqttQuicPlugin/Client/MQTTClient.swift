@@ -28,6 +28,8 @@ public final class MQTTClient {
     private var activeProtocolVersion: UInt8 = 0  // 0x04 or 0x05
     /// Effective keepalive in seconds (from CONNACK Server Keep Alive, or connect param).
     private var effectiveKeepalive: UInt16 = 0
+    /// True while QUIC PINGs (native timer) keep the connection alive instead of PINGREQ.
+    private var transportKeepaliveActive = false
     /// Assigned Client Identifier from CONNACK when client sent empty ClientID; nil otherwise.
     private var assignedClientIdentifier: String?
     private var quicClient: QuicClientProtocol?
@@ -48,12 +50,35 @@ public final class MQTTClient {
     private var unsubackContinuation: CheckedContinuation<Data, Error>?
     /// Pending PINGRESP for sendMqttPing(). Message loop completes when PINGRESP is read.
     private var pendingPingresp: CheckedContinuation<Void, Error>?
+    /// Data streams (connect's dataStreams option): PUBLISH goes on stream topicHash(topic) % dataStreamCount,
+    /// opened on first use; the stream opened by connect stays the control stream. dataStreamGeneration
+    /// changes on every connect and disconnect so loops of an old connection leave the map alone.
+    private var dataStreamOpens: [Int: Task<MQTTStreamWriterProtocol?, Never>] = [:]
+    /// Reader loop of each opened data stream; cancelled by disconnect.
+    private var dataStreamLoops: [Int: Task<Void, Never>] = [:]
+    private var dataStreamCount = 0
+    /// The broker refused another stream: publishes stay on the control stream until this uptime,
+    /// then one open is tried again. The wait doubles per refusal, up to dataStreamRetryMax.
+    private var dataStreamRetryAt: TimeInterval = 0
+    private var dataStreamRetry = MQTTClient.dataStreamRetryMin
+    private var dataStreamGeneration = 0
+    private static let dataStreamRetryMin: TimeInterval = 0.5
+    private static let dataStreamRetryMax: TimeInterval = 30
     private let lock = NSLock()
 
     public init(protocolVersion: ProtocolVersion = .auto) {
         self.protocolVersion = protocolVersion
     }
 
+    /// 32-bit FNV-1a over the topic's UTF-8 bytes. Same function as Android, so a topic picks the same data stream.
+    static func topicHash(_ topic: String) -> UInt32 {
+        var h: UInt32 = 0x811c9dc5
+        for b in topic.utf8 {
+            h = (h ^ UInt32(b)) &* 0x01000193
+        }
+        return h
+    }
+
     public func getState() -> State {
         lock.lock()
         defer { lock.unlock() }
@@ -74,23 +99,39 @@ public final class MQTTClient {
         return assignedClientIdentifier
     }
 
-    public func connect(host: String, port: UInt16, clientId: String, username: String?, password: String?, cleanSession: Bool, keepalive: UInt16, sessionExpiryInterval: UInt32? = nil) async throws {
+    public func connect(host: String, port: UInt16, clientId: String, username: String?, password: String?, cleanSession: Bool, keepalive: UInt16, sessionExpiryInterval: UInt32? = nil, ccAlgo: CongestionControl = .cubic, transportConfig: QuicTransportConfig = .default, sessionResumption: Bool = false, transportKeepalive: Bool = false, datagrams: Bool = false, dataStreams: Int = 0) async throws {
         lock.lock()
         if case .connecting = state {
             lock.unlock()
             throw MQTTProtocolError.insufficientData("already connecting")
         }
         state = .connecting
+        let oldLoops = takeDataStreams()
+        #if NGTCP2_ENABLED
+        dataStreamCount = max(0, dataStreams)
+        #else
+        dataStreamCount = 0
+        #endif
+        dataStreamRetryAt = 0
+        dataStreamRetry = MQTTClient.dataStreamRetryMin
+        dataStreamGeneration += 1
         lock.unlock()
+        oldLoops.forEach { $0.cancel() }
 
         do {
             // Determine protocol version
             let useV5 = protocolVersion == .v5 || (protocolVersion == .auto)
             
+            // transportKeepalive: native sends QUIC PINGs every keepalive seconds and CONNECT
+            // carries keepalive 0, so no PINGREQ timer runs here. Liveness is the QUIC idle
+            // timeout (1.5x keepalive, as the broker would enforce).
             let quic: QuicClientProtocol
             #if NGTCP2_ENABLED
-            quic = NGTCP2Client()
+            let quicKeepalive = transportKeepalive && keepalive > 0
+            quic = NGTCP2Client(ccAlgo: ccAlgo, transportConfig: transportConfig, sessionResumption: sessionResumption,
+                                keepAliveMs: quicKeepalive ? UInt64(keepalive) * 1000 : 0, datagrams: datagrams)
             #else
+            let quicKeepalive = false
             // Build CONNACK stub (used when ngtcp2 is not linked)
             let connack: Data
             if useV5 {
@@ -119,7 +160,7 @@ public final class MQTTClient {
                     clientId: clientId,
                     username: username,
                     password: password,
-                    keepalive: keepalive,
+                    keepalive: quicKeepalive ? 0 : keepalive,
                     cleanStart: cleanSession,
                     sessionExpiryInterval: sessionExpiryInterval
                 )
@@ -129,7 +170,7 @@ public final class MQTTClient {
                     clientId: clientId,
                     username: username,
                     password: password,
-                    keepalive: keepalive,
+                    keepalive: quicKeepalive ? 0 : keepalive,
                     cleanSession: cleanSession
                 )
                 activeProtocolVersion = MQTTProtocolLevel.v311
@@ -196,11 +237,14 @@ public final class MQTTClient {
                     throw MQTTProtocolError.insufficientData("CONNACK refused: \(reasonCode)")
                 }
                 // [MQTT-3.2.2-21] Use Server Keep Alive from CONNACK if present
+                // A nonzero Server Keep Alive after CONNECT said 0 means the broker still wants PINGREQ.
                 lock.lock()
                 if let sk = props[MQTT5PropertyType.serverKeepAlive.rawValue] as? UInt16 {
                     effectiveKeepalive = sk
+                    transportKeepaliveActive = quicKeepalive && sk == 0
                 } else {
                     effectiveKeepalive = keepalive
+                    transportKeepaliveActive = quicKeepalive
                 }
                 assignedClientIdentifier = props[MQTT5PropertyType.assignedClientIdentifier.rawValue] as? String
                 lock.unlock()
@@ -214,6 +258,7 @@ public final class MQTTClient {
                 }
                 lock.lock()
                 effectiveKeepalive = keepalive
+                transportKeepaliveActive = quicKeepalive
                 lock.unlock()
             }
 
@@ -252,6 +297,27 @@ public final class MQTTClient {
         } else {
             data = try MQTTProtocol.buildPublish(topic: topic, payload: payload, packetId: pid, qos: qos, retain: false)
         }
+        // QoS 0 may go as a QUIC DATAGRAM (connect's datagrams option); the stream otherwise.
+        #if NGTCP2_ENABLED
+        lock.lock()
+        let quic = quicClient as? NGTCP2Client
+        lock.unlock()
+        if qos == 0, let quic = quic, quic.sendDatagram(data) {
+            return
+        }
+        #endif
+        if let (slot, dw) = await dataWriter(topic: topic) {
+            do {
+                try await dw.write(data)
+                try await dw.drain()
+                return
+            } catch {
+                // Only this stream failed (e.g. the broker sent STOP_SENDING); the connection is
+                // still up. Drop the stream so the topic reopens one, and send on the control stream.
+                print("[MqttQuic] data stream write failed, publishing on the control stream: \(error)")
+                await dropDataStream(slot: slot, writer: dw)
+            }
+        }
         do {
             try await w.write(data)
             try await w.drain()
@@ -264,7 +330,9 @@ public final class MQTTClient {
             reader = nil
             writer = nil
             state = .disconnected
+            let loops = takeDataStreams()
             lock.unlock()
+            loops.forEach { $0.cancel() }
             throw error
         }
     }
@@ -334,6 +402,20 @@ public final class MQTTClient {
         }
     }
 
+    /// Keep the session across a network change by migrating the QUIC connection (native only).
+    public func migrate() async throws {
+        guard case .connected = getState() else { throw MQTTProtocolError.insufficientData("not connected") }
+        #if NGTCP2_ENABLED
+        lock.lock()
+        let quic = quicClient as? NGTCP2Client
+        lock.unlock()
+        guard let client = quic else { throw MQTTProtocolError.insufficientData("migration needs the native QUIC client") }
+        try await client.migrate()
+        #else
+        throw MQTTProtocolError.insufficientData("migration needs the native QUIC client")
+        #endif
+    }
+
     public func disconnect() async throws {
         let task = messageLoopTask
         messageLoopTask = nil
@@ -342,6 +424,15 @@ public final class MQTTClient {
         task?.cancel()
         _ = try? await task?.value
 
+        lock.lock()
+        let dataLoops = takeDataStreams()
+        dataStreamGeneration += 1
+        lock.unlock()
+        dataLoops.forEach { $0.cancel() }
+        for loop in dataLoops {
+            await loop.value
+        }
+
         lock.lock()
         let subCont = subackContinuation
         subackContinuation = nil
@@ -462,8 +553,9 @@ public final class MQTTClient {
         keepaliveTask?.cancel()
         lock.lock()
         let ka = effectiveKeepalive
+        let transportActive = transportKeepaliveActive
         lock.unlock()
-        guard ka > 0 else { return }
+        guard ka > 0, !transportActive else { return }
         keepaliveTask = Task { [weak self] in
             guard let self = self else { return }
             while !Task.isCancelled {
@@ -483,6 +575,168 @@ public final class MQTTClient {
         }
     }
 
+    /// Deliver an incoming PUBLISH to its callbacks and send PUBACK (QoS 1) or PUBREC (QoS 2) on
+    /// replyWriter, the stream it arrived on (control or data stream).
+    private func handlePublish(msgType: UInt8, rest: Data, replyWriter: MQTTStreamWriterProtocol?) async {
+        let qos = (msgType >> 1) & 0x03
+        do {
+            let topic: String
+            let packetId: UInt16?
+            let payload: Data
+            lock.lock()
+            let version = activeProtocolVersion
+            if version == MQTTProtocolLevel.v5 {
+                var map = topicAliasMap
+                lock.unlock()
+                (topic, packetId, payload) = try MQTT5Protocol.parsePublishV5(Data(rest), offset: 0, qos: UInt8(qos), topicAliasMap: &map)
+                lock.lock()
+                topicAliasMap = map
+                lock.unlock()
+            } else {
+                lock.unlock()
+                let (t, pid, pl, _) = try MQTTProtocol.parsePublish(Data(rest), offset: 0, qos: UInt8(qos))
+                topic = t
+                packetId = pid
+                payload = pl
+            }
+
+            lock.lock()
+            let cb = subscribedTopics[topic]
+            let globalCb = onPublish
+            lock.unlock()
+            globalCb?(topic, payload)
+            cb?(payload)
+
+            if qos >= 1, let pid = packetId, let replyWriter = replyWriter {
+                let ack = qos == 1 ? MQTTProtocol.buildPuback(packetId: pid) : MQTTProtocol.buildPubrec(packetId: pid)
+                try await replyWriter.write(Data(ack))
+                try await replyWriter.drain()
+            }
+        } catch {
+            // PUBLISH parse failed: log and skip this message (don't disconnect)
+            let hex = rest.prefix(64).map { String(format: "%02x", $0) }.joined()
+            print("[MqttQuic] PUBLISH parse failed: \(error) restLen=\(rest.count) hex=\(hex)")
+        }
+    }
+
+    /// Slot and writer of the data stream for topic, opened on first use, or nil to publish on the
+    /// control stream (data streams off, or the broker's stream limit reached and the retry wait
+    /// not over). A topic always maps to the same stream, so its messages stay in order.
+    private func dataWriter(topic: String) async -> (Int, MQTTStreamWriterProtocol)? {
+        lock.lock()
+        guard dataStreamCount > 0, let quic = quicClient else {
+            lock.unlock()
+            return nil
+        }
+        let slot = Int(MQTTClient.topicHash(topic) % UInt32(dataStreamCount))
+        if let open = dataStreamOpens[slot] {
+            lock.unlock()
+            return await open.value.map { (slot, $0) }
+        }
+        guard ProcessInfo.processInfo.systemUptime >= dataStreamRetryAt else {
+            lock.unlock()
+            return nil
+        }
+        let generation = dataStreamGeneration
+        let open = Task<MQTTStreamWriterProtocol?, Never> { [weak self] in
+            do {
+                let s = try await quic.openStream()
+                let w = QUICStreamWriter(stream: s)
+                self?.lock.lock()
+                self?.dataStreamRetry = MQTTClient.dataStreamRetryMin
+                self?.lock.unlock()
+                self?.startDataStreamLoop(slot: slot, generation: generation, reader: QUICStreamReader(stream: s), writer: w)
+                return w
+            } catch {
+                guard let self = self else { return nil }
+                self.lock.lock()
+                let wait = self.dataStreamRetry
+                if self.dataStreamGeneration == generation {
+                    self.dataStreamRetryAt = ProcessInfo.processInfo.systemUptime + wait
+                    self.dataStreamRetry = min(wait * 2, MQTTClient.dataStreamRetryMax)
+                    self.dataStreamOpens.removeValue(forKey: slot)
+                }
+                self.lock.unlock()
+                print("[MqttQuic] no data stream available, publishing on the control stream for \(wait)s: \(error)")
+                return nil
+            }
+        }
+        dataStreamOpens[slot] = open
+        lock.unlock()
+        return await open.value.map { (slot, $0) }
+    }
+
+    /// Forget slot's stream if it is still writer's, so the next publish on the slot opens a new one.
+    private func dropDataStream(slot: Int, writer: MQTTStreamWriterProtocol) async {
+        lock.lock()
+        let open = dataStreamOpens[slot]
+        lock.unlock()
+        guard let open = open, await open.value === writer else { return }
+        lock.lock()
+        if dataStreamOpens[slot] == open {
+            dataStreamOpens.removeValue(forKey: slot)
+        }
+        lock.unlock()
+    }
+
+    /// Forget all data streams and return their reader loops for the caller to cancel. Call with lock held.
+    private func takeDataStreams() -> [Task<Void, Never>] {
+        let loops = Array(dataStreamLoops.values)
+        dataStreamLoops.removeAll()
+        dataStreamOpens.removeAll()
+        return loops
+    }
+
+    /// Acks for our own publishes, on whichever stream they arrived: PUBREC gets its PUBREL there
+    /// (QoS 2 step 2), PUBACK and PUBCOMP end the flow. publish() does not wait for acks.
+    private func handlePublishAck(type: UInt8, rest: Data, writer: MQTTStreamWriterProtocol?) async throws {
+        guard type == MQTTMessageType.PUBREC.rawValue, let writer = writer else { return }
+        try await writer.write(MQTTProtocol.buildPubrel(packetId: try MQTTProtocol.parsePuback(rest)))
+        try await writer.drain()
+    }
+
+    /// Read a data stream: the broker sends PUBLISH for its topics there too, PUBREL for QoS 2
+    /// ones, and the acks for publishes sent on it. When it ends, the next publish on the slot
+    /// opens a fresh stream.
+    private func startDataStreamLoop(slot: Int, generation: Int, reader: MQTTStreamReaderProtocol, writer: MQTTStreamWriterProtocol) {
+        let loop = Task { [weak self] in
+            guard let self = self else { return }
+            while !Task.isCancelled {
+                do {
+                    let packet = Data(try await reader.readPacket())
+                    let (_, lenBytes) = try MQTTProtocol.decodeRemainingLength(packet, offset: 1)
+                    let msgType = packet[0]
+                    let rest = packet.subdata(in: (1 + lenBytes)..<packet.count)
+                    switch msgType & 0xF0 {
+                    case MQTTMessageType.PUBLISH.rawValue:
+                        await self.handlePublish(msgType: msgType, rest: rest, replyWriter: writer)
+                    case MQTTMessageType.PUBREL.rawValue & 0xF0:
+                        try await writer.write(MQTTProtocol.buildPubcomp(packetId: try MQTTProtocol.parsePubrel(rest)))
+                        try await writer.drain()
+                    case MQTTMessageType.PUBACK.rawValue, MQTTMessageType.PUBREC.rawValue, MQTTMessageType.PUBCOMP.rawValue:
+                        try await self.handlePublishAck(type: msgType & 0xF0, rest: rest, writer: writer)
+                    default:
+                        break
+                    }
+                } catch {
+                    break
+                }
+            }
+            self.lock.lock()
+            if self.dataStreamGeneration == generation {
+                self.dataStreamOpens.removeValue(forKey: slot)
+            }
+            self.lock.unlock()
+        }
+        lock.lock()
+        if dataStreamGeneration == generation {
+            dataStreamLoops[slot] = loop
+        } else {
+            loop.cancel()
+        }
+        lock.unlock()
+    }
+
     private func startMessageLoop() {
         messageLoopTask = Task { [weak self] in
             guard let self = self else { return }
@@ -494,11 +748,11 @@ public final class MQTTClient {
                 guard let r = r else { break }
 
                 do {
-                    let (msgType, remLen, fixed) = try await self.readFixedHeader(r)
-                    let rest = try await r.readexactly(remLen)
+                    let fullPacket = Data(try await r.readPacket())
+                    let (_, lenBytes) = try MQTTProtocol.decodeRemainingLength(fullPacket, offset: 1)
+                    let msgType = fullPacket[0]
+                    let rest = fullPacket.subdata(in: (1 + lenBytes)..<fullPacket.count)
                     let type = msgType & 0xF0
-                    var fullPacket = Data(fixed)
-                    fullPacket.append(rest)
 
                     self.lock.lock()
                     let version = self.activeProtocolVersion
@@ -554,50 +808,14 @@ public final class MQTTClient {
                         self.lock.unlock()
                         pingCont?.resume()
                     case MQTTMessageType.PUBLISH.rawValue:
-                        let qos = (msgType >> 1) & 0x03
-                        do {
-                            let topic: String
-                            let packetId: UInt16?
-                            let payload: Data
-                            self.lock.lock()
-                            let version = self.activeProtocolVersion
-                            if version == MQTTProtocolLevel.v5 {
-                                var map = self.topicAliasMap
-                                self.lock.unlock()
-                                (topic, packetId, payload) = try MQTT5Protocol.parsePublishV5(Data(rest), offset: 0, qos: UInt8(qos), topicAliasMap: &map)
-                                self.lock.lock()
-                                self.topicAliasMap = map
-                                self.lock.unlock()
-                            } else {
-                                self.lock.unlock()
-                                let (t, pid, pl, _) = try MQTTProtocol.parsePublish(Data(rest), offset: 0, qos: UInt8(qos))
-                                topic = t
-                                packetId = pid
-                                payload = pl
-                            }
-
-                            self.lock.lock()
-                            let cb = self.subscribedTopics[topic]
-                            let globalCb = self.onPublish
-                            self.lock.unlock()
-                            globalCb?(topic, payload)
-                            cb?(payload)
-
-                            if qos >= 1, let pid = packetId {
-                                self.lock.lock()
-                                let wPuback = self.writer
-                                self.lock.unlock()
-                                if let wPuback = wPuback {
-                                    let puback = MQTTProtocol.buildPuback(packetId: pid)
-                                    try await wPuback.write(Data(puback))
-                                    try await wPuback.drain()
-                                }
-                            }
-                        } catch {
-                            // PUBLISH parse failed: log and skip this message (don't disconnect)
-                            let hex = rest.prefix(64).map { String(format: "%02x", $0) }.joined()
-                            print("[MqttQuic] PUBLISH parse failed: \(error) restLen=\(rest.count) hex=\(hex)")
+                        await self.handlePublish(msgType: msgType, rest: rest, replyWriter: w)
+                    case MQTTMessageType.PUBREL.rawValue & 0xF0:
+                        if let w = w {
+                            try await w.write(MQTTProtocol.buildPubcomp(packetId: try MQTTProtocol.parsePubrel(rest)))
+                            try await w.drain()
                         }
+                    case MQTTMessageType.PUBACK.rawValue, MQTTMessageType.PUBREC.rawValue, MQTTMessageType.PUBCOMP.rawValue:
+                        try await self.handlePublishAck(type: type, rest: rest, writer: w)
                     default:
                         break
                     }
@@ -18,6 +18,7 @@ public class MqttQuicPlugin: CAPPlugin, CAPBridgedPlugin {
         CAPPluginMethod(name: "sendKeepalive", returnType: CAPPluginReturnPromise),
         CAPPluginMethod(name: "connect", returnType: CAPPluginReturnPromise),
         CAPPluginMethod(name: "disconnect", returnType: CAPPluginReturnPromise),
+        CAPPluginMethod(name: "migrate", returnType: CAPPluginReturnPromise),
         CAPPluginMethod(name: "publish", returnType: CAPPluginReturnPromise),
         CAPPluginMethod(name: "subscribe", returnType: CAPPluginReturnPromise),
         CAPPluginMethod(name: "unsubscribe", returnType: CAPPluginReturnPromise),
@@ -56,6 +57,25 @@ public class MqttQuicPlugin: CAPPlugin, CAPBridgedPlugin {
     }
 
     private func bundledCaPath() -> String? {
+        return bundledCaBlobPath() ?? bundledCaPemPath()
+    }
+
+    /// mqttquic_ca.bin (build-ca-store.py output) if bundled; native maps it and skips PEM parsing.
+    private func bundledCaBlobPath() -> String? {
+        for bundle in [Bundle.main, Bundle(for: MqttQuicPlugin.self)] {
+            if let path = bundle.path(forResource: "mqttquic_ca", ofType: "bin"),
+               let handle = FileHandle(forReadingAtPath: path) {
+                let magic = handle.readData(ofLength: 4)
+                handle.closeFile()
+                if magic == Data("MQCA".utf8) {
+                    return path
+                }
+            }
+        }
+        return nil
+    }
+
+    private func bundledCaPemPath() -> String? {
         // Prefer app bundle so TLS works when installed from npm pack (pod resources may be in separate .bundle)
         if let mainPath = Bundle.main.path(forResource: "mqttquic_ca", ofType: "pem"),
            let mainContents = try? String(contentsOfFile: mainPath),
@@ -73,6 +93,32 @@ public class MqttQuicPlugin: CAPPlugin, CAPBridgedPlugin {
         return nil
     }
 
+    /// transportProfile preset with any transportConfig fields laid over it; nil if the profile is
+    /// unknown or a field is not a non-negative number.
+    private func transportConfig(_ call: CAPPluginCall) -> QuicTransportConfig? {
+        guard var config = QuicTransportConfig(profile: call.getString("transportProfile") ?? "default") else {
+            return nil
+        }
+        guard let o = call.getObject("transportConfig") else {
+            return config
+        }
+        func field(_ name: String, _ value: inout UInt64) -> Bool {
+            guard let raw = o[name] else { return true }
+            guard let n = raw as? NSNumber, n.int64Value >= 0 else { return false }
+            value = n.uint64Value
+            return true
+        }
+        guard field("maxStreamsBidi", &config.maxStreamsBidi),
+              field("maxStreamsUni", &config.maxStreamsUni),
+              field("maxStreamData", &config.maxStreamData),
+              field("maxData", &config.maxData),
+              field("maxAckDelayMs", &config.maxAckDelayMs),
+              field("idleTimeoutMs", &config.idleTimeoutMs) else {
+            return nil
+        }
+        return config
+    }
+
     @objc func connect(_ call: CAPPluginCall) {
         let host = call.getString("host") ?? ""
         let port = call.getInt("port") ?? 1884
@@ -85,6 +131,12 @@ public class MqttQuicPlugin: CAPPlugin, CAPBridgedPlugin {
         let sessionExpiryInterval = call.getInt("sessionExpiryInterval")
         let caFile = call.getString("caFile")
         let caPath = call.getString("caPath")
+        let ccAlgoStr = call.getString("ccAlgo") ?? "cubic"
+        let sessionResumption = call.getBool("sessionResumption") ?? false
+        let persistSessions = call.getBool("persistSessions") ?? false
+        let transportKeepalive = call.getBool("transportKeepalive") ?? false
+        let datagrams = call.getBool("datagrams") ?? false
+        let dataStreams = call.getInt("dataStreams") ?? 0
         
         let protocolVersion: MQTTClient.ProtocolVersion
         switch protocolVersionStr {
@@ -97,6 +149,38 @@ public class MqttQuicPlugin: CAPPlugin, CAPBridgedPlugin {
             call.reject("host and clientId are required")
             return
         }
+        guard let ccAlgo = CongestionControl(option: ccAlgoStr) else {
+            call.reject("ccAlgo must be 'cubic', 'reno' or 'bbr'")
+            return
+        }
+        guard let transportConfig = transportConfig(call) else {
+            call.reject("invalid transportProfile or transportConfig")
+            return
+        }
+        if transportKeepalive, call.getObject("transportConfig")?["idleTimeoutMs"] != nil {
+            // Native sets the idle timeout to 1.5x keepalive in this mode; don't drop the caller's silently.
+            call.reject("transportConfig.idleTimeoutMs cannot be used with transportKeepalive (idle timeout is 1.5x keepalive)")
+            return
+        }
+        guard (0...32).contains(dataStreams) else {
+            call.reject("dataStreams must be between 0 and 32")
+            return
+        }
+
+        #if NGTCP2_ENABLED
+        if sessionResumption {
+            // Tickets stay in the app's Caches directory; without persistSessions they only
+            // live as long as the process.
+            var dir: String?
+            if persistSessions, let caches = FileManager.default.urls(for: .cachesDirectory, in: .userDomainMask).first {
+                let url = caches.appendingPathComponent("mqttquic_sessions", isDirectory: true)
+                if (try? FileManager.default.createDirectory(at: url, withIntermediateDirectories: true)) != nil {
+                    dir = url.path
+                }
+            }
+            NGTCP2Client.setSessionCacheDir(dir)
+        }
+        #endif
 
         Task {
             do {
@@ -150,7 +234,13 @@ public class MqttQuicPlugin: CAPPlugin, CAPBridgedPlugin {
                     password: password,
                     cleanSession: cleanSession,
                     keepalive: UInt16(keepalive),
-                    sessionExpiryInterval: sessionExpiryInterval != nil ? UInt32(sessionExpiryInterval!) : nil
+                    sessionExpiryInterval: sessionExpiryInterval != nil ? UInt32(sessionExpiryInterval!) : nil,
+                    ccAlgo: ccAlgo,
+                    transportConfig: transportConfig,
+                    sessionResumption: sessionResumption,
+                    transportKeepalive: transportKeepalive,
+                    datagrams: datagrams,
+                    dataStreams: dataStreams
                 )
                 DispatchQueue.main.async {
                     call.resolve(["connected": true])
@@ -215,6 +305,17 @@ public class MqttQuicPlugin: CAPPlugin, CAPBridgedPlugin {
         }
     }
 
+    @objc func migrate(_ call: CAPPluginCall) {
+        Task {
+            do {
+                try await client.migrate()
+                DispatchQueue.main.async { call.resolve(["migrated": true]) }
+            } catch {
+                DispatchQueue.main.async { call.reject("\(error)") }
+            }
+        }
+    }
+
     @objc func disconnect(_ call: CAPPluginCall) {
         Task {
             do {
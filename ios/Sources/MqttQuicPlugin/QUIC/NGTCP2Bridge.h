@@ -10,19 +10,149 @@ extern "C" {
 
 typedef void *NGTCP2ClientHandle;
 
+/** Transport counters. Stream byte counts cover application data only. */
+typedef struct {
+  uint64_t stream_bytes_sent;    /* handed to ngtcp2 and written into packets */
+  uint64_t stream_bytes_acked;   /* acknowledged by the peer */
+  uint64_t stream_bytes_unacked; /* sent, still retained for retransmission */
+  uint64_t stream_bytes_unsent;  /* queued, not yet written */
+  uint64_t send_buffer_bytes;    /* total memory retained by send buffers */
+  uint64_t wakeup_enqueues;      /* worker wakeup requests (stream writes, opens, closes) */
+  uint64_t wakeups;              /* requests that actually signalled the worker */
+  uint64_t recv_syscalls;        /* socket receive calls, including the final empty one */
+  uint64_t recv_packets;         /* datagrams handed to ngtcp2 */
+  uint64_t send_syscalls;        /* socket send calls */
+  uint64_t send_packets;         /* datagrams sent */
+  uint64_t path_max_udp_payload; /* current path's max UDP payload (PMTUD result) */
+  uint64_t loop_wakeups;         /* event loop passes */
+  uint64_t spurious_wakeups;     /* passes with no I/O ready and no deadline due */
+  uint64_t recv_window;          /* connection receive window after autotuning */
+  uint64_t credit_updates;       /* stream and connection flow-control limit extensions */
+  uint64_t session_resumed;      /* 1 if the TLS handshake resumed a cached session */
+  uint64_t early_data_accepted;  /* 1 if the server accepted 0-RTT data */
+  uint64_t datagrams_sent;       /* QoS 0 PUBLISH packets sent as DATAGRAM frames */
+  uint64_t datagrams_received;   /* DATAGRAM frames received */
+  uint64_t datagrams_lost;       /* DATAGRAM frames declared lost (never resent) */
+} NGTCP2ClientStats;
+
+/** Transport parameters and receive windows advertised to the server. */
+typedef struct {
+  uint64_t max_streams_bidi; /* server-initiated bidirectional streams */
+  uint64_t max_streams_uni;  /* server-initiated unidirectional streams */
+  uint64_t max_stream_data;  /* per-stream receive window, bytes */
+  uint64_t max_data;         /* connection receive window, bytes */
+  uint64_t max_ack_delay_ms; /* longest ACK hold-back; larger batches ACKs */
+  uint64_t idle_timeout_ms;  /* 0 disables the idle timeout */
+} NGTCP2TransportConfig;
+
 NGTCP2ClientHandle ngtcp2_client_create(void);
 void ngtcp2_client_destroy(NGTCP2ClientHandle handle);
 
 int ngtcp2_client_connect(NGTCP2ClientHandle handle, const char *host, uint16_t port, const char *alpn);
+/**
+ * Connect completion: result is 0 once the handshake completes (or, when 0-RTT is attempted, as
+ * soon as early data can be sent), -1 on failure, timeout or close
+ * (see ngtcp2_client_last_error). Runs on the client's worker thread; it must not close or destroy
+ * the client.
+ */
+typedef void (*ngtcp2_client_connect_cb)(int result, void *user_data);
+/**
+ * Start connecting and return without waiting for the handshake. Returns 0 if started (cb fires
+ * exactly once), or -1 if setup failed (cb is not called).
+ */
+int ngtcp2_client_connect_async(NGTCP2ClientHandle handle, const char *host, uint16_t port,
+                                const char *alpn, ngtcp2_client_connect_cb cb, void *user_data);
 int64_t ngtcp2_client_open_stream(NGTCP2ClientHandle handle);
 int ngtcp2_client_write_stream(NGTCP2ClientHandle handle, int64_t stream_id,
                                const uint8_t *data, size_t datalen, int fin);
+/** Called once when the stack no longer needs memory passed to ngtcp2_client_write_stream_nocopy. */
+typedef void (*ngtcp2_client_release_cb)(void *user_data);
+/**
+ * Queue data without copying. data must stay valid and unchanged until release(user_data)
+ * is called (after the peer acks it, or on close). On failure (-1) release is not called.
+ */
+int ngtcp2_client_write_stream_nocopy(NGTCP2ClientHandle handle, int64_t stream_id,
+                                      const uint8_t *data, size_t datalen, int fin,
+                                      ngtcp2_client_release_cb release, void *user_data);
 ssize_t ngtcp2_client_read_stream(NGTCP2ClientHandle handle, int64_t stream_id,
                                   uint8_t *buffer, size_t maxlen);
+/**
+ * Blocking read: waits up to timeout_ns for data on the stream. Returns bytes read, 0 on timeout,
+ * or -1 once the stream has ended (FIN, reset, or connection closed) with nothing left to read.
+ */
+ssize_t ngtcp2_client_read_stream_wait(NGTCP2ClientHandle handle, int64_t stream_id,
+                                       uint8_t *buffer, size_t maxlen, uint64_t timeout_ns);
+/** Enable native MQTT packet framing for streams opened afterwards. Call before ngtcp2_client_connect. */
+int ngtcp2_client_set_mqtt_framing(NGTCP2ClientHandle handle, int enabled);
+/**
+ * Largest UDP payload to send, the ceiling for path MTU discovery (0 keeps the default, 1452).
+ * pmtud = 0 stays at 1200 bytes. Call before ngtcp2_client_connect.
+ */
+int ngtcp2_client_set_path_mtu(NGTCP2ClientHandle handle, size_t max_udp_payload, int pmtud);
+/**
+ * Congestion controller, an ngtcp2_cc_algo value: 0 Reno, 1 CUBIC (the default), 2 BBR.
+ * Returns -1 for anything else. Call before ngtcp2_client_connect.
+ */
+int ngtcp2_client_set_cc_algo(NGTCP2ClientHandle handle, int cc_algo);
+/** Fill *config with the values used when ngtcp2_client_set_transport_config is never called. */
+void ngtcp2_client_transport_config_default(NGTCP2TransportConfig *config);
+/**
+ * Transport parameters for the next connect. Returns -1 (nothing changed) if a value is out of
+ * range: zero windows, max_ack_delay_ms >= 16384, or stream counts above 2^60.
+ */
+int ngtcp2_client_set_transport_config(NGTCP2ClientHandle handle,
+                                       const NGTCP2TransportConfig *config);
+/**
+ * Resume cached TLS sessions for this host/port/ALPN and send 0-RTT data when the ticket allows
+ * it. Off by default: 0-RTT data is replayable. If the server rejects it, streams are resent
+ * after the handshake. Call before ngtcp2_client_connect.
+ */
+int ngtcp2_client_set_session_resumption(NGTCP2ClientHandle handle, int enabled);
+/**
+ * Process-wide: also keep session tickets as files in dir so they survive restarts. The
+ * directory must exist and should be private to the app. NULL or "" keeps them in memory only.
+ */
+void ngtcp2_client_set_session_cache_dir(const char *dir);
+/**
+ * Send QUIC PINGs every interval_ms on an idle connection and set the idle timeout to 1.5x
+ * interval_ms, so the transport timer replaces MQTT PINGREQs (connect with keepalive 0). If the
+ * server's idle timeout is shorter, PINGs go out at half of it. 0 (default) turns it off. Call
+ * before ngtcp2_client_connect.
+ */
+int ngtcp2_client_set_keep_alive(NGTCP2ClientHandle handle, uint64_t interval_ms);
+/**
+ * Offer the QUIC DATAGRAM extension so QoS 0 PUBLISH packets can skip the stream (see
+ * ngtcp2_client_write_datagram); received ones are read from the MQTT stream like any other
+ * packet. Needs MQTT framing. Call before ngtcp2_client_connect.
+ */
+int ngtcp2_client_set_datagrams(NGTCP2ClientHandle handle, int enabled);
+/**
+ * Send one whole QoS 0 PUBLISH packet in a DATAGRAM frame: no retransmission, no head-of-line
+ * blocking. Returns -1 if it must be written to the stream instead (datagrams off or not
+ * supported by the server, handshake not finished, packet too large, or queue full).
+ */
+int ngtcp2_client_write_datagram(NGTCP2ClientHandle handle, const uint8_t *data, size_t len);
+/**
+ * Framed streams: copy the next whole MQTT packet into buffer, waiting up to timeout_ns for one.
+ * Returns the packet length, 0 on timeout, -1 once the stream has ended, or -2 if maxlen is too
+ * small (the packet stays queued and *needed holds its size).
+ */
+ssize_t ngtcp2_client_read_packet(NGTCP2ClientHandle handle, int64_t stream_id,
+                                  uint8_t *buffer, size_t maxlen, uint64_t timeout_ns,
+                                  size_t *needed);
 int ngtcp2_client_close_stream(NGTCP2ClientHandle handle, int64_t stream_id);
+/**
+ * After a network change, move the connection to a new UDP socket (same server, new local
+ * address) without a new handshake; streams stay open. Blocks until the switch is made. Returns
+ * -1 (see ngtcp2_client_last_error) before the handshake is confirmed, if the server disabled
+ * migration, or if no spare connection ID is available yet.
+ */
+int ngtcp2_client_migrate(NGTCP2ClientHandle handle);
 int ngtcp2_client_close(NGTCP2ClientHandle handle);
 int ngtcp2_client_is_connected(NGTCP2ClientHandle handle);
 const char *ngtcp2_client_last_error(NGTCP2ClientHandle handle);
+/** Fill *out with a snapshot of the connection counters. Returns 0 on success, -1 on failure. */
+int ngtcp2_client_get_stats(NGTCP2ClientHandle handle, NGTCP2ClientStats *out);
 
 /** UDP reachability check to host:port (e.g. MQTT/QUIC server). Returns 0 on success, -1 on failure. */
 int ngtcp2_ping_server(const char *host, uint16_t port);
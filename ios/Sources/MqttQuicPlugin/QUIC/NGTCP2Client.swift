@@ -30,14 +30,56 @@ public final class NGTCP2Client: QuicClientProtocol {
     private var host: String?
     private var port: UInt16?
     
+    /// Split stream data into whole MQTT packets in native (see MQTTPacketStreamProtocol)
+    private let mqttFraming: Bool
+
+    /// Set when native rejected the transport config; connect fails with it.
+    private var configError: String?
+
     /// Active streams
     private var streams: [UInt64: NGTCP2Stream] = [:]
     private let streamLock = NSLock()
     
     // MARK: - Initialization
     
-    public init() {
+    /// maxUdpPayload caps datagram size and is the ceiling for path MTU discovery (0 = native
+    /// default, 1452); pmtud false keeps packets at 1200 bytes. ccAlgo picks the congestion
+    /// controller (ngtcp2's default is CUBIC), transportConfig the advertised transport
+    /// parameters and receive windows. sessionResumption resumes the TLS session of an earlier
+    /// connection to the same broker and sends the first packets as 0-RTT when the server allows
+    /// it (replayable, so off by default; see setSessionCacheDir). keepAliveMs > 0 sends QUIC
+    /// PINGs at that interval on an idle connection, with a 1.5x idle timeout, in place of MQTT
+    /// PINGREQs (see MQTTClient's transportKeepalive). datagrams offers the QUIC DATAGRAM
+    /// extension for QoS 0 PUBLISH packets (see sendDatagram; needs mqttFraming).
+    public init(mqttFraming: Bool = true, maxUdpPayload: Int = 0, pmtud: Bool = true,
+                ccAlgo: CongestionControl = .cubic, transportConfig: QuicTransportConfig = .default,
+                sessionResumption: Bool = false, keepAliveMs: UInt64 = 0, datagrams: Bool = false) {
+        self.mqttFraming = mqttFraming
         clientHandle = ngtcp2_client_create()
+        if let h = clientHandle {
+            _ = ngtcp2_client_set_mqtt_framing(h, mqttFraming ? 1 : 0)
+            _ = ngtcp2_client_set_path_mtu(h, max(0, maxUdpPayload), pmtud ? 1 : 0)
+            _ = ngtcp2_client_set_cc_algo(h, ccAlgo.rawValue)
+            var tc = NGTCP2TransportConfig(
+                max_streams_bidi: transportConfig.maxStreamsBidi,
+                max_streams_uni: transportConfig.maxStreamsUni,
+                max_stream_data: transportConfig.maxStreamData,
+                max_data: transportConfig.maxData,
+                max_ack_delay_ms: transportConfig.maxAckDelayMs,
+                idle_timeout_ms: transportConfig.idleTimeoutMs)
+            if ngtcp2_client_set_transport_config(h, &tc) != 0 {
+                configError = "invalid transport config: \(transportConfig)"
+            }
+            _ = ngtcp2_client_set_session_resumption(h, sessionResumption ? 1 : 0)
+            _ = ngtcp2_client_set_keep_alive(h, keepAliveMs)
+            _ = ngtcp2_client_set_datagrams(h, datagrams ? 1 : 0)
+        }
+    }
+
+    /// Keep TLS session tickets as files in dir (app-private, must exist) so sessionResumption
+    /// also works after a restart; nil keeps them in memory only. Process-wide.
+    public static func setSessionCacheDir(_ dir: String?) {
+        ngtcp2_client_set_session_cache_dir(dir)
     }
     
     deinit {
@@ -72,11 +114,25 @@ public final class NGTCP2Client: QuicClientProtocol {
         guard let handle = clientHandle else {
             throw NGTCP2Error.quicError("native handle not initialized")
         }
+        if let configError = configError {
+            throw NGTCP2Error.quicError(configError)
+        }
 
+        // The handshake runs on the native worker; this task suspends until its completion fires.
         let alpn = "mqtt"
-        let rv = host.withCString { hostPtr in
-            alpn.withCString { alpnPtr in
-                ngtcp2_client_connect(handle, hostPtr, port, alpnPtr)
+        let rv: Int32 = await withCheckedContinuation { continuation in
+            let completion = Unmanaged.passRetained(ConnectCompletion(continuation))
+            let started = host.withCString { hostPtr in
+                alpn.withCString { alpnPtr in
+                    ngtcp2_client_connect_async(handle, hostPtr, port, alpnPtr, { result, userData in
+                        guard let userData = userData else { return }
+                        Unmanaged<ConnectCompletion>.fromOpaque(userData).takeRetainedValue().continuation.resume(returning: result)
+                    }, completion.toOpaque())
+                }
+            }
+            if started != 0 {
+                completion.release()
+                continuation.resume(returning: -1)
             }
         }
         if rv != 0 {
@@ -103,12 +159,40 @@ public final class NGTCP2Client: QuicClientProtocol {
             throw NGTCP2Error.quicError(lastErrorMessage())
         }
 
-        let stream = NGTCP2Stream(streamId: UInt64(streamId), client: self)
+        let stream = NGTCP2Stream(streamId: UInt64(streamId), client: self, framesMQTTPackets: mqttFraming)
         streams[UInt64(streamId)] = stream
         
         return stream
     }
     
+    /// Move the connection to a new UDP socket after a network change (same server, new local
+    /// address). Streams stay open and no new handshake is needed. Fails before the handshake is
+    /// confirmed, or if the server disabled migration or has no spare connection ID yet.
+    public func migrate() async throws {
+        guard isConnected, let handle = clientHandle else {
+            throw NGTCP2Error.notConnected
+        }
+        // Blocks until the worker has switched sockets; keep it off the cooperative pool.
+        let rv: Int32 = await withCheckedContinuation { continuation in
+            DispatchQueue.global().async {
+                continuation.resume(returning: ngtcp2_client_migrate(handle))
+            }
+        }
+        if rv != 0 {
+            throw NGTCP2Error.quicError(lastErrorMessage())
+        }
+    }
+
+    /// Queue one whole QoS 0 PUBLISH packet as a QUIC DATAGRAM (unreliable, no head-of-line
+    /// blocking). False if it has to go on the stream instead: datagrams off or not supported by
+    /// the broker, packet too large for one datagram, or the native queue full.
+    public func sendDatagram(_ packet: Data) -> Bool {
+        guard isConnected, let handle = clientHandle, !packet.isEmpty else { return false }
+        return packet.withUnsafeBytes { raw in
+            ngtcp2_client_write_datagram(handle, raw.bindMemory(to: UInt8.self).baseAddress, raw.count) == 0
+        }
+    }
+
     public func close() async throws {
         if !isConnected {
             if let handle = clientHandle {
@@ -150,14 +234,22 @@ public final class NGTCP2Client: QuicClientProtocol {
             throw NGTCP2Error.clientDisconnected
         }
 
-        let result = data.withUnsafeBytes { buffer in
-            ngtcp2_client_write_stream(handle,
-                                       Int64(streamId),
-                                       buffer.bindMemory(to: UInt8.self).baseAddress,
-                                       data.count,
-                                       0)
-        }
+        // Hand the bytes to the native send buffer without copying: the retained
+        // NSData keeps them alive until native releases it after the peer acks.
+        let box = data as NSData
+        let retained = Unmanaged.passRetained(box)
+        let result = ngtcp2_client_write_stream_nocopy(handle,
+                                                       Int64(streamId),
+                                                       box.bytes.assumingMemoryBound(to: UInt8.self),
+                                                       box.length,
+                                                       0,
+                                                       { userData in
+                                                           guard let userData = userData else { return }
+                                                           Unmanaged<NSData>.fromOpaque(userData).release()
+                                                       },
+                                                       retained.toOpaque())
         if result != 0 {
+            retained.release()
             throw NGTCP2Error.quicError(lastErrorMessage())
         }
     }
@@ -168,7 +260,19 @@ public final class NGTCP2Client: QuicClientProtocol {
         _ = data
     }
     
-    fileprivate func lastErrorMessage() -> String {
+    /// Transport counters for this connection (send buffer / ack tracking), or nil if the handle is gone.
+    public func stats() -> NGTCP2ClientStats? {
+        guard let handle = clientHandle else {
+            return nil
+        }
+        var out = NGTCP2ClientStats()
+        guard ngtcp2_client_get_stats(handle, &out) == 0 else {
+            return nil
+        }
+        return out
+    }
+
+        fileprivate func lastErrorMessage() -> String {
         guard let handle = clientHandle, let cStr = ngtcp2_client_last_error(handle) else {
             return "unknown QUIC error"
         }
@@ -178,15 +282,26 @@ public final class NGTCP2Client: QuicClientProtocol {
 
 // MARK: - NGTCP2Stream Implementation
 
+/// Boxes the continuation handed to ngtcp2_client_connect_async; native fires it exactly once.
+private final class ConnectCompletion {
+    let continuation: CheckedContinuation<Int32, Never>
+
+    init(_ continuation: CheckedContinuation<Int32, Never>) {
+        self.continuation = continuation
+    }
+}
+
 /// ngtcp2-based QUIC stream
-internal final class NGTCP2Stream: QuicStreamProtocol {
+internal final class NGTCP2Stream: QuicStreamProtocol, MQTTPacketStreamProtocol {
     let streamId: UInt64
+    let framesMQTTPackets: Bool
     private weak var client: NGTCP2Client?
     private var isClosed: Bool = false
     
-    init(streamId: UInt64, client: NGTCP2Client) {
+    init(streamId: UInt64, client: NGTCP2Client, framesMQTTPackets: Bool = false) {
         self.streamId = streamId
         self.client = client
+        self.framesMQTTPackets = framesMQTTPackets
     }
     
     func read(maxBytes: Int) async throws -> Data {
@@ -200,23 +315,76 @@ internal final class NGTCP2Stream: QuicStreamProtocol {
             throw NGTCP2Error.clientDisconnected
         }
 
+        guard maxBytes > 0 else {
+            return Data()
+        }
+
+        // Park in native until the receive callback signals data (no polling). Waits are
+        // bounded so close() and task cancellation are still noticed between slices.
         while !isClosed {
-            var buffer = [UInt8](repeating: 0, count: maxBytes)
-            let nread = buffer.withUnsafeMutableBytes { rawBuffer -> Int in
-                let ptr = rawBuffer.bindMemory(to: UInt8.self).baseAddress
-                return ngtcp2_client_read_stream(handle, Int64(streamId), ptr, maxBytes)
-            }
-            if nread < 0 {
+            try Task.checkCancellation()
+            let chunk = await readWait(handle: handle, maxBytes: maxBytes, timeoutNs: NGTCP2Stream.readWaitSliceNs)
+            if chunk.count < 0 {
                 throw NGTCP2Error.quicError(client.lastErrorMessage())
             }
-            if nread > 0 {
-                return Data(buffer.prefix(Int(nread)))
+            if let data = chunk.data {
+                return data
             }
-            try await Task.sleep(nanoseconds: 5_000_000) // 5ms backoff
         }
         return Data()
     }
+
+    private static let readWaitSliceNs: UInt64 = 250_000_000
+    private static let readWaitQueue = DispatchQueue(label: "ai.annadata.mqttquic.ngtcp2.read", attributes: .concurrent)
+
+    /// One blocking native wait, run off the cooperative pool. count is the native result; data is set when count > 0.
+    private func readWait(handle: UnsafeMutableRawPointer, maxBytes: Int, timeoutNs: UInt64) async -> (count: Int, data: Data?) {
+        let id = Int64(streamId)
+        return await withCheckedContinuation { continuation in
+            NGTCP2Stream.readWaitQueue.async {
+                var buffer = [UInt8](repeating: 0, count: maxBytes)
+                let nread = buffer.withUnsafeMutableBytes { rawBuffer -> Int in
+                    let ptr = rawBuffer.bindMemory(to: UInt8.self).baseAddress
+                    return ngtcp2_client_read_stream_wait(handle, id, ptr, maxBytes, timeoutNs)
+                }
+                continuation.resume(returning: (nread, nread > 0 ? Data(buffer.prefix(nread)) : nil))
+            }
+        }
+    }
     
+    func readPacket(timeoutNs: UInt64) async throws -> Data? {
+        guard !isClosed else {
+            throw NGTCP2Error.streamClosed
+        }
+        guard let client = client, let handle = client.clientHandle else {
+            throw NGTCP2Error.clientDisconnected
+        }
+        let id = Int64(streamId)
+        let result: (count: Int, data: Data?) = await withCheckedContinuation { continuation in
+            NGTCP2Stream.readWaitQueue.async {
+                var buffer = [UInt8](repeating: 0, count: NGTCP2Stream.packetBufferSize)
+                var needed = 0
+                var n = buffer.withUnsafeMutableBufferPointer {
+                    ngtcp2_client_read_packet(handle, id, $0.baseAddress, $0.count, timeoutNs, &needed)
+                }
+                if n == -2 {
+                    // Larger than the default buffer; the packet is still queued, so size up and retry.
+                    buffer = [UInt8](repeating: 0, count: needed)
+                    n = buffer.withUnsafeMutableBufferPointer {
+                        ngtcp2_client_read_packet(handle, id, $0.baseAddress, $0.count, 0, &needed)
+                    }
+                }
+                continuation.resume(returning: (n, n > 0 ? Data(buffer.prefix(n)) : nil))
+            }
+        }
+        if result.count < 0 {
+            throw NGTCP2Error.quicError(client.lastErrorMessage())
+        }
+        return result.data
+    }
+
+    private static let packetBufferSize = 16 * 1024
+
     func write(_ data: Data) async throws {
         guard !isClosed else {
             throw NGTCP2Error.streamClosed
@@ -15,6 +15,82 @@ public protocol QuicStreamProtocol: AnyObject {
     func close() async throws
 }
 
+/// A stream whose transport splits incoming data into whole MQTT control packets
+/// (fixed header + body) as it arrives, so callers get one packet per call.
+public protocol MQTTPacketStreamProtocol: AnyObject {
+    /// False when framing is off for this stream; readPacket must not be used then.
+    var framesMQTTPackets: Bool { get }
+    /// Next whole packet, waiting up to timeoutNs; nil on timeout. Throws once the stream has ended.
+    func readPacket(timeoutNs: UInt64) async throws -> Data?
+}
+
+/// Congestion controller for a connection; raw values are ngtcp2_cc_algo.
+public enum CongestionControl: Int32 {
+    case reno = 0
+    case cubic = 1
+    case bbr = 2
+
+    /// Parse a connect option ("reno", "cubic", "bbr"); nil if unrecognised.
+    public init?(option: String) {
+        switch option.lowercased() {
+        case "reno": self = .reno
+        case "cubic": self = .cubic
+        case "bbr": self = .bbr
+        default: return nil
+        }
+    }
+}
+
+/// Transport parameters and receive windows advertised to the server. Defaults are what native
+/// has always sent; lowPower and bulk trade battery against throughput.
+public struct QuicTransportConfig {
+    /// Server-initiated bidirectional streams.
+    public var maxStreamsBidi: UInt64 = 8
+    /// Server-initiated unidirectional streams.
+    public var maxStreamsUni: UInt64 = 8
+    /// Per-stream receive window, bytes.
+    public var maxStreamData: UInt64 = 256 * 1024
+    /// Connection receive window, bytes.
+    public var maxData: UInt64 = 1024 * 1024
+    /// Longest we hold an ACK back; larger values batch ACKs into fewer radio wakeups.
+    public var maxAckDelayMs: UInt64 = 1
+    /// 0 disables the idle timeout.
+    public var idleTimeoutMs: UInt64 = 30_000
+
+    public init() {}
+
+    public static let `default` = QuicTransportConfig()
+
+    /// Small telemetry links: 25 ms ACK batching, modest windows, 2 min idle timeout.
+    public static let lowPower: QuicTransportConfig = {
+        var c = QuicTransportConfig()
+        c.maxStreamData = 64 * 1024
+        c.maxData = 256 * 1024
+        c.maxAckDelayMs = 25
+        c.idleTimeoutMs = 120_000
+        return c
+    }()
+
+    /// High bandwidth-delay links: 4 MB stream and 16 MB connection windows.
+    public static let bulk: QuicTransportConfig = {
+        var c = QuicTransportConfig()
+        c.maxStreamData = 4 * 1024 * 1024
+        c.maxData = 16 * 1024 * 1024
+        c.maxAckDelayMs = 10
+        return c
+    }()
+
+    /// Preset for a connect option ("default", "low-power", "bulk"); nil if unrecognised.
+    public init?(profile: String) {
+        switch profile.lowercased() {
+        case "default": self = .default
+        case "low-power": self = .lowPower
+        case "bulk": self = .bulk
+        default: return nil
+        }
+    }
+}
+
 /// QUIC client: connect, TLS handshake, open one bidirectional stream.
 public protocol QuicClientProtocol: AnyObject {
     func connect(host: String, port: UInt16) async throws
@@ -33,6 +33,21 @@ public final class QUICStreamReader: MQTTStreamReaderProtocol {
         }
         return acc
     }
+
+    /// One packet per call when the stream is framed natively; otherwise framed here from the byte stream.
+    public func readPacket() async throws -> Data {
+        guard let packets = stream as? MQTTPacketStreamProtocol, packets.framesMQTTPackets else {
+            return try await readPacketBytewise()
+        }
+        while true {
+            try Task.checkCancellation()
+            if let packet = try await packets.readPacket(timeoutNs: QUICStreamReader.packetWaitSliceNs) {
+                return packet
+            }
+        }
+    }
+
+    private static let packetWaitSliceNs: UInt64 = 250_000_000
 }
 
 /// MQTTStreamWriter over a QuicStream.
@@ -13,6 +13,32 @@ import Foundation
 public protocol MQTTStreamReaderProtocol: AnyObject {
     func read(maxBytes: Int) async throws -> Data
     func readexactly(_ n: Int) async throws -> Data
+    /// Read one whole MQTT control packet (fixed header + body).
+    func readPacket() async throws -> Data
+}
+
+extension MQTTStreamReaderProtocol {
+    /// Readers over a natively framed stream override this.
+    public func readPacket() async throws -> Data {
+        try await readPacketBytewise()
+    }
+
+    /// Frame one packet from the byte stream: fixed header byte by byte via readexactly, then the body.
+    public func readPacketBytewise() async throws -> Data {
+        var packet = try await readexactly(1)
+        var remaining = 0
+        var mul = 1
+        while true {
+            if packet.count == 5 { throw MQTTProtocolError.insufficientData("remaining length") }
+            let b = try await readexactly(1)
+            packet.append(b)
+            remaining += Int(b[b.startIndex] & 0x7F) * mul
+            if b[b.startIndex] & 0x80 == 0 { break }
+            mul *= 128
+        }
+        packet.append(try await readexactly(remaining))
+        return packet
+    }
 }
 
 /// StreamWriter-like interface: write(data), drain(), close().
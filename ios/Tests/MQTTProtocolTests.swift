@@ -79,4 +79,13 @@ final class MQTTProtocolTests: XCTestCase {
         let written = buf.consumeWrite()
         XCTAssertEqual(written, Data([6, 7, 8]))
     }
+
+    /// Published 32-bit FNV-1a vectors; Android checks the same ones, so both pick the same data stream.
+    func testTopicHashKnownVectors() {
+        XCTAssertEqual(MQTTClient.topicHash(""), 0x811c9dc5)
+        XCTAssertEqual(MQTTClient.topicHash("a"), 0xe40c292c)
+        XCTAssertEqual(MQTTClient.topicHash("foobar"), 0xbf9cf968)
+        XCTAssertEqual(MQTTClient.topicHash("sensors/température"), 0xc0cac0f0)
+        XCTAssertEqual(MQTTClient.topicHash("home/+/状态"), 0x123b6cc3)
+    }
 }
@@ -113,7 +113,8 @@ export CPPFLAGS="-arch $ARCH -isysroot $IOS_SDK_PATH $VERSION_MIN"
 export LDFLAGS="-arch $ARCH -isysroot $IOS_SDK_PATH $VERSION_MIN"
 
 WOLFSSL_CONFIGURE_QUIC=""
-[ "$ENABLE_QUIC" = "1" ] && WOLFSSL_CONFIGURE_QUIC="--enable-quic"
+# Session tickets and early data back TLS resumption / 0-RTT reconnects.
+[ "$ENABLE_QUIC" = "1" ] && WOLFSSL_CONFIGURE_QUIC="--enable-quic --enable-session-ticket --enable-earlydata"
 ./configure \
     --host="${ARCH}-apple-darwin" \
     --prefix="$INSTALL_PREFIX" \
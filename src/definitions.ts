@@ -9,6 +9,51 @@ export interface MqttQuicConnectOptions {
   // TLS certificate options (QUIC only)
   caFile?: string;  // Path to CA certificate bundle (PEM)
   caPath?: string;  // Path to CA certificate directory
+  /**
+   * QUIC congestion controller (native only, default 'cubic'). 'bbr' tends to hold
+   * throughput better on lossy cellular links; 'reno' is the most conservative.
+   */
+  ccAlgo?: 'cubic' | 'reno' | 'bbr';
+  /**
+   * QUIC transport preset (native only, default 'default'). 'low-power' batches ACKs
+   * (25 ms) with small windows; 'bulk' opens 4 MB stream / 16 MB connection windows.
+   */
+  transportProfile?: 'default' | 'low-power' | 'bulk';
+  /** Per-field overrides applied on top of transportProfile (native only). */
+  transportConfig?: MqttQuicTransportConfig;
+  /**
+   * Resume the TLS session of an earlier connection to the same broker and send
+   * CONNECT as 0-RTT when the server allows it (native only, default false).
+   * 0-RTT data can be replayed by an attacker; only enable it for brokers where
+   * a repeated CONNECT is harmless.
+   */
+  sessionResumption?: boolean;
+  /** With sessionResumption: keep session tickets in the app cache across restarts. */
+  persistSessions?: boolean;
+  /**
+   * Keep the connection alive with QUIC PINGs from the native transport timer instead
+   * of MQTT PINGREQs (native only, default false). CONNECT is sent with keepalive 0;
+   * the QUIC idle timeout (1.5x keepalive) detects a dead connection instead. It
+   * replaces the profile's idle timeout; connect rejects transportConfig.idleTimeoutMs
+   * together with this option.
+   */
+  transportKeepalive?: boolean;
+  /**
+   * Send QoS 0 publishes as QUIC DATAGRAM frames when the broker supports them
+   * (native only, default false): lost ones are not resent and do not hold up
+   * the stream. Falls back to the stream otherwise, or for packets too large
+   * for one datagram. The broker must accept MQTT PUBLISH packets in DATAGRAM
+   * frames; QoS 0 messages sent this way may arrive out of order.
+   */
+  datagrams?: boolean;
+  /**
+   * Number of extra QUIC streams for PUBLISH traffic (native only, 0-32,
+   * default 0). Each topic is sent on stream FNV-1a(topic) % dataStreams, so a
+   * large message on one topic does not delay the others; the first stream
+   * still carries CONNECT, SUBSCRIBE and PING. The broker must accept PUBLISH
+   * on additional streams of the same connection.
+   */
+  dataStreams?: number;
   // MQTT 5.0 options
   protocolVersion?: '3.1.1' | '5.0' | 'auto';
   sessionExpiryInterval?: number;  // Seconds (MQTT 5.0)
@@ -36,6 +81,16 @@ export interface MqttQuicConnectOptions {
   webTransportPath?: string;
 }
 
+/** QUIC transport parameters and receive windows advertised to the server. */
+export interface MqttQuicTransportConfig {
+  maxStreamsBidi?: number;  // server-initiated bidirectional streams (default 8)
+  maxStreamsUni?: number;  // server-initiated unidirectional streams (default 8)
+  maxStreamData?: number;  // per-stream receive window, bytes (default 256 KB)
+  maxData?: number;  // connection receive window, bytes (default 1 MB)
+  maxAckDelayMs?: number;  // longest ACK hold-back, < 16384 (default 1)
+  idleTimeoutMs?: number;  // 0 disables (default 30000); not with transportKeepalive
+}
+
 export interface MqttQuicPublishOptions {
   topic: string;
   payload: string | Uint8Array;
@@ -85,6 +140,11 @@ export interface MqttQuicPlugin {
   ping(options: MqttQuicPingOptions): Promise<{ ok: boolean }>;
   connect(options: MqttQuicConnectOptions): Promise<{ connected: boolean }>;
   disconnect(): Promise<void>;
+  /**
+   * Native only: after a network change (Wi-Fi <-> cellular), move the QUIC connection to
+   * the new network without reconnecting; the MQTT session and subscriptions carry on.
+   */
+  migrate(): Promise<{ migrated: boolean }>;
   publish(options: MqttQuicPublishOptions): Promise<{ success: boolean }>;
   subscribe(options: MqttQuicSubscribeOptions): Promise<{ success: boolean }>;
   unsubscribe(options: { topic: string }): Promise<{ success: boolean }>;
@@ -248,6 +248,11 @@ export class MqttQuicWeb extends WebPlugin {
     });
   }
 
+  /** Web: the browser owns the transport; there is nothing to migrate. */
+  async migrate(): Promise<{ migrated: boolean }> {
+    return Promise.resolve({ migrated: false });
+  }
+
   async disconnect(): Promise<void> {
     if (this.wt) {
       this.wtReadAbort?.abort();